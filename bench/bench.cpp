@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "datasetFile.h"
+#include "gemm.h"
+#include "halfMatrix.h"
+#include "inference.h"
+#include "layer.h"
+#include "matrix.h"
+#include "neuralNetwork.h"
+#include "nlohmann/json.hpp"
+#include "quantizedInference.h"
+#include "simd.h"
+#include "sparseMatrix.h"
+#include "staticNetwork.h"
+#include "threadPool.h"
+#include "utils.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+  /** Only benchmarks whose name contains this run.*/
+  std::string filter;
+  /** Measure every benchmark for at least this long.*/
+  double minSeconds = 0.5;
+  /** JSON report, empty for none, "-" for stdout.*/
+  std::string jsonPath;
+  /** Threads of the thread pool, 0 means one per core.*/
+  int numberOfThreads = 0;
+};
+
+struct Benchmark {
+  std::string name;
+  /** Work done by one iteration, in units.*/
+  double work;
+  /** "flop", "byte", "value" or "sample".*/
+  std::string unit;
+  /** Runs before every iteration, not timed.*/
+  std::function<void()> prepare;
+  /** One timed iteration.*/
+  std::function<void()> run;
+};
+
+struct BenchResult {
+  std::string name;
+  std::string unit;
+  std::size_t iterations;
+  double meanSeconds;
+  double minSeconds;
+  double p50Seconds;
+  double p90Seconds;
+  double p99Seconds;
+  /** Units of work per second, from the median.*/
+  double throughput;
+};
+
+/** Sends std::cout to another buffer until it goes out of scope, on every
+ * way out of main.*/
+class CoutRedirect {
+public:
+  explicit CoutRedirect(std::streambuf *target)
+      : m_previous(std::cout.rdbuf(target)) {}
+  ~CoutRedirect() { std::cout.rdbuf(m_previous); }
+  CoutRedirect(const CoutRedirect &) = delete;
+  CoutRedirect &operator=(const CoutRedirect &) = delete;
+
+private:
+  std::streambuf *m_previous;
+};
+
+double getPercentile(const std::vector<double> &sorted, double percentile) {
+  const std::size_t index = std::min(
+      sorted.size() - 1,
+      static_cast<std::size_t>(percentile / 100.0 * sorted.size()));
+  return sorted[index];
+}
+
+BenchResult measure(const Benchmark &benchmark, double minSeconds) {
+  // One untimed run warms up caches, buffers and the thread pool.
+  if (benchmark.prepare) {
+    benchmark.prepare();
+  }
+  benchmark.run();
+
+  std::vector<double> samples;
+  double total = 0.0;
+  while (total < minSeconds || samples.size() < 10) {
+    if (benchmark.prepare) {
+      benchmark.prepare();
+    }
+    const Clock::time_point start = Clock::now();
+    benchmark.run();
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    samples.push_back(seconds);
+    total += seconds;
+  }
+  std::sort(samples.begin(), samples.end());
+
+  BenchResult result;
+  result.name = benchmark.name;
+  result.unit = benchmark.unit;
+  result.iterations = samples.size();
+  result.meanSeconds = total / samples.size();
+  result.minSeconds = samples.front();
+  result.p50Seconds = getPercentile(samples, 50);
+  result.p90Seconds = getPercentile(samples, 90);
+  result.p99Seconds = getPercentile(samples, 99);
+  result.throughput = benchmark.work / result.p50Seconds;
+  return result;
+}
+
+std::shared_ptr<Matrix> randomMatrix(int rows, int columns) {
+  return std::make_shared<Matrix>(rows, columns, true);
+}
+
+/** Write a CSV with random pixels and one hot labels, like MNIST.*/
+void writeDataset(const std::string &dataPath, const std::string &labelPath,
+                  int rows) {
+  std::mt19937 generator(7);
+  std::uniform_int_distribution<int> pixel(0, 255);
+  std::uniform_int_distribution<int> digit(0, 9);
+  std::ofstream data(dataPath);
+  std::ofstream labels(labelPath);
+  for (int row = 0; row < rows; ++row) {
+    for (int column = 0; column < 784; ++column) {
+      // Most MNIST pixels are background.
+      const int value = column % 3 == 0 ? pixel(generator) : 0;
+      data << (column == 0 ? "" : ",") << value / 255.0;
+    }
+    data << "\n";
+    const int label = digit(generator);
+    for (int column = 0; column < 10; ++column) {
+      labels << (column == 0 ? "" : ",") << (column == label ? 1 : 0);
+    }
+    labels << "\n";
+  }
+}
+
+std::string formatSeconds(double seconds) {
+  char text[32];
+  if (seconds < 1e-3) {
+    std::snprintf(text, sizeof(text), "%.2f us", seconds * 1e6);
+  } else if (seconds < 1.0) {
+    std::snprintf(text, sizeof(text), "%.2f ms", seconds * 1e3);
+  } else {
+    std::snprintf(text, sizeof(text), "%.2f s", seconds);
+  }
+  return text;
+}
+
+std::string formatThroughput(double throughput, const std::string &unit) {
+  char text[48];
+  if (unit == "flop") {
+    std::snprintf(text, sizeof(text), "%.2f GFLOP/s", throughput / 1e9);
+  } else if (unit == "byte") {
+    std::snprintf(text, sizeof(text), "%.1f MB/s", throughput / 1e6);
+  } else {
+    std::snprintf(text, sizeof(text), "%.3g %s/s", throughput, unit.c_str());
+  }
+  return text;
+}
+
+void printUsage() {
+  std::cout << "Use: ./bench [--filter <name>] [--min-time <seconds>] "
+               "[--json <file or ->] [--threads <n>]"
+            << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    if (i + 1 >= argc) {
+      printUsage();
+      return 1;
+    }
+    if (argument == "--filter") {
+      options.filter = argv[++i];
+    } else if (argument == "--min-time") {
+      options.minSeconds = std::stod(argv[++i]);
+    } else if (argument == "--json") {
+      options.jsonPath = argv[++i];
+    } else if (argument == "--threads") {
+      options.numberOfThreads = std::stoi(argv[++i]);
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+  ThreadPool::getInstance().setNumberOfThreads(options.numberOfThreads);
+
+  // The library reports loading on stdout, results go to the real one.
+  // With "--json -" stdout holds only the JSON and the table goes to
+  // stderr.
+  std::ostream output(std::cout.rdbuf());
+  std::ostream report(options.jsonPath == "-" ? std::cerr.rdbuf()
+                                              : std::cout.rdbuf());
+  std::ofstream silent;
+  const CoutRedirect redirect(silent.rdbuf());
+
+  const std::filesystem::path directory =
+      std::filesystem::temp_directory_path() /
+      ("nn_bench_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(directory);
+  const std::string dataPath = (directory / "data.csv").string();
+  const std::string labelPath = (directory / "labels.csv").string();
+  const std::string jsonWeightsPath = (directory / "weights.json").string();
+  const std::string checkpointPath = (directory / "weights.bin").string();
+  const int datasetRows = 2000;
+  writeDataset(dataPath, labelPath, datasetRows);
+  const double datasetBytes =
+      static_cast<double>(std::filesystem::file_size(dataPath));
+
+  // MNIST sized network, the shape the config files describe.
+  Params params;
+  params.numOfNeuronsActivationFunction = {
+      {784, "relu"}, {428, "relu"}, {128, "tanh"}, {10, ""}};
+  params.bias = 1.0;
+  params.learningRate = 1e-6;
+  params.momentum = 0.9;
+  params.trainingDataPath = dataPath;
+  params.labelDataPath = labelPath;
+  params.batchSize = 64;
+  params.numberOfThreads = options.numberOfThreads;
+  NeuralNetwork network(params);
+  auto dataset = Dataset::open(dataPath);
+  auto labels = Dataset::open(labelPath);
+  network.setBatch(*dataset, *labels, 0, params.batchSize);
+  network.feedForward();
+  network.setErrors();
+  const double networkFlops = 2.0 * (784.0 * 428 + 428.0 * 128 + 128.0 * 10);
+
+  std::vector<Benchmark> benchmarks;
+
+  auto sample = randomMatrix(1, 784);
+  auto weights = randomMatrix(784, 428);
+  std::shared_ptr<Matrix> product;
+  benchmarks.push_back({"matrix_operator_multiply_1x784x428",
+                        2.0 * 784 * 428, "flop", nullptr,
+                        [&] { product = (*sample) * weights; }});
+  for (int rows : {32, 64, 256}) {
+    auto left = randomMatrix(rows, 784);
+    auto result = std::make_shared<Matrix>(rows, 428, false);
+    benchmarks.push_back(
+        {"matrix_multiply_" + std::to_string(rows) + "x784x428",
+         2.0 * rows * 784 * 428, "flop", nullptr,
+         [left, weights, result] {
+           Matrix::multiply(*left, *weights, *result);
+         }});
+  }
+  auto transposed = std::make_shared<Matrix>(428, 784, false);
+  benchmarks.push_back({"matrix_transpose_784x428",
+                        2.0 * sizeof(Scalar) * 784 * 428, "byte", nullptr,
+                        [&] { weights->transpose(*transposed); }});
+  // The two products of back propagation, read without a transpose.
+  auto neurons = randomMatrix(64, 784);
+  auto gradient = randomMatrix(64, 428);
+  auto delta = std::make_shared<Matrix>(784, 428, false);
+  auto leftGradient = std::make_shared<Matrix>(64, 784, false);
+  benchmarks.push_back({"matrix_multiply_at_b_64x784x428",
+                        2.0 * 64 * 784 * 428, "flop", nullptr, [&] {
+                          Matrix::multiplyTransposedLeft(*neurons, *gradient,
+                                                         *delta);
+                        }});
+  benchmarks.push_back({"matrix_multiply_a_bt_64x428x784",
+                        2.0 * 64 * 784 * 428, "flop", nullptr, [&] {
+                          Matrix::multiplyTransposedRight(*gradient, *weights,
+                                                          *leftGradient);
+                        }});
+  // The same products with a batch of the MNIST like data, without its
+  // zeros. The work is that of the dense product, so the throughputs
+  // compare.
+  Matrix pixels(64, 784, false);
+  dataset->readRows(0, 64, pixels);
+  SparseMatrix sparsePixels;
+  sparsePixels.compress(pixels, 1.0);
+  benchmarks.push_back({"sparse_compress_64x784", 64.0 * 784, "value",
+                        nullptr, [&] { sparsePixels.compress(pixels, 1.0); }});
+  auto sparseProduct = std::make_shared<Matrix>(64, 428, false);
+  benchmarks.push_back({"sparse_multiply_64x784x428", 2.0 * 64 * 784 * 428,
+                        "flop", nullptr, [&] {
+                          SparseMatrix::multiply(sparsePixels, *weights,
+                                                 *sparseProduct);
+                        }});
+  benchmarks.push_back({"sparse_multiply_at_b_64x784x428",
+                        2.0 * 64 * 784 * 428, "flop", nullptr, [&] {
+                          SparseMatrix::multiplyTransposedLeft(
+                              sparsePixels, *gradient, *delta);
+                        }});
+  // The dense product with the weights in 16 bits, widened on the fly.
+  auto halfProduct = std::make_shared<Matrix>(64, 428, false);
+  for (const HalfType type : {HalfType::BFloat16, HalfType::Float16}) {
+    auto halfWeights = std::make_shared<HalfMatrix>(type);
+    halfWeights->assign(*weights);
+    benchmarks.push_back(
+        {"half_multiply_" + HalfMatrix::getTypeName(type) + "_64x784x428",
+         2.0 * 64 * 784 * 428, "flop", nullptr,
+         [neurons, halfWeights, halfProduct] {
+           HalfMatrix::multiply(*neurons, *halfWeights, *halfProduct);
+         }});
+  }
+
+  for (const std::string activation : {"", "relu", "tanh"}) {
+    auto layer = std::make_shared<Layer>(428, activation);
+    layer->resize(64);
+    std::copy(weights->data(), weights->data() + 64 * 428,
+              layer->layerAsMatrix()->data());
+    benchmarks.push_back(
+        {"layer_activate_" + (activation.empty() ? "sigmoid" : activation) +
+             "_64x428",
+         64.0 * 428, "value", nullptr, [layer] { layer->activate(); }});
+  }
+
+  benchmarks.push_back({"feed_forward_b64", params.batchSize * networkFlops,
+                        "flop", nullptr, [&] { network.feedForward(); }});
+  benchmarks.push_back({"back_propagation_b64", 64.0, "sample", nullptr,
+                        [&] { network.backPropagation(); }});
+
+  const Inference inference = network.createInference();
+  Matrix inputs(params.batchSize, 784, false);
+  dataset->readRows(0, params.batchSize, inputs);
+  InferenceBuffers inferenceBuffers =
+      inference.createBuffers(params.batchSize);
+  benchmarks.push_back({"inference_forward_b64",
+                        params.batchSize * networkFlops, "flop", nullptr,
+                        [&] { inference.forward(inputs, inferenceBuffers); }});
+  Matrix calibration(256, 784, false);
+  dataset->readRows(0, 256, calibration);
+  const QuantizedInference quantized(inference, calibration);
+  QuantizedBuffers quantizedBuffers = quantized.createBuffers(params.batchSize);
+  benchmarks.push_back({"quantized_forward_b64",
+                        params.batchSize * networkFlops, "flop", nullptr,
+                        [&] { quantized.forward(inputs, quantizedBuffers); }});
+
+  Inference halfInference = inference;
+  halfInference.setHalfType(HalfType::BFloat16);
+  InferenceBuffers halfBuffers = halfInference.createBuffers(params.batchSize);
+  benchmarks.push_back(
+      {"inference_forward_bf16_b64", params.batchSize * networkFlops, "flop",
+       nullptr, [&] { halfInference.forward(inputs, halfBuffers); }});
+
+  // One sample at a time, the latency of a single request.
+  Matrix oneSample(1, 784, false);
+  dataset->readRows(0, 1, oneSample);
+  InferenceBuffers sampleBuffers = inference.createBuffers(1);
+  benchmarks.push_back({"inference_forward_b1", networkFlops, "flop", nullptr,
+                        [&] { inference.forward(oneSample, sampleBuffers); }});
+  const ProductionNetwork staticNetwork(inference.getWeightMatrices(),
+                                        inference.getBias(),
+                                        inference.getInputScale());
+  Scalar staticOutput[10];
+  benchmarks.push_back(
+      {"static_forward_b1", networkFlops, "flop", nullptr,
+       [&] { staticNetwork.forward(oneSample.row(0).data(), staticOutput); }});
+
+  const std::string cachePath = DatasetFile::getCachePath(dataPath);
+  std::shared_ptr<Matrix> loaded;
+  benchmarks.push_back({"get_data_from_file_csv", datasetBytes, "byte",
+                        [&] { std::filesystem::remove(cachePath); },
+                        [&] { loaded = Utils::getDataFromFile(dataPath); }});
+  benchmarks.push_back({"get_data_from_file_cached", datasetBytes, "byte",
+                        nullptr,
+                        [&] { loaded = Utils::getDataFromFile(dataPath); }});
+
+  const auto networkWeights = network.getWeightMatrices();
+  double weightBytes = 0.0;
+  for (auto const &matrix : networkWeights) {
+    weightBytes += sizeof(Scalar) * matrix->getNumberOfRows() *
+                   matrix->getNumberOfColumns();
+  }
+  benchmarks.push_back(
+      {"save_weights_json", weightBytes, "byte", nullptr,
+       [&] { Utils::saveWeightToFile(jsonWeightsPath, networkWeights); }});
+  std::vector<std::shared_ptr<Matrix>> loadedWeights;
+  benchmarks.push_back(
+      {"load_weights_json", weightBytes, "byte", nullptr,
+       [&] { loadedWeights = Utils::loadWeights(jsonWeightsPath); }});
+  const CheckpointData checkpoint = network.getCheckpointData();
+  benchmarks.push_back({"save_checkpoint", weightBytes, "byte", nullptr,
+                        [&] { Checkpoint::save(checkpointPath, checkpoint); }});
+  CheckpointData loadedCheckpoint;
+  benchmarks.push_back(
+      {"load_checkpoint", weightBytes, "byte", nullptr,
+       [&] { loadedCheckpoint = Checkpoint::load(checkpointPath); }});
+
+  std::vector<BenchResult> results;
+  report << std::left << std::setw(38) << "benchmark" << std::right
+         << std::setw(10) << "iters" << std::setw(12) << "p50"
+         << std::setw(12) << "p90" << std::setw(12) << "p99"
+         << std::setw(20) << "throughput" << std::endl;
+  for (const Benchmark &benchmark : benchmarks) {
+    if (benchmark.name.find(options.filter) == std::string::npos) {
+      continue;
+    }
+    const BenchResult result = measure(benchmark, options.minSeconds);
+    results.push_back(result);
+    report << std::left << std::setw(38) << result.name << std::right
+           << std::setw(10) << result.iterations << std::setw(12)
+           << formatSeconds(result.p50Seconds) << std::setw(12)
+           << formatSeconds(result.p90Seconds) << std::setw(12)
+           << formatSeconds(result.p99Seconds) << std::setw(20)
+           << formatThroughput(result.throughput, result.unit) << std::endl;
+  }
+  std::filesystem::remove_all(directory);
+
+  if (!options.jsonPath.empty()) {
+    nlohmann::json json;
+    json["gemmKernel"] = Gemm::getKernelName();
+    json["int8Kernel"] = QuantizedInference::getKernelName();
+    json["halfKernel"] = HalfMatrix::getKernelName(HalfType::BFloat16);
+    json["simd"] = Simd::getLevelName(Simd::getLevel());
+    json["threads"] = ThreadPool::getInstance().getNumberOfThreads();
+    json["minSeconds"] = options.minSeconds;
+    json["benchmarks"] = nlohmann::json::array();
+    for (const BenchResult &result : results) {
+      json["benchmarks"].push_back({{"name", result.name},
+                                    {"unit", result.unit},
+                                    {"iterations", result.iterations},
+                                    {"meanSeconds", result.meanSeconds},
+                                    {"minSeconds", result.minSeconds},
+                                    {"p50Seconds", result.p50Seconds},
+                                    {"p90Seconds", result.p90Seconds},
+                                    {"p99Seconds", result.p99Seconds},
+                                    {"throughput", result.throughput}});
+    }
+    if (options.jsonPath == "-") {
+      output << json.dump(2) << std::endl;
+    } else {
+      std::ofstream file(options.jsonPath);
+      if (!file.is_open()) {
+        std::cerr << "Could not write " << options.jsonPath << std::endl;
+        return 1;
+      }
+      file << json.dump(2) << std::endl;
+    }
+  }
+  return 0;
+}
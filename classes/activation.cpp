@@ -0,0 +1,125 @@
+#include "activation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "threadPool.h"
+
+namespace {
+
+/** Arrays shorter than this are not split across threads.*/
+constexpr int kMinParallelValues = 1 << 14;
+
+template <ActivationType Type, bool Derive>
+NN_ALWAYS_INLINE void applyKernel(const Scalar *__restrict values,
+                                  Scalar *__restrict activated,
+                                  Scalar *__restrict derived,
+                                  std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    const Scalar x = values[i];
+    const Scalar f = Activation::activate<Type>(x);
+    Scalar d;
+    if constexpr (Type == ActivationType::Relu) {
+      d = f > 0 ? Scalar(1) : Scalar(0);
+    } else if constexpr (Type == ActivationType::Tanh) {
+      d = Scalar(1) - f * f;
+    } else {
+      d = f * (1 - f);
+    }
+    activated[i] = f;
+    if constexpr (Derive) {
+      derived[i] = d;
+    }
+  }
+}
+
+template <bool Derive>
+NN_ALWAYS_INLINE void applyType(ActivationType type, const Scalar *values,
+                                Scalar *activated, Scalar *derived,
+                                std::size_t size) {
+  switch (type) {
+  case ActivationType::Relu:
+    applyKernel<ActivationType::Relu, Derive>(values, activated, derived,
+                                              size);
+    break;
+  case ActivationType::Tanh:
+    applyKernel<ActivationType::Tanh, Derive>(values, activated, derived,
+                                              size);
+    break;
+  default:
+    applyKernel<ActivationType::Sigmoid, Derive>(values, activated, derived,
+                                                 size);
+    break;
+  }
+}
+
+NN_ALWAYS_INLINE void applyAny(ActivationType type, const Scalar *values,
+                               Scalar *activated, Scalar *derived,
+                               std::size_t size) {
+  // Evaluation only needs the activated values.
+  if (derived != nullptr) {
+    applyType<true>(type, values, activated, derived, size);
+  } else {
+    applyType<false>(type, values, activated, derived, size);
+  }
+}
+
+#if NN_X86
+NN_TARGET("avx512f")
+void applyAvx512(ActivationType type, const Scalar *values, Scalar *activated,
+                 Scalar *derived, std::size_t size) {
+  applyAny(type, values, activated, derived, size);
+}
+
+NN_TARGET("avx2,fma")
+void applyAvx2(ActivationType type, const Scalar *values, Scalar *activated,
+               Scalar *derived, std::size_t size) {
+  applyAny(type, values, activated, derived, size);
+}
+#endif
+
+void applyGeneric(ActivationType type, const Scalar *values,
+                  Scalar *activated, Scalar *derived, std::size_t size) {
+  applyAny(type, values, activated, derived, size);
+}
+
+using ApplyFunction = void (*)(ActivationType, const Scalar *, Scalar *,
+                               Scalar *, std::size_t);
+
+ApplyFunction selectKernel() {
+  switch (Simd::getLevel()) {
+#if NN_X86
+  case SimdLevel::Avx512:
+    return applyAvx512;
+  case SimdLevel::Avx2:
+    return applyAvx2;
+#endif
+  default:
+    return applyGeneric;
+  }
+}
+
+} // namespace
+
+ActivationType Activation::fromString(const std::string &name) {
+  if (name.empty()) {
+    return ActivationType::Sigmoid;
+  } else if (name == "relu" || name == "RELU") {
+    return ActivationType::Relu;
+  } else if (name == "tanh" || name == "TANH") {
+    return ActivationType::Tanh;
+  }
+  throw std::runtime_error("Invalid string for activation type\n");
+}
+
+void Activation::apply(ActivationType type, const Scalar *values,
+                       Scalar *activated, Scalar *derived, std::size_t size) {
+  static const ApplyFunction kernel = selectKernel();
+  ThreadPool::getInstance().parallelFor(
+      0, static_cast<int>(size), kMinParallelValues,
+      [&](int begin, int end) {
+        kernel(type, values + begin, activated + begin,
+               derived != nullptr ? derived + begin : nullptr, end - begin);
+      });
+}
@@ -0,0 +1,184 @@
+#ifndef _ACTIVATION_H
+#define _ACTIVATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "scalar.h"
+#include "simd.h"
+
+/** Activation functions a layer can use.*/
+enum class ActivationType {
+  /** Fast Sigmoid f(x) = x / (1 + |x|), the default.*/
+  Sigmoid,
+  /** Rectified linear unit f(x) = max(x, 0).*/
+  Relu,
+  /** Hyperbolic tan.*/
+  Tanh
+};
+
+class Activation {
+public:
+  /**
+   * @brief Get the activation function from its name in the config file.
+   *
+   * @param name "" for Sigmoid, "relu"/"RELU" or "tanh"/"TANH".
+   * @return ActivationType activation function.
+   */
+  static ActivationType fromString(const std::string &name);
+
+  /**
+   * @brief Calculate activated and derived values of contiguous values in
+   * one pass. Derived values are calculated from the activated ones:
+   * f(x) * (1 - f(x)) for Sigmoid, 1 - f(x)^2 for tanh and 1 or 0 for
+   * relu.
+   *
+   * @param type activation function.
+   * @param values values at the neurons.
+   * @param activated activated values are written here.
+   * @param derived derived values are written here, nullptr when only the
+   * activated values are needed.
+   * @param size number of values.
+   */
+  static void apply(ActivationType type, const Scalar *values,
+                    Scalar *activated, Scalar *derived, std::size_t size);
+
+  /**
+   * @brief Activated value of one neuron, with the same formulas apply()
+   * uses, for kernels that fuse the activation into their own loop.
+   *
+   * @tparam Type activation function.
+   * @param x value at the neuron.
+   * @return Scalar activated value.
+   */
+  template <ActivationType Type>
+  static NN_ALWAYS_INLINE Scalar activate(Scalar x) {
+    if constexpr (Type == ActivationType::Relu) {
+      return x > 0 ? x : Scalar(0);
+    } else if constexpr (Type == ActivationType::Tanh) {
+      return tanhValue(x);
+    } else {
+      return x / (1 + std::fabs(x));
+    }
+  }
+
+private:
+  /**
+   * exp(x) for 0 <= x <= 40 without branches or library calls, so the loop
+   * around it vectorizes. x = n * ln2 + r, exp(r) comes from a Pade
+   * approximation and 2^n is put straight into the exponent bits (Cephes
+   * exp, within 1 ulp).
+   */
+  static NN_ALWAYS_INLINE double expValue(double x) {
+    // Adding 1.5 * 2^52 rounds to an integer that ends up in the low bits.
+    constexpr double shifter = 6755399441055744.0;
+    constexpr std::int64_t shifterBits = 0x4338000000000000LL;
+    const double shifted = x * 1.4426950408889634073599 + shifter;
+    const double n = shifted - shifter;
+    double r = x - n * 6.93145751953125E-1;
+    r -= n * 1.42860682030941723212E-6;
+
+    const double rr = r * r;
+    const double p =
+        r * ((1.26177193074810590878E-4 * rr + 3.02994407707441961300E-2) * rr +
+             9.99999999999999999910E-1);
+    const double q = ((3.00198505138664455042E-6 * rr +
+                       2.52448340349684104192E-3) *
+                          rr +
+                      2.27265548208155028766E-1) *
+                         rr +
+                     2.00000000000000000009E0;
+    const double expR = 1.0 + 2.0 * (p / (q - p));
+
+    std::int64_t bits;
+    std::memcpy(&bits, &shifted, sizeof(bits));
+    const std::int64_t scaleBits = (bits - shifterBits + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &scaleBits, sizeof(scale));
+    return expR * scale;
+  }
+
+  /**
+   * tanh(x) without branches (Cephes tanh): a rational approximation for
+   * |x| < 0.625, 1 - 2 / (exp(2|x|) + 1) elsewhere. |x| is clamped to 20
+   * where tanh is 1 in double precision.
+   */
+  static NN_ALWAYS_INLINE double tanhValue(double x) {
+    const double z = x * x;
+    const double p =
+        (-9.64399179425052238628E-1 * z - 9.92877231001918586564E1) * z -
+        1.61468768441708447952E3;
+    const double q =
+        ((z + 1.12811678491632931402E2) * z + 2.23548839060100448583E3) * z +
+        4.84406305325125486048E3;
+    const double small = x + x * z * (p / q);
+
+    const double magnitude = std::min(std::fabs(x), 20.0);
+    const double large =
+        std::copysign(1.0 - 2.0 / (expValue(2.0 * magnitude) + 1.0), x);
+    return std::fabs(x) < 0.625 ? small : large;
+  }
+
+  /**
+   * expValue in single precision for 0 <= x <= 40 (Cephes expf, within 1
+   * ulp): 2^n goes into the exponent bits, exp(r) is a polynomial.
+   */
+  static NN_ALWAYS_INLINE float expValue(float x) {
+    // Adding 1.5 * 2^23 rounds to an integer that ends up in the low bits.
+    constexpr float shifter = 12582912.0f;
+    constexpr std::int32_t shifterBits = 0x4B400000;
+    const float shifted = x * 1.44269504088896341f + shifter;
+    const float n = shifted - shifter;
+    float r = x - n * 0.693359375f;
+    r -= n * -2.12194440e-4f;
+
+    const float rr = r * r;
+    const float expR =
+        ((((((1.9875691500E-4f * r + 1.3981999507E-3f) * r +
+             8.3334519073E-3f) *
+                r +
+            4.1665795894E-2f) *
+               r +
+           1.6666665459E-1f) *
+              r +
+          5.0000001201E-1f) *
+             rr +
+         r) +
+        1.0f;
+
+    std::int32_t bits;
+    std::memcpy(&bits, &shifted, sizeof(bits));
+    const std::int32_t scaleBits = (bits - shifterBits + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &scaleBits, sizeof(scale));
+    return expR * scale;
+  }
+
+  /**
+   * tanhValue in single precision (Cephes tanhf), |x| is clamped to 10
+   * where tanh is 1 in single precision.
+   */
+  static NN_ALWAYS_INLINE float tanhValue(float x) {
+    const float z = x * x;
+    const float small =
+        ((((-5.70498872745E-3f * z + 2.06390887954E-2f) * z -
+           5.37397155531E-2f) *
+              z +
+          1.33314422036E-1f) *
+             z -
+         3.33332819422E-1f) *
+            z * x +
+        x;
+
+    const float magnitude = std::min(std::fabs(x), 10.0f);
+    const float large =
+        std::copysign(1.0f - 2.0f / (expValue(2.0f * magnitude) + 1.0f), x);
+    return std::fabs(x) < 0.625f ? small : large;
+  }
+};
+
+#endif // _ACTIVATION_H
@@ -0,0 +1,74 @@
+#ifndef _ALIGNED_ALLOCATOR_H
+#define _ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "allocationCounter.h"
+
+/** Alignment of every matrix buffer, one cache line (and one AVX-512
+ * register).*/
+constexpr std::size_t kMatrixAlignment = 64;
+
+/**
+ * @brief Minimal standard allocator returning memory aligned to Alignment
+ * bytes, so std::vector can be used as a SIMD friendly buffer.
+ *
+ * @tparam T type of the allocated elements.
+ * @tparam Alignment alignment in bytes, must be a power of two.
+ */
+template <typename T, std::size_t Alignment = kMatrixAlignment>
+class AlignedAllocator {
+public:
+  using value_type = T;
+
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() noexcept = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+  /**
+   * @brief Allocate memory for n elements.
+   *
+   * @param n number of elements.
+   * @return T* pointer aligned to Alignment bytes.
+   */
+  T *allocate(std::size_t n) {
+    if (n == 0) {
+      return nullptr;
+    }
+    // std::aligned_alloc needs a size that is a multiple of the alignment.
+    std::size_t bytes = n * sizeof(T);
+    bytes = (bytes + Alignment - 1) / Alignment * Alignment;
+    void *memory = std::aligned_alloc(Alignment, bytes);
+    if (memory == nullptr) {
+      throw std::bad_alloc();
+    }
+    AllocationCounter::count(bytes);
+    return static_cast<T *>(memory);
+  }
+
+  /**
+   * @brief Release memory returned by allocate.
+   *
+   * @param memory pointer returned by allocate.
+   */
+  void deallocate(T *memory, std::size_t) noexcept { std::free(memory); }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return false;
+  }
+};
+
+#endif // _ALIGNED_ALLOCATOR_H
@@ -0,0 +1,21 @@
+#include "allocationCounter.h"
+
+#include <atomic>
+
+namespace {
+std::atomic<std::size_t> g_allocations{0};
+std::atomic<std::size_t> g_bytes{0};
+} // namespace
+
+void AllocationCounter::count(std::size_t bytes) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+std::size_t AllocationCounter::getAllocations() {
+  return g_allocations.load(std::memory_order_relaxed);
+}
+
+std::size_t AllocationCounter::getBytes() {
+  return g_bytes.load(std::memory_order_relaxed);
+}
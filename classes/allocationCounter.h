@@ -0,0 +1,37 @@
+#ifndef _ALLOCATION_COUNTER_H
+#define _ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+/**
+ * @brief Counts the heap allocations of the process: every buffer of an
+ * AlignedAllocator, and every operator new in train, which links the
+ * counting replacements of src/countingNew.cpp. Counting is one relaxed
+ * atomic add, cheap enough to stay on in production runs.
+ */
+class AllocationCounter {
+public:
+  /**
+   * @brief Count one allocation.
+   *
+   * @param bytes size of the allocation.
+   */
+  static void count(std::size_t bytes);
+
+  /**
+   * @brief Get the number of allocations since the start of the process.
+   *
+   * @return std::size_t number of allocations.
+   */
+  static std::size_t getAllocations();
+
+  /**
+   * @brief Get the number of bytes allocated since the start of the
+   * process, freed memory is not subtracted.
+   *
+   * @return std::size_t allocated bytes.
+   */
+  static std::size_t getBytes();
+};
+
+#endif // _ALLOCATION_COUNTER_H
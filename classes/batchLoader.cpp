@@ -0,0 +1,155 @@
+#include "batchLoader.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+double BatchLoaderStatistics::getAverageQueueDepth() const {
+  return batches == 0 ? 0.0 : static_cast<double>(queueDepthSum) / batches;
+}
+
+BatchLoader::BatchLoader(std::shared_ptr<Dataset> data,
+                         std::shared_ptr<Dataset> labels,
+                         std::size_t numberOfEpochs,
+                         const BatchLoaderOptions &options)
+    : m_data(std::move(data)), m_labels(std::move(labels)),
+      m_numberOfEpochs(numberOfEpochs), m_options(options), m_head(0),
+      m_ready(0), m_stop(false) {
+  if (m_data->getNumberOfRows() != m_labels->getNumberOfRows()) {
+    throw std::runtime_error(
+        "Training data and labels have a different number of rows.");
+  }
+  m_options.batchSize = std::max<std::size_t>(1, m_options.batchSize);
+  m_options.prefetchDepth = std::max<std::size_t>(1, m_options.prefetchDepth);
+  m_batches.resize(m_options.prefetchDepth);
+  m_thread = std::thread(&BatchLoader::run, this);
+}
+
+BatchLoader::~BatchLoader() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_bufferFree.notify_all();
+  m_thread.join();
+}
+
+void BatchLoader::fill(Batch &batch, std::size_t first, std::size_t count) {
+  batch.isEndOfEpoch = false;
+  batch.firstSample = first;
+  if (m_options.shuffle) {
+    m_data->gatherRows(m_order.data() + first, count, batch.inputs);
+    m_labels->gatherRows(m_order.data() + first, count, batch.targets);
+  } else {
+    m_data->readRows(first, count, batch.inputs);
+    m_labels->readRows(first, count, batch.targets);
+  }
+  if (m_options.inputScale != 1.0) {
+    for (int row = 0; row < batch.inputs.getNumberOfRows(); ++row) {
+      Scalar *values = batch.inputs.row(row).data();
+      for (int column = 0; column < batch.inputs.getNumberOfColumns();
+           ++column) {
+        values[column] *= m_options.inputScale;
+      }
+    }
+  }
+}
+
+void BatchLoader::run() {
+  const std::size_t numberOfSamples = m_data->getNumberOfRows();
+  if (m_options.shuffle) {
+    m_order.resize(numberOfSamples);
+  }
+  try {
+    for (std::size_t epoch = m_options.firstEpoch; epoch < m_numberOfEpochs;
+         ++epoch) {
+      if (m_options.shuffle) {
+        std::iota(m_order.begin(), m_order.end(), 0);
+        std::mt19937_64 generator(m_options.seed + epoch);
+        std::shuffle(m_order.begin(), m_order.end(), generator);
+      }
+      // A resumed epoch starts where the checkpoint stopped. The last step
+      // of every epoch only publishes the end marker.
+      std::size_t first = epoch == m_options.firstEpoch
+                              ? std::min(m_options.firstSample, numberOfSamples)
+                              : 0;
+      while (true) {
+        std::size_t slot;
+        {
+          const auto waitStart = Clock::now();
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_bufferFree.wait(
+              lock, [this] { return m_stop || m_ready < m_batches.size(); });
+          m_statistics.idleSeconds +=
+              std::chrono::duration<double>(Clock::now() - waitStart).count();
+          if (m_stop) {
+            return;
+          }
+          // The slot after the ready ones is not touched by the consumer,
+          // the one it uses is counted as ready until it is released.
+          slot = (m_head + m_ready) % m_batches.size();
+        }
+        Batch &batch = m_batches[slot];
+        const bool isEndOfEpoch = first == numberOfSamples;
+        if (isEndOfEpoch) {
+          batch.isEndOfEpoch = true;
+        } else {
+          const std::size_t count =
+              std::min(m_options.batchSize, numberOfSamples - first);
+          fill(batch, first, count);
+          first += count;
+        }
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          ++m_ready;
+        }
+        m_batchReady.notify_one();
+        if (isEndOfEpoch) {
+          break;
+        }
+      }
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_error = std::current_exception();
+  }
+  m_batchReady.notify_one();
+}
+
+const Batch *BatchLoader::next() {
+  const auto waitStart = Clock::now();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  const std::size_t queueDepth = m_ready;
+  m_batchReady.wait(lock, [this] { return m_ready > 0 || m_error; });
+  m_statistics.stallSeconds +=
+      std::chrono::duration<double>(Clock::now() - waitStart).count();
+  if (m_ready == 0) {
+    std::rethrow_exception(m_error);
+  }
+  const Batch &batch = m_batches[m_head];
+  if (batch.isEndOfEpoch) {
+    lock.unlock();
+    release();
+    return nullptr;
+  }
+  ++m_statistics.batches;
+  m_statistics.queueDepthSum += queueDepth;
+  return &batch;
+}
+
+void BatchLoader::release() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_head = (m_head + 1) % m_batches.size();
+    --m_ready;
+  }
+  m_bufferFree.notify_one();
+}
+
+BatchLoaderStatistics BatchLoader::takeStatistics() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  BatchLoaderStatistics statistics = m_statistics;
+  m_statistics = BatchLoaderStatistics();
+  return statistics;
+}
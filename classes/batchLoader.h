@@ -0,0 +1,148 @@
+#ifndef _BATCH_LOADER_H
+#define _BATCH_LOADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dataset.h"
+#include "matrix.h"
+
+/** How the batches of an epoch are prepared.*/
+struct BatchLoaderOptions {
+  /** Samples in one batch, the last batch of an epoch may be smaller.*/
+  std::size_t batchSize = 1;
+  /** Buffers in the ring. A batch holds its buffer until it is released,
+   * so releasing it right after copying lets all of them fill ahead.*/
+  std::size_t prefetchDepth = 2;
+  /** Visit the samples in a new random order every epoch.*/
+  bool shuffle = false;
+  /** Seed of the order, epoch e uses seed + e, so runs repeat.*/
+  std::uint64_t seed = 0;
+  /** Every input value is multiplied by this, 1 leaves them as they are.*/
+  double inputScale = 1.0;
+  /** Epoch to start with, earlier ones are skipped.*/
+  std::size_t firstEpoch = 0;
+  /** Samples of the first epoch that are skipped, in the epoch's order.*/
+  std::size_t firstSample = 0;
+};
+
+/** Samples and targets of one batch, one sample per row.*/
+struct Batch {
+  Matrix inputs{0, 0, false};
+  Matrix targets{0, 0, false};
+  /** Position of the first sample within its epoch.*/
+  std::size_t firstSample = 0;
+  /** Set on the marker that closes an epoch, it holds no samples.*/
+  bool isEndOfEpoch = false;
+};
+
+/** Counters that show whether training waits for its input.*/
+struct BatchLoaderStatistics {
+  /** Batches handed to the consumer.*/
+  std::size_t batches = 0;
+  /** Time the consumer waited for a batch that was not ready.*/
+  double stallSeconds = 0.0;
+  /** Time the loader waited for a free buffer.*/
+  double idleSeconds = 0.0;
+  /** Ready batches seen by the consumer, summed over all requests.*/
+  std::size_t queueDepthSum = 0;
+
+  /**
+   * @brief Get the mean number of batches that were ready when the consumer
+   * asked for one. Near prefetchDepth the loader keeps up, near 0 training
+   * is input bound.
+   *
+   * @return double mean queue depth.
+   */
+  double getAverageQueueDepth() const;
+};
+
+/**
+ * @brief Prepares batches on a background thread while the current one is
+ * in use. Batches go through a fixed ring of buffers, so nothing is
+ * allocated once every buffer has held a full batch.
+ *
+ * The consumer calls next() until it returns nullptr, which marks the end of
+ * an epoch, and release() after it is done with every batch.
+ */
+class BatchLoader {
+public:
+  /**
+   * @brief Construct a new Batch Loader object and start preparing the
+   * first epoch.
+   *
+   * @param data samples.
+   * @param labels targets, one per sample.
+   * @param numberOfEpochs number of passes over the samples, counting the
+   * skipped ones.
+   * @param options how batches are prepared.
+   */
+  BatchLoader(std::shared_ptr<Dataset> data, std::shared_ptr<Dataset> labels,
+              std::size_t numberOfEpochs, const BatchLoaderOptions &options);
+
+  /**
+   * @brief Destroy the Batch Loader object, stops the loader thread.
+   *
+   */
+  virtual ~BatchLoader();
+
+  BatchLoader(const BatchLoader &) = delete;
+  BatchLoader &operator=(const BatchLoader &) = delete;
+
+  /**
+   * @brief Wait for the next batch.
+   *
+   * @return const Batch* the batch, valid until release(). nullptr at the
+   * end of an epoch.
+   * @throws whatever reading the datasets threw on the loader thread.
+   */
+  const Batch *next();
+
+  /**
+   * @brief Hand the batch returned by next() back to the loader.
+   *
+   */
+  void release();
+
+  /**
+   * @brief Get the counters and reset them.
+   *
+   * @return BatchLoaderStatistics counters since the last call.
+   */
+  BatchLoaderStatistics takeStatistics();
+
+private:
+  void run();
+  void fill(Batch &batch, std::size_t first, std::size_t count);
+
+  using Clock = std::chrono::steady_clock;
+
+  std::shared_ptr<Dataset> m_data;
+  std::shared_ptr<Dataset> m_labels;
+  std::size_t m_numberOfEpochs;
+  BatchLoaderOptions m_options;
+  /** Order of the samples in the current epoch.*/
+  std::vector<std::size_t> m_order;
+  /** Ring of buffers, m_ready of them starting at m_head are ready.*/
+  std::vector<Batch> m_batches;
+  std::size_t m_head;
+  std::size_t m_ready;
+  std::mutex m_mutex;
+  /** Signalled when a batch is ready.*/
+  std::condition_variable m_batchReady;
+  /** Signalled when a buffer is free.*/
+  std::condition_variable m_bufferFree;
+  bool m_stop;
+  /** Error of the loader thread, rethrown by next().*/
+  std::exception_ptr m_error;
+  BatchLoaderStatistics m_statistics;
+  std::thread m_thread;
+};
+
+#endif // _BATCH_LOADER_H
@@ -0,0 +1,39 @@
+#include "binaryDataset.h"
+
+#include <cstring>
+
+#include "datasetFile.h"
+
+BinaryDataset::BinaryDataset(const std::string &filePath)
+    : m_values(DatasetFile::map(filePath)) {}
+
+std::size_t BinaryDataset::getNumberOfRows() const {
+  return m_values->getNumberOfRows();
+}
+
+int BinaryDataset::getNumberOfColumns() const {
+  return m_values->getNumberOfColumns();
+}
+
+void BinaryDataset::readRows(std::size_t first, std::size_t count,
+                             Matrix &destination) const {
+  checkRange(first, count);
+  destination.resize(count, getNumberOfColumns());
+  for (std::size_t row = 0; row < count; ++row) {
+    std::memcpy(destination.row(row).data(), m_values->row(first + row).data(),
+                sizeof(Scalar) * getNumberOfColumns());
+  }
+}
+
+void BinaryDataset::gatherRows(const std::size_t *indices, std::size_t count,
+                               Matrix &destination) const {
+  destination.resize(count, getNumberOfColumns());
+  for (std::size_t row = 0; row < count; ++row) {
+    checkRange(indices[row], 1);
+    std::memcpy(destination.row(row).data(),
+                m_values->row(indices[row]).data(),
+                sizeof(Scalar) * getNumberOfColumns());
+  }
+}
+
+std::shared_ptr<Matrix> BinaryDataset::readAll() const { return m_values; }
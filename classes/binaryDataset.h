@@ -0,0 +1,40 @@
+#ifndef _BINARY_DATASET_H
+#define _BINARY_DATASET_H
+
+#include "dataset.h"
+
+/**
+ * @brief Dataset in the binary format of DatasetFile. The file is memory
+ * mapped, pages are read from disk when their samples are used and can be
+ * dropped by the kernel again under memory pressure.
+ */
+class BinaryDataset : public Dataset {
+public:
+  /**
+   * @brief Construct a new Binary Dataset object.
+   *
+   * @param filePath path to a binary dataset file.
+   * @throws std::runtime_error when the file is not a valid dataset.
+   */
+  explicit BinaryDataset(const std::string &filePath);
+
+  std::size_t getNumberOfRows() const override;
+  int getNumberOfColumns() const override;
+  void readRows(std::size_t first, std::size_t count,
+                Matrix &destination) const override;
+  void gatherRows(const std::size_t *indices, std::size_t count,
+                  Matrix &destination) const override;
+
+  /**
+   * @brief The mapped samples themselves, nothing is copied.
+   *
+   * @return std::shared_ptr<Matrix> all samples, one per row.
+   */
+  std::shared_ptr<Matrix> readAll() const override;
+
+private:
+  /** Matrix over the mapped values.*/
+  std::shared_ptr<Matrix> m_values;
+};
+
+#endif // _BINARY_DATASET_H
@@ -0,0 +1,281 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "mappedFile.h"
+
+namespace {
+constexpr char kMagic[8] = {'N', 'N', 'C', 'K', 'P', 'T', '\0', '\0'};
+/** Types of the stored values.*/
+constexpr std::uint32_t kDoubleType = 1;
+constexpr std::uint32_t kFloatType = 2;
+constexpr std::uint32_t kBFloat16Type = 3;
+constexpr std::uint32_t kFloat16Type = 4;
+/** Matrices are written in the type they have in this build.*/
+constexpr std::uint32_t kScalarType =
+    sizeof(Scalar) == sizeof(double) ? kDoubleType : kFloatType;
+/** Every matrix starts at a multiple of this offset.*/
+constexpr std::uint64_t kAlignment = 64;
+
+constexpr std::uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr std::uint64_t kFnvPrime = 1099511628211ull;
+
+std::uint64_t hashBytes(std::uint64_t hash, const void *data,
+                        std::size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+std::uint64_t alignUp(std::uint64_t offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+/** Widen a matrix stored in 16 bits into a new matrix.*/
+std::shared_ptr<Matrix> widenMatrix(const char *bytes, int rows, int columns,
+                                    HalfType type) {
+  auto matrix = std::make_shared<Matrix>(rows, columns, false);
+  const std::uint16_t *values = reinterpret_cast<const std::uint16_t *>(bytes);
+  for (int row = 0; row < rows; ++row) {
+    HalfMatrix::widen(values + static_cast<std::size_t>(row) * columns,
+                      matrix->row(row).data(), columns, type);
+  }
+  return matrix;
+}
+
+std::size_t getValueSize(std::uint32_t type) {
+  switch (type) {
+  case kDoubleType:
+    return sizeof(double);
+  case kFloatType:
+    return sizeof(float);
+  default:
+    return sizeof(std::uint16_t);
+  }
+}
+
+/** Writes bytes and hashes everything after the header.*/
+class HashingWriter {
+public:
+  explicit HashingWriter(std::ofstream &file)
+      : m_file(file), m_hash(kFnvOffset), m_offset(0) {}
+
+  void write(const void *data, std::size_t size) {
+    m_file.write(static_cast<const char *>(data), size);
+    m_hash = hashBytes(m_hash, data, size);
+    m_offset += size;
+  }
+
+  void padTo(std::uint64_t offset) {
+    static const char zeros[kAlignment] = {};
+    write(zeros, offset - m_offset);
+  }
+
+  std::uint64_t getHash() const { return m_hash; }
+  std::uint64_t getOffset() const { return m_offset; }
+
+private:
+  std::ofstream &m_file;
+  std::uint64_t m_hash;
+  std::uint64_t m_offset;
+};
+} // namespace
+
+bool Checkpoint::isCheckpoint(const std::string &filePath) {
+  std::ifstream file(filePath, std::ios::binary);
+  char magic[sizeof(kMagic)];
+  return file.read(magic, sizeof(magic)) &&
+         std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+void Checkpoint::save(const std::string &filePath,
+                      const CheckpointData &data, HalfType storage) {
+  const std::size_t numberOfLayers = data.layerSizes.size();
+  if (data.activations.size() != numberOfLayers ||
+      data.weights.size() + 1 != numberOfLayers) {
+    throw std::runtime_error("Weights do not fit the topology.");
+  }
+  const std::size_t numberOfWeights = data.weights.size();
+  if (numberOfWeights == 0 ||
+      data.optimizerState.size() % numberOfWeights != 0) {
+    throw std::runtime_error("Optimizer state does not fit the weights.");
+  }
+  auto fits = [&](const Matrix &matrix, std::size_t index) {
+    return matrix.getNumberOfRows() == data.layerSizes[index] &&
+           matrix.getNumberOfColumns() == data.layerSizes[index + 1];
+  };
+  for (std::size_t i = 0; i < numberOfWeights; ++i) {
+    if (!fits(*data.weights[i], i)) {
+      throw std::runtime_error("Weights do not fit the topology.");
+    }
+  }
+  for (std::size_t i = 0; i < data.optimizerState.size(); ++i) {
+    if (!fits(*data.optimizerState[i], i % numberOfWeights)) {
+      throw std::runtime_error("Optimizer state does not fit the weights.");
+    }
+  }
+
+  CheckpointHeader header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  switch (storage) {
+  case HalfType::BFloat16:
+    header.type = kBFloat16Type;
+    break;
+  case HalfType::Float16:
+    header.type = kFloat16Type;
+    break;
+  default:
+    header.type = kScalarType;
+    break;
+  }
+  header.numberOfLayers = numberOfLayers;
+  header.numberOfStates = storage == HalfType::None
+                              ? data.optimizerState.size() / numberOfWeights
+                              : 0;
+  header.epoch = data.epoch;
+  header.sampleOffset = data.sampleOffset;
+  header.epochErrorSum = data.epochErrorSum;
+
+  const std::string temporaryPath = filePath + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    // The header is written again once the checksum is known.
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    HashingWriter writer(file);
+    for (std::size_t i = 0; i < numberOfLayers; ++i) {
+      const CheckpointLayer layer{
+          static_cast<std::uint32_t>(data.layerSizes[i]),
+          static_cast<std::uint32_t>(data.activations[i])};
+      writer.write(&layer, sizeof(layer));
+    }
+    std::vector<std::uint16_t> halfRow;
+    auto writeMatrix = [&](const Matrix &matrix) {
+      writer.padTo(alignUp(sizeof(header) + writer.getOffset()) -
+                   sizeof(header));
+      const int columns = matrix.getNumberOfColumns();
+      for (int row = 0; row < matrix.getNumberOfRows(); ++row) {
+        if (storage == HalfType::None) {
+          writer.write(matrix.row(row).data(), sizeof(Scalar) * columns);
+        } else {
+          halfRow.resize(columns);
+          HalfMatrix::narrow(matrix.row(row).data(), halfRow.data(), columns,
+                             storage);
+          writer.write(halfRow.data(), sizeof(std::uint16_t) * columns);
+        }
+      }
+    };
+    for (const auto &weights : data.weights) {
+      writeMatrix(*weights);
+    }
+    if (storage == HalfType::None) {
+      for (const auto &state : data.optimizerState) {
+        writeMatrix(*state);
+      }
+    }
+    header.checksum = writer.getHash();
+    header.fileSize = sizeof(header) + writer.getOffset();
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (!file) {
+      std::remove(temporaryPath.c_str());
+      throw std::runtime_error("Can not write a file " + temporaryPath);
+    }
+  }
+  if (std::rename(temporaryPath.c_str(), filePath.c_str()) != 0) {
+    std::remove(temporaryPath.c_str());
+    throw std::runtime_error("Can not write a file " + filePath);
+  }
+}
+
+CheckpointData Checkpoint::load(const std::string &filePath) {
+  auto file = std::make_shared<MappedFile>(filePath, true);
+  CheckpointHeader header;
+  if (file->size() < sizeof(header)) {
+    throw std::runtime_error(filePath + " is not a checkpoint.");
+  }
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error(filePath + " is not a checkpoint.");
+  }
+  if (header.version == 0 || header.version > kVersion ||
+      header.type < kDoubleType || header.type > kFloat16Type) {
+    throw std::runtime_error(filePath +
+                             " has an unsupported version or value type.");
+  }
+  if (header.fileSize != file->size()) {
+    throw std::runtime_error(filePath + " is truncated.");
+  }
+  if (hashBytes(kFnvOffset, file->data() + sizeof(header),
+                file->size() - sizeof(header)) != header.checksum) {
+    throw std::runtime_error(filePath + " is corrupted, checksum mismatch.");
+  }
+
+  const std::size_t valueSize = getValueSize(header.type);
+  CheckpointData data;
+  std::uint64_t offset = sizeof(header);
+  if (offset + header.numberOfLayers * sizeof(CheckpointLayer) >
+      file->size()) {
+    throw std::runtime_error(filePath + " is truncated.");
+  }
+  for (std::uint32_t i = 0; i < header.numberOfLayers; ++i) {
+    CheckpointLayer layer;
+    std::memcpy(&layer, file->data() + offset, sizeof(layer));
+    offset += sizeof(layer);
+    if (layer.activation > static_cast<std::uint32_t>(ActivationType::Tanh)) {
+      throw std::runtime_error(filePath + " has an unknown activation.");
+    }
+    data.layerSizes.push_back(static_cast<int>(layer.numberOfNeurons));
+    data.activations.push_back(static_cast<ActivationType>(layer.activation));
+  }
+  if (header.numberOfLayers < 2) {
+    throw std::runtime_error(filePath + " has no weights.");
+  }
+  const std::uint32_t numberOfWeights = header.numberOfLayers - 1;
+  for (std::uint32_t i = 0; i < numberOfWeights * (header.numberOfStates + 1);
+       ++i) {
+    offset = alignUp(offset);
+    const int rows = data.layerSizes[i % numberOfWeights];
+    const int columns = data.layerSizes[i % numberOfWeights + 1];
+    const std::uint64_t size =
+        static_cast<std::uint64_t>(rows) * columns * valueSize;
+    if (offset + size > file->size()) {
+      throw std::runtime_error(filePath + " is truncated.");
+    }
+    std::shared_ptr<Matrix> matrix;
+    if (header.type == kScalarType) {
+      Scalar *values =
+          reinterpret_cast<Scalar *>(file->writableData() + offset);
+      matrix = std::make_shared<Matrix>(rows, columns, values, file);
+    } else if (header.type == kDoubleType) {
+      // Written by a build with the other Scalar type.
+      matrix = Matrix::convert(
+          reinterpret_cast<const double *>(file->data() + offset), rows,
+          columns);
+    } else if (header.type == kFloatType) {
+      matrix = Matrix::convert(
+          reinterpret_cast<const float *>(file->data() + offset), rows,
+          columns);
+    } else {
+      matrix = widenMatrix(file->data() + offset, rows, columns,
+                           header.type == kBFloat16Type ? HalfType::BFloat16
+                                                        : HalfType::Float16);
+    }
+    if (i < numberOfWeights) {
+      data.weights.push_back(matrix);
+    } else {
+      data.optimizerState.push_back(matrix);
+    }
+    offset += size;
+  }
+  data.epoch = header.epoch;
+  data.sampleOffset = header.sampleOffset;
+  data.epochErrorSum = header.epochErrorSum;
+  return data;
+}
@@ -0,0 +1,117 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "activation.h"
+#include "halfMatrix.h"
+#include "matrix.h"
+
+/**
+ * @brief First 64 bytes of a checkpoint file. It is followed by a table of
+ * CheckpointLayer entries, the weight matrices and the optimizer state
+ * matrices. Every matrix starts at a 64 byte boundary and holds its values
+ * row after row in the byte order of the machine that wrote it.
+ */
+struct CheckpointHeader {
+  /** "NNCKPT" followed by two zero bytes.*/
+  char magic[8];
+  /** Version of the format, see Checkpoint::kVersion.*/
+  std::uint32_t version;
+  /** Type of the stored values, 1 for double, 2 for float, 3 for bfloat16,
+   * 4 for IEEE half precision.*/
+  std::uint32_t type;
+  /** Number of layers in the table.*/
+  std::uint32_t numberOfLayers;
+  /** Optimizer state matrices per weight matrix, each shaped like it.*/
+  std::uint32_t numberOfStates;
+  /** FNV-1a hash of every byte after the header.*/
+  std::uint64_t checksum;
+  /** Size of the whole file.*/
+  std::uint64_t fileSize;
+  /** Epochs finished when the checkpoint was taken.*/
+  std::uint64_t epoch;
+  /** Samples of the next epoch already trained.*/
+  std::uint64_t sampleOffset;
+  /** Sum of the batch errors of those samples.*/
+  double epochErrorSum;
+};
+
+static_assert(sizeof(CheckpointHeader) == 64,
+              "The layer table must start at a 64 byte boundary.");
+
+/** One entry of the layer table.*/
+struct CheckpointLayer {
+  /** Number of neurons in the layer.*/
+  std::uint32_t numberOfNeurons;
+  /** ActivationType of the layer.*/
+  std::uint32_t activation;
+};
+
+/** Everything a checkpoint file holds.*/
+struct CheckpointData {
+  /** Number of neurons in every layer.*/
+  std::vector<int> layerSizes;
+  /** Activation function of every layer.*/
+  std::vector<ActivationType> activations;
+  /** Weights between neighbouring layers, (layer i x layer i+1).*/
+  std::vector<std::shared_ptr<Matrix>> weights;
+  /** Optimizer state, a whole number of matrices per weight matrix, state
+   * s of weight matrix i at index s * weights.size() + i.*/
+  std::vector<std::shared_ptr<Matrix>> optimizerState;
+  /** Epochs finished.*/
+  std::uint64_t epoch = 0;
+  /** Samples of the next epoch already trained.*/
+  std::uint64_t sampleOffset = 0;
+  /** Sum of the batch errors of those samples.*/
+  double epochErrorSum = 0.0;
+};
+
+class Checkpoint {
+public:
+  /** Current version of the format. Version 1 files had no training
+   * position and no optimizer state, their fields are zero.*/
+  static constexpr std::uint32_t kVersion = 2;
+
+  /**
+   * @brief Check whether a file starts with the checkpoint magic.
+   *
+   * @param filePath path to any file.
+   * @return true the file is a checkpoint.
+   */
+  static bool isCheckpoint(const std::string &filePath);
+
+  /**
+   * @brief Write a checkpoint with the values in the Scalar type, or the
+   * weights rounded to 16 bits. A 16 bit checkpoint is half the size and
+   * meant for prediction, it has no optimizer state. The file is written
+   * under a temporary name and renamed, so a crash never leaves half a
+   * checkpoint behind.
+   *
+   * @param filePath path to the checkpoint.
+   * @param data topology and weights.
+   * @param storage format of the weights, HalfType::None for Scalar.
+   * @throws std::runtime_error when the weights or the optimizer state do
+   * not fit the topology, or the file can not be written.
+   */
+  static void save(const std::string &filePath, const CheckpointData &data,
+                   HalfType storage = HalfType::None);
+
+  /**
+   * @brief Memory map a checkpoint. The weight and state matrices use the
+   * mapped values in place, writing to them changes only this process'
+   * copy. A checkpoint of a build with the other Scalar type or with 16
+   * bit weights is converted into new matrices.
+   *
+   * @param filePath path to the checkpoint.
+   * @return CheckpointData topology and weights.
+   * @throws std::runtime_error when the file is not a valid checkpoint or
+   * its checksum does not match.
+   */
+  static CheckpointData load(const std::string &filePath);
+};
+
+#endif // _CHECKPOINT_H
@@ -0,0 +1,79 @@
+#include "checkpointWriter.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+/**
+ * @brief Copy matrices into matrices of the snapshot, reusing their
+ * buffers.
+ */
+void copyMatrices(const std::vector<std::shared_ptr<Matrix>> &source,
+                  std::vector<std::shared_ptr<Matrix>> &destination) {
+  destination.resize(source.size());
+  for (std::size_t i = 0; i < source.size(); ++i) {
+    if (!destination[i]) {
+      destination[i] = std::make_shared<Matrix>(0, 0, false);
+    }
+    const Matrix &from = *source[i];
+    Matrix &to = *destination[i];
+    to.resize(from.getNumberOfRows(), from.getNumberOfColumns());
+    for (int row = 0; row < from.getNumberOfRows(); ++row) {
+      std::copy(from.row(row).data(),
+                from.row(row).data() + from.getNumberOfColumns(),
+                to.row(row).data());
+    }
+  }
+}
+} // namespace
+
+CheckpointWriter::CheckpointWriter(const std::string &filePath)
+    : m_filePath(filePath), m_hasPending(false), m_stop(false) {
+  m_thread = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wakeUp.notify_one();
+  m_thread.join();
+}
+
+void CheckpointWriter::submit(const CheckpointData &data) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.layerSizes = data.layerSizes;
+    m_pending.activations = data.activations;
+    copyMatrices(data.weights, m_pending.weights);
+    copyMatrices(data.optimizerState, m_pending.optimizerState);
+    m_pending.epoch = data.epoch;
+    m_pending.sampleOffset = data.sampleOffset;
+    m_pending.epochErrorSum = data.epochErrorSum;
+    m_hasPending = true;
+  }
+  m_wakeUp.notify_one();
+}
+
+void CheckpointWriter::run() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wakeUp.wait(lock, [this] { return m_stop || m_hasPending; });
+      if (!m_hasPending) {
+        return;
+      }
+      // Buffers are swapped, not copied, the next submit fills the old ones.
+      std::swap(m_pending, m_writing);
+      m_hasPending = false;
+    }
+    try {
+      Checkpoint::save(m_filePath, m_writing);
+    } catch (const std::runtime_error &e) {
+      // Training goes on, the next checkpoint may succeed.
+      std::cerr << "Checkpoint not written: " << e.what() << std::endl;
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef _CHECKPOINT_WRITER_H
+#define _CHECKPOINT_WRITER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "checkpoint.h"
+
+/**
+ * @brief Writes checkpoints on a background thread. A snapshot is copied
+ * into a buffer the writer owns, so training goes on changing its weights
+ * while the file is written. When a new snapshot arrives before the last
+ * one was written only the newest is kept.
+ */
+class CheckpointWriter {
+public:
+  /**
+   * @brief Construct a new Checkpoint Writer object and start its thread.
+   *
+   * @param filePath every checkpoint replaces this file.
+   */
+  explicit CheckpointWriter(const std::string &filePath);
+
+  /**
+   * @brief Destroy the Checkpoint Writer object. The last snapshot is
+   * written before the thread stops.
+   *
+   */
+  virtual ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter &) = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+  /**
+   * @brief Copy the current state and hand it to the writer thread. Only
+   * the copy runs on the calling thread, once the buffers have the size of
+   * the network nothing is allocated.
+   *
+   * @param data topology, weights and training position to save.
+   */
+  void submit(const CheckpointData &data);
+
+private:
+  void run();
+
+  /** Path of the checkpoint file.*/
+  std::string m_filePath;
+  /** Newest snapshot, not yet picked up by the writer.*/
+  CheckpointData m_pending;
+  /** Snapshot the writer is saving.*/
+  CheckpointData m_writing;
+  bool m_hasPending;
+  bool m_stop;
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  std::thread m_thread;
+};
+
+#endif // _CHECKPOINT_WRITER_H
@@ -0,0 +1,187 @@
+#include "csvDataset.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "threadPool.h"
+
+namespace {
+/** Files are split into pieces of at least this many bytes, one piece is
+ * parsed by one task.*/
+constexpr std::size_t kMinChunkBytes = 1 << 20;
+
+/**
+ * @brief Find where the next line starts.
+ *
+ * @return const char* first byte after the next newline, or end.
+ */
+const char *nextLine(const char *position, const char *end) {
+  const void *newLine = std::memchr(position, '\n', end - position);
+  return newLine != nullptr ? static_cast<const char *>(newLine) + 1 : end;
+}
+
+/**
+ * @brief Find the first line that starts at or after position.
+ */
+const char *lineStartAfter(const char *begin, const char *position,
+                           const char *end) {
+  return position == begin ? begin : nextLine(position - 1, end);
+}
+
+/**
+ * @brief Empty lines (a trailing newline, CRLF leftovers) hold no row.
+ */
+bool isDataLine(const char *line, const char *end) {
+  return line != end && *line != '\n' && *line != '\r';
+}
+
+const char *skipSpaces(const char *position, const char *end) {
+  while (position != end && (*position == ' ' || *position == '\t')) {
+    ++position;
+  }
+  return position;
+}
+
+/**
+ * @brief Parse one line of comma separated values into a row.
+ *
+ * @throws std::runtime_error when the line does not hold exactly columns
+ * numbers.
+ */
+void parseLine(const char *position, const char *end, Scalar *row,
+               int columns, std::size_t rowIndex) {
+  for (int column = 0; column < columns; ++column) {
+    position = skipSpaces(position, end);
+    const auto result = std::from_chars(position, end, row[column]);
+    if (result.ec != std::errc()) {
+      throw std::runtime_error("Invalid value in row " +
+                               std::to_string(rowIndex + 1) + ", column " +
+                               std::to_string(column + 1));
+    }
+    position = skipSpaces(result.ptr, end);
+    if (column + 1 < columns) {
+      if (position == end || *position != ',') {
+        throw std::runtime_error("Row " + std::to_string(rowIndex + 1) +
+                                 " has less than " + std::to_string(columns) +
+                                 " values");
+      }
+      ++position;
+    }
+  }
+  while (position != end &&
+         std::isspace(static_cast<unsigned char>(*position))) {
+    ++position;
+  }
+  if (position != end) {
+    throw std::runtime_error("Row " + std::to_string(rowIndex + 1) +
+                             " has more than " + std::to_string(columns) +
+                             " values");
+  }
+}
+
+} // namespace
+
+CsvDataset::CsvDataset(const std::string &filePath) : m_numberOfColumns(0) {
+  try {
+    m_file = std::make_unique<MappedFile>(filePath);
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    return;
+  }
+  const char *begin = m_file->data();
+  const char *end = begin + m_file->size();
+
+  // Row width comes from the first row, every other row must match it.
+  const char *firstLine = begin;
+  while (firstLine != end && !isDataLine(firstLine, end)) {
+    firstLine = nextLine(firstLine, end);
+  }
+  if (firstLine == end) {
+    return;
+  }
+  m_numberOfColumns = static_cast<int>(std::count(
+                          firstLine, nextLine(firstLine, end), ',')) +
+                      1;
+
+  // Pieces start at line boundaries, a line belongs to the piece where it
+  // starts. Every piece indexes its own lines, the pieces are joined after.
+  ThreadPool &pool = ThreadPool::getInstance();
+  const std::size_t numberOfChunks = std::max<std::size_t>(
+      1, std::min<std::size_t>(m_file->size() / kMinChunkBytes,
+                               pool.getNumberOfThreads() * 4));
+  std::vector<const char *> chunkBegins(numberOfChunks + 1);
+  for (std::size_t chunk = 0; chunk < numberOfChunks; ++chunk) {
+    chunkBegins[chunk] = lineStartAfter(
+        begin, begin + m_file->size() / numberOfChunks * chunk, end);
+  }
+  chunkBegins[numberOfChunks] = end;
+
+  std::vector<std::vector<std::uint64_t>> chunkOffsets(numberOfChunks);
+  pool.parallelFor(0, numberOfChunks, 1, [&](int chunkBegin, int chunkEnd) {
+    for (int chunk = chunkBegin; chunk < chunkEnd; ++chunk) {
+      for (const char *line = chunkBegins[chunk];
+           line < chunkBegins[chunk + 1]; line = nextLine(line, end)) {
+        if (isDataLine(line, end)) {
+          chunkOffsets[chunk].push_back(line - begin);
+        }
+      }
+    }
+  });
+  std::size_t numberOfRows = 0;
+  for (const auto &offsets : chunkOffsets) {
+    numberOfRows += offsets.size();
+  }
+  m_rowOffsets.reserve(numberOfRows);
+  for (const auto &offsets : chunkOffsets) {
+    m_rowOffsets.insert(m_rowOffsets.end(), offsets.begin(), offsets.end());
+  }
+}
+
+std::size_t CsvDataset::getNumberOfRows() const { return m_rowOffsets.size(); }
+
+int CsvDataset::getNumberOfColumns() const { return m_numberOfColumns; }
+
+std::size_t CsvDataset::getFileSize() const {
+  return m_file ? m_file->size() : 0;
+}
+
+void CsvDataset::parseRow(std::size_t index, Scalar *row) const {
+  // Anything between two rows is blank lines, parseLine skips it.
+  const std::size_t lineEnd = index + 1 < m_rowOffsets.size()
+                                  ? m_rowOffsets[index + 1]
+                                  : m_file->size();
+  parseLine(m_file->data() + m_rowOffsets[index], m_file->data() + lineEnd,
+            row, m_numberOfColumns, index);
+}
+
+void CsvDataset::readRows(std::size_t first, std::size_t count,
+                          Matrix &destination) const {
+  checkRange(first, count);
+  destination.resize(count, m_numberOfColumns);
+  ThreadPool::getInstance().parallelFor(
+      0, count, std::max(1, (1 << 14) / std::max(1, m_numberOfColumns)),
+      [&](int rowBegin, int rowEnd) {
+        for (int row = rowBegin; row < rowEnd; ++row) {
+          parseRow(first + row, destination.row(row).data());
+        }
+      });
+}
+
+void CsvDataset::gatherRows(const std::size_t *indices, std::size_t count,
+                            Matrix &destination) const {
+  for (std::size_t row = 0; row < count; ++row) {
+    checkRange(indices[row], 1);
+  }
+  destination.resize(count, m_numberOfColumns);
+  ThreadPool::getInstance().parallelFor(
+      0, count, std::max(1, (1 << 14) / std::max(1, m_numberOfColumns)),
+      [&](int rowBegin, int rowEnd) {
+        for (int row = rowBegin; row < rowEnd; ++row) {
+          parseRow(indices[row], destination.row(row).data());
+        }
+      });
+}
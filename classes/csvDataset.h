@@ -0,0 +1,63 @@
+#ifndef _CSV_DATASET_H
+#define _CSV_DATASET_H
+
+#include <cstdint>
+#include <vector>
+
+#include "dataset.h"
+#include "mappedFile.h"
+
+/**
+ * @brief Dataset in a comma separated file, one sample per line. Opening
+ * the file only records where every line starts, values are parsed when
+ * their rows are read. The width of the first line is the width of every
+ * row.
+ */
+class CsvDataset : public Dataset {
+public:
+  /**
+   * @brief Construct a new Csv Dataset object. The file is memory mapped
+   * and its lines are indexed by all threads of the pool.
+   *
+   * @param filePath path to a CSV file, a file that can not be opened gives
+   * an empty dataset.
+   */
+  explicit CsvDataset(const std::string &filePath);
+
+  std::size_t getNumberOfRows() const override;
+  int getNumberOfColumns() const override;
+
+  /**
+   * @brief Parse consecutive samples into a matrix, rows are split across
+   * the threads of the pool.
+   *
+   * @throws std::runtime_error when a line is not a row of numbers.
+   */
+  void readRows(std::size_t first, std::size_t count,
+                Matrix &destination) const override;
+  void gatherRows(const std::size_t *indices, std::size_t count,
+                  Matrix &destination) const override;
+
+  /**
+   * @brief Get the size of the file.
+   *
+   * @return std::size_t number of bytes.
+   */
+  std::size_t getFileSize() const;
+
+private:
+  /**
+   * @brief Parse one row of the file into a row of a matrix.
+   *
+   */
+  void parseRow(std::size_t index, Scalar *row) const;
+
+  /** Mapped file, empty when it could not be opened.*/
+  std::unique_ptr<MappedFile> m_file;
+  /** Offset of the first byte of every row in the file.*/
+  std::vector<std::uint64_t> m_rowOffsets;
+  /** Number of values in every row.*/
+  int m_numberOfColumns;
+};
+
+#endif // _CSV_DATASET_H
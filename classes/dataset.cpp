@@ -0,0 +1,68 @@
+#include "dataset.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include "binaryDataset.h"
+#include "csvDataset.h"
+#include "datasetFile.h"
+
+namespace {
+void printOpenRate(const std::string &filePath, const Dataset &dataset,
+                   std::size_t bytes,
+                   std::chrono::steady_clock::time_point startTime) {
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - startTime)
+                             .count();
+  std::cout << "Loaded " << filePath << ": " << dataset.getNumberOfRows()
+            << " rows x " << dataset.getNumberOfColumns() << " columns in "
+            << seconds << " s (" << dataset.getNumberOfRows() / seconds
+            << " rows/s, " << bytes / seconds / (1 << 20) << " MB/s)"
+            << std::endl;
+}
+} // namespace
+
+std::shared_ptr<Dataset> Dataset::open(const std::string &filePath) {
+  const auto startTime = std::chrono::steady_clock::now();
+  const std::string cachePath = DatasetFile::getCachePath(filePath);
+  const bool isBinary = DatasetFile::isBinary(filePath);
+  if (isBinary || DatasetFile::isCacheOf(cachePath, filePath)) {
+    const std::string binaryPath = isBinary ? filePath : cachePath;
+    auto dataset = std::make_shared<BinaryDataset>(binaryPath);
+    printOpenRate(binaryPath, *dataset,
+                  sizeof(Scalar) * dataset->getNumberOfRows() *
+                      dataset->getNumberOfColumns(),
+                  startTime);
+    return dataset;
+  }
+
+  auto csv = std::make_shared<CsvDataset>(filePath);
+  if (csv->getNumberOfRows() == 0) {
+    return csv;
+  }
+  // The next run maps the binary copy instead of parsing the text again.
+  try {
+    DatasetFile::write(cachePath, *csv, filePath);
+    auto dataset = std::make_shared<BinaryDataset>(cachePath);
+    printOpenRate(filePath, *dataset, csv->getFileSize(), startTime);
+    return dataset;
+  } catch (const std::ios_base::failure &e) {
+    std::cerr << "Dataset cache not written: " << e.what() << std::endl;
+  }
+  printOpenRate(filePath, *csv, csv->getFileSize(), startTime);
+  return csv;
+}
+
+std::shared_ptr<Matrix> Dataset::readAll() const {
+  auto values = std::make_shared<Matrix>(getNumberOfRows(),
+                                         getNumberOfColumns(), false);
+  readRows(0, getNumberOfRows(), *values);
+  return values;
+}
+
+void Dataset::checkRange(std::size_t first, std::size_t count) const {
+  if (first + count > getNumberOfRows()) {
+    throw std::out_of_range("Rows are past the end of the dataset.");
+  }
+}
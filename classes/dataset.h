@@ -0,0 +1,89 @@
+#ifndef _DATASET_H
+#define _DATASET_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "matrix.h"
+
+/**
+ * @brief Samples stored on disk, one per row. Rows are read on demand into
+ * a caller owned matrix, so only the rows in use have to fit into memory.
+ */
+class Dataset {
+public:
+  /**
+   * @brief Open a dataset file. Binary datasets are memory mapped. A CSV is
+   * converted once into a binary copy next to it (DatasetFile::getCachePath)
+   * which is reused while the CSV does not change, when the copy can not be
+   * written the CSV is parsed on every read instead.
+   *
+   * @param filePath path to a CSV or binary dataset file.
+   * @return std::shared_ptr<Dataset> the opened dataset, without rows when
+   * the file can not be opened.
+   * @throws std::runtime_error when the file holds invalid data.
+   */
+  static std::shared_ptr<Dataset> open(const std::string &filePath);
+
+  /**
+   * @brief Destroy the Dataset object.
+   *
+   */
+  virtual ~Dataset() = default;
+
+  /**
+   * @brief Get the number of samples.
+   *
+   * @return std::size_t number of rows.
+   */
+  virtual std::size_t getNumberOfRows() const = 0;
+
+  /**
+   * @brief Get the number of values in every sample.
+   *
+   * @return int number of columns.
+   */
+  virtual int getNumberOfColumns() const = 0;
+
+  /**
+   * @brief Copy consecutive samples into a matrix. The matrix is resized to
+   * (count x columns), which does not allocate when it was that big before.
+   *
+   * @param first index of the first sample.
+   * @param count number of samples.
+   * @param destination matrix that receives one sample per row.
+   * @throws std::out_of_range when the samples are past the end.
+   */
+  virtual void readRows(std::size_t first, std::size_t count,
+                        Matrix &destination) const = 0;
+
+  /**
+   * @brief Copy samples in any order into a matrix, the i-th row of the
+   * matrix receives sample indices[i]. The matrix is resized to
+   * (count x columns).
+   *
+   * @param indices indices of the samples.
+   * @param count number of samples.
+   * @param destination matrix that receives one sample per row.
+   * @throws std::out_of_range when an index is past the end.
+   */
+  virtual void gatherRows(const std::size_t *indices, std::size_t count,
+                          Matrix &destination) const = 0;
+
+  /**
+   * @brief Read every sample into one matrix.
+   *
+   * @return std::shared_ptr<Matrix> all samples, one per row.
+   */
+  virtual std::shared_ptr<Matrix> readAll() const;
+
+protected:
+  /**
+   * @brief Throw when [first, first + count) is not inside the dataset.
+   *
+   */
+  void checkRange(std::size_t first, std::size_t count) const;
+};
+
+#endif // _DATASET_H
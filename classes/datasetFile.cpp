@@ -0,0 +1,158 @@
+#include "datasetFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include "dataset.h"
+#include "mappedFile.h"
+
+namespace {
+constexpr char kMagic[8] = {'N', 'N', 'D', 'A', 'T', 'A', '\0', '\0'};
+/** Rows converted at once while writing a dataset.*/
+constexpr std::size_t kWriteRows = 4096;
+/** Values are written in the type a Matrix holds in this build.*/
+constexpr DatasetType kScalarType = sizeof(Scalar) == sizeof(double)
+                                        ? DatasetType::Float64
+                                        : DatasetType::Float32;
+
+/** Bytes of one value of a DatasetType, 0 for an unknown type.*/
+std::size_t getValueSize(std::uint32_t type) {
+  switch (static_cast<DatasetType>(type)) {
+  case DatasetType::Float64:
+    return sizeof(double);
+  case DatasetType::Float32:
+    return sizeof(float);
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Size and modification time of a file.
+ *
+ * @return bool false when the file does not exist.
+ */
+bool getSourceStatus(const std::string &filePath, std::uint64_t &size,
+                     std::int64_t &modified) {
+  struct stat status;
+  if (stat(filePath.c_str(), &status) != 0) {
+    return false;
+  }
+  size = static_cast<std::uint64_t>(status.st_size);
+  modified = static_cast<std::int64_t>(status.st_mtim.tv_sec) * 1000000000 +
+             status.st_mtim.tv_nsec;
+  return true;
+}
+
+bool readHeader(const std::string &filePath, DatasetHeader &header) {
+  std::ifstream file(filePath, std::ios::binary);
+  return file.read(reinterpret_cast<char *>(&header), sizeof(header)) &&
+         std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0;
+}
+} // namespace
+
+std::string DatasetFile::getCachePath(const std::string &csvPath) {
+  return csvPath + ".bin";
+}
+
+bool DatasetFile::isBinary(const std::string &filePath) {
+  DatasetHeader header;
+  return readHeader(filePath, header);
+}
+
+bool DatasetFile::isCacheOf(const std::string &binaryPath,
+                            const std::string &csvPath) {
+  DatasetHeader header;
+  std::uint64_t size = 0;
+  std::int64_t modified = 0;
+  return readHeader(binaryPath, header) && header.version == kVersion &&
+         header.type == static_cast<std::uint32_t>(kScalarType) &&
+         getSourceStatus(csvPath, size, modified) &&
+         header.sourceSize == size && header.sourceModified == modified;
+}
+
+void DatasetFile::write(const std::string &filePath, const Dataset &data,
+                        const std::string &csvPath) {
+  DatasetHeader header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.type = static_cast<std::uint32_t>(kScalarType);
+  header.numberOfRows = data.getNumberOfRows();
+  header.numberOfColumns = data.getNumberOfColumns();
+  if (!csvPath.empty()) {
+    getSourceStatus(csvPath, header.sourceSize, header.sourceModified);
+  }
+
+  const std::string temporaryPath = filePath + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    Matrix block(0, 0, false);
+    try {
+      for (std::size_t first = 0; first < data.getNumberOfRows() && file;
+           first += kWriteRows) {
+        data.readRows(first,
+                      std::min(kWriteRows, data.getNumberOfRows() - first),
+                      block);
+        for (int row = 0; row < block.getNumberOfRows(); ++row) {
+          file.write(reinterpret_cast<const char *>(block.row(row).data()),
+                     sizeof(Scalar) * block.getNumberOfColumns());
+        }
+      }
+    } catch (...) {
+      file.close();
+      std::remove(temporaryPath.c_str());
+      throw;
+    }
+    if (!file) {
+      std::remove(temporaryPath.c_str());
+      throw std::ios_base::failure("Can not write a file " + temporaryPath);
+    }
+  }
+  if (std::rename(temporaryPath.c_str(), filePath.c_str()) != 0) {
+    std::remove(temporaryPath.c_str());
+    throw std::ios_base::failure("Can not write a file " + filePath);
+  }
+}
+
+std::shared_ptr<Matrix> DatasetFile::map(const std::string &filePath) {
+  auto file = std::make_shared<MappedFile>(filePath, true);
+  DatasetHeader header;
+  if (file->size() < sizeof(header)) {
+    throw std::runtime_error(filePath + " is not a binary dataset.");
+  }
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error(filePath + " is not a binary dataset.");
+  }
+  const std::size_t valueSize = getValueSize(header.type);
+  if (header.version != kVersion || valueSize == 0) {
+    throw std::runtime_error(filePath +
+                             " has an unsupported version or value type.");
+  }
+  const std::uint64_t expectedSize =
+      sizeof(header) +
+      header.numberOfRows * header.numberOfColumns * valueSize;
+  if (file->size() != expectedSize) {
+    throw std::runtime_error(filePath + " is truncated.");
+  }
+  const int rows = static_cast<int>(header.numberOfRows);
+  const int columns = static_cast<int>(header.numberOfColumns);
+  if (header.type != static_cast<std::uint32_t>(kScalarType)) {
+    // Written by a build with the other Scalar type.
+    const char *values = file->data() + sizeof(header);
+    return valueSize == sizeof(double)
+               ? Matrix::convert(reinterpret_cast<const double *>(values),
+                                 rows, columns)
+               : Matrix::convert(reinterpret_cast<const float *>(values),
+                                 rows, columns);
+  }
+  Scalar *values = reinterpret_cast<Scalar *>(file->writableData() +
+                                              sizeof(header));
+  return std::make_shared<Matrix>(rows, columns, values, file);
+}
@@ -0,0 +1,103 @@
+#ifndef _DATASET_FILE_H
+#define _DATASET_FILE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "matrix.h"
+
+class Dataset;
+
+/** Type of the values stored in a binary dataset file.*/
+enum class DatasetType : std::uint32_t { Float64 = 1, Float32 = 2 };
+
+/**
+ * @brief First 64 bytes of a binary dataset file. The values follow right
+ * after it, row after row in the byte order of the machine that wrote them,
+ * so a memory mapped file can be used as a Matrix without copying.
+ */
+struct DatasetHeader {
+  /** "NNDATA" followed by two zero bytes.*/
+  char magic[8];
+  /** Version of the format, see DatasetFile::kVersion.*/
+  std::uint32_t version;
+  /** DatasetType of the values.*/
+  std::uint32_t type;
+  /** Number of samples.*/
+  std::uint64_t numberOfRows;
+  /** Number of values in every sample.*/
+  std::uint64_t numberOfColumns;
+  /** Size of the CSV the values were converted from, 0 if unknown.*/
+  std::uint64_t sourceSize;
+  /** Modification time of that CSV in nanoseconds, 0 if unknown.*/
+  std::int64_t sourceModified;
+  /** Zero, keeps the values 64 byte aligned.*/
+  std::uint8_t reserved[16];
+};
+
+static_assert(sizeof(DatasetHeader) == 64,
+              "Dataset values must start at a 64 byte boundary.");
+
+class DatasetFile {
+public:
+  /** Current version of the binary format.*/
+  static constexpr std::uint32_t kVersion = 1;
+
+  /**
+   * @brief Get the path of the binary cache kept next to a CSV file.
+   *
+   * @param csvPath path to a CSV file.
+   * @return std::string csvPath with ".bin" appended.
+   */
+  static std::string getCachePath(const std::string &csvPath);
+
+  /**
+   * @brief Check whether a file starts with the binary dataset magic.
+   *
+   * @param filePath path to any file.
+   * @return true the file is a binary dataset.
+   */
+  static bool isBinary(const std::string &filePath);
+
+  /**
+   * @brief Check whether a binary file holds the current content of a CSV,
+   * based on the size and modification time recorded at conversion, in
+   * the Scalar type of this build.
+   *
+   * @param binaryPath path to a binary dataset file.
+   * @param csvPath path to the CSV it was converted from.
+   * @return true the binary file can be used instead of the CSV.
+   */
+  static bool isCacheOf(const std::string &binaryPath,
+                        const std::string &csvPath);
+
+  /**
+   * @brief Write a dataset as a binary dataset file of Scalar values.
+   * Samples are copied a block of rows at a time, so the dataset does not
+   * have to fit into memory. The file is written under a temporary name
+   * and renamed, so readers never see half a file.
+   *
+   * @param filePath path to the binary file.
+   * @param data samples to write.
+   * @param csvPath CSV the samples come from, empty if none.
+   * @throws std::ios_base::failure when the file can not be written, and
+   * whatever reading the dataset throws.
+   */
+  static void write(const std::string &filePath, const Dataset &data,
+                    const std::string &csvPath = "");
+
+  /**
+   * @brief Memory map a binary dataset file. If the file holds Scalar
+   * values, the returned matrix uses them directly and keeps the mapping
+   * alive, pages are only read from disk when a sample is used. Values of
+   * the other type are converted into a new matrix.
+   *
+   * @param filePath path to the binary file.
+   * @return std::shared_ptr<Matrix> samples, one per row.
+   * @throws std::runtime_error when the file is not a valid dataset.
+   */
+  static std::shared_ptr<Matrix> map(const std::string &filePath);
+};
+
+#endif // _DATASET_FILE_H
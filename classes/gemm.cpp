@@ -0,0 +1,343 @@
+#include "gemm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "alignedAllocator.h"
+#include "simd.h"
+#include "threadPool.h"
+
+namespace {
+
+/** Depth of the packed panels, a KC x NR sliver of B stays in L1.*/
+constexpr int kBlockDepth = 256;
+/** Rows of A packed at once, a MC x KC block of A stays in L2.*/
+constexpr int kBlockRows = 96;
+/** Columns of B packed at once, a KC x NC panel of B stays in L3.*/
+constexpr int kBlockColumns = 2048;
+/** Up to this many rows of A the product streams B directly instead of
+ * packing it, packing would cost as much as the multiplication itself.*/
+constexpr int kStreamingRows = 4;
+/** Products below this many floating point operations are not split across
+ * threads, the hand-off would cost more than it saves.*/
+constexpr double kMinParallelFlops = 1 << 18;
+
+using Buffer = std::vector<Scalar, AlignedAllocator<Scalar>>;
+
+struct GemmArguments {
+  int m;
+  int n;
+  int k;
+  Scalar alpha;
+  GemmOperand a;
+  GemmOperand b;
+  Scalar beta;
+  Scalar *c;
+  int cRowStride;
+};
+
+/**
+ * Copies a (mc x kc) block of A into panels of MR rows, each panel stored
+ * column after column so the micro kernel reads it linearly. Rows past mc
+ * are padded with zeros.
+ */
+template <int MR>
+NN_ALWAYS_INLINE void packA(int mc, int kc, const Scalar *a, int rowStride,
+                            int columnStride, Scalar *packed) {
+  for (int panel = 0; panel < mc; panel += MR) {
+    const int rows = std::min(MR, mc - panel);
+    for (int p = 0; p < kc; ++p) {
+      for (int i = 0; i < rows; ++i) {
+        packed[i] = a[static_cast<std::size_t>(panel + i) * rowStride +
+                      static_cast<std::size_t>(p) * columnStride];
+      }
+      for (int i = rows; i < MR; ++i) {
+        packed[i] = 0.0;
+      }
+      packed += MR;
+    }
+  }
+}
+
+/**
+ * Copies a (kc x nc) block of B into panels of NR columns, each panel stored
+ * row after row. Columns past nc are padded with zeros.
+ */
+template <int NR>
+NN_ALWAYS_INLINE void packB(int kc, int nc, const Scalar *b, int rowStride,
+                            int columnStride, Scalar *packed) {
+  for (int panel = 0; panel < nc; panel += NR) {
+    const int columns = std::min(NR, nc - panel);
+    for (int p = 0; p < kc; ++p) {
+      const Scalar *row = b + static_cast<std::size_t>(p) * rowStride +
+                          static_cast<std::size_t>(panel) * columnStride;
+      if (columnStride == 1) {
+        std::memcpy(packed, row, sizeof(Scalar) * columns);
+      } else {
+        for (int j = 0; j < columns; ++j) {
+          packed[j] = row[static_cast<std::size_t>(j) * columnStride];
+        }
+      }
+      for (int j = columns; j < NR; ++j) {
+        packed[j] = 0.0;
+      }
+      packed += NR;
+    }
+  }
+}
+
+/** NR scalars in one value, the compiler maps it onto as many vector
+ * registers as the instruction set needs.*/
+template <int NR> struct PanelRow {
+  typedef Scalar type __attribute__((vector_size(NR * sizeof(Scalar))));
+};
+
+/**
+ * Multiplies one packed MR panel of A with one packed NR panel of B. The
+ * MR x NR accumulator is small enough to live in vector registers, only
+ * the (mr x nr) part that is inside C is stored.
+ */
+template <int MR, int NR>
+NN_ALWAYS_INLINE void microKernel(int kc, const Scalar *__restrict a,
+                                  const Scalar *__restrict b, Scalar alpha,
+                                  Scalar beta, Scalar *__restrict c,
+                                  int cRowStride, int mr, int nr) {
+  using Row = typename PanelRow<NR>::type;
+  Row accumulator[MR] = {};
+  for (int p = 0; p < kc; ++p) {
+    Row bRow;
+    std::memcpy(&bRow, b, sizeof(Row));
+    for (int i = 0; i < MR; ++i) {
+      accumulator[i] += a[i] * bRow;
+    }
+    a += MR;
+    b += NR;
+  }
+
+  if (mr == MR && nr == NR) {
+    for (int i = 0; i < MR; ++i) {
+      Scalar *cRow = c + static_cast<std::size_t>(i) * cRowStride;
+      Row result = alpha * accumulator[i];
+      if (beta != 0.0) {
+        Row old;
+        std::memcpy(&old, cRow, sizeof(Row));
+        result += beta * old;
+      }
+      std::memcpy(cRow, &result, sizeof(Row));
+    }
+    return;
+  }
+  for (int i = 0; i < mr; ++i) {
+    Scalar *cRow = c + static_cast<std::size_t>(i) * cRowStride;
+    for (int j = 0; j < nr; ++j) {
+      cRow[j] = (beta == 0 ? Scalar(0) : beta * cRow[j]) +
+                alpha * accumulator[i][j];
+    }
+  }
+}
+
+/**
+ * Blocked multiplication in the classic order: panels of B (NC wide, KC
+ * deep) are packed once and reused for every MC block of A, every packed
+ * block is walked by the micro kernel in MR x NR tiles.
+ */
+template <int MR, int NR>
+NN_ALWAYS_INLINE void blockedMultiply(const GemmArguments &args) {
+  thread_local Buffer packedA;
+  thread_local Buffer packedB;
+  packedA.resize(static_cast<std::size_t>(kBlockRows + MR) * kBlockDepth);
+  packedB.resize(static_cast<std::size_t>(kBlockColumns + NR) * kBlockDepth);
+
+  for (int jc = 0; jc < args.n; jc += kBlockColumns) {
+    const int nc = std::min(kBlockColumns, args.n - jc);
+    for (int pc = 0; pc < args.k; pc += kBlockDepth) {
+      const int kc = std::min(kBlockDepth, args.k - pc);
+      // Only the first depth block scales what is already in C.
+      const Scalar beta = pc == 0 ? args.beta : 1.0;
+      packB<NR>(kc, nc,
+                args.b.data + static_cast<std::size_t>(pc) * args.b.rowStride +
+                    static_cast<std::size_t>(jc) * args.b.columnStride,
+                args.b.rowStride, args.b.columnStride, packedB.data());
+
+      for (int ic = 0; ic < args.m; ic += kBlockRows) {
+        const int mc = std::min(kBlockRows, args.m - ic);
+        packA<MR>(mc, kc,
+                  args.a.data +
+                      static_cast<std::size_t>(ic) * args.a.rowStride +
+                      static_cast<std::size_t>(pc) * args.a.columnStride,
+                  args.a.rowStride, args.a.columnStride, packedA.data());
+
+        for (int jr = 0; jr < nc; jr += NR) {
+          const int nr = std::min(NR, nc - jr);
+          const Scalar *bPanel =
+              packedB.data() + static_cast<std::size_t>(jr) * kc;
+          for (int ir = 0; ir < mc; ir += MR) {
+            const int mr = std::min(MR, mc - ir);
+            Scalar *cTile = args.c +
+                            static_cast<std::size_t>(ic + ir) * args.cRowStride +
+                            jc + jr;
+            microKernel<MR, NR>(kc,
+                                packedA.data() +
+                                    static_cast<std::size_t>(ir) * kc,
+                                bPanel, args.alpha, beta, cTile,
+                                args.cRowStride, mr, nr);
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Product for a few rows of A with row major B: every row of C is built as
+ * a sum of scaled rows of B, so B is read exactly once, front to back.
+ * Fused uses a fused multiply add for every term. Left to the compiler the
+ * vectorized loop would be contracted and its epilogue not, and columns of
+ * one product would round differently.
+ */
+template <bool Fused>
+NN_ALWAYS_INLINE void streamingMultiply(const GemmArguments &args) {
+  for (int i = 0; i < args.m; ++i) {
+    Scalar *__restrict cRow =
+        args.c + static_cast<std::size_t>(i) * args.cRowStride;
+    if (args.beta == 0.0) {
+      std::fill(cRow, cRow + args.n, 0.0);
+    } else if (args.beta != 1.0) {
+      for (int j = 0; j < args.n; ++j) {
+        cRow[j] *= args.beta;
+      }
+    }
+    const Scalar *aRow =
+        args.a.data + static_cast<std::size_t>(i) * args.a.rowStride;
+    for (int p = 0; p < args.k; ++p) {
+      const Scalar scale =
+          args.alpha * aRow[static_cast<std::size_t>(p) * args.a.columnStride];
+      const Scalar *__restrict bRow =
+          args.b.data + static_cast<std::size_t>(p) * args.b.rowStride;
+      for (int j = 0; j < args.n; ++j) {
+        if constexpr (Fused) {
+          cRow[j] = fusedMultiplyAdd(scale, bRow[j], cRow[j]);
+        } else {
+          cRow[j] += scale * bRow[j];
+        }
+      }
+    }
+  }
+}
+
+template <bool Fused>
+NN_ALWAYS_INLINE void multiplyWith(const GemmArguments &args,
+                                   void (*blocked)(const GemmArguments &)) {
+  if (args.m <= kStreamingRows && args.b.columnStride == 1) {
+    streamingMultiply<Fused>(args);
+  } else {
+    blocked(args);
+  }
+}
+
+// The same templates compiled once per instruction set. A micro kernel tile
+// is one vector register wide and as tall as the register file allows
+// (16 zmm, 12 ymm, 8 xmm accumulators), wider tiles spill.
+#if NN_X86
+NN_TARGET("avx512f") void blockedAvx512(const GemmArguments &args) {
+  blockedMultiply<16, 64 / sizeof(Scalar)>(args);
+}
+
+NN_TARGET("avx512f") void multiplyAvx512(const GemmArguments &args) {
+  multiplyWith<true>(args, blockedAvx512);
+}
+
+NN_TARGET("avx2,fma") void blockedAvx2(const GemmArguments &args) {
+  blockedMultiply<12, 32 / sizeof(Scalar)>(args);
+}
+
+NN_TARGET("avx2,fma") void multiplyAvx2(const GemmArguments &args) {
+  multiplyWith<true>(args, blockedAvx2);
+}
+#endif
+
+void blockedGeneric(const GemmArguments &args) {
+  blockedMultiply<8, 16 / sizeof(Scalar)>(args);
+}
+
+void multiplyGeneric(const GemmArguments &args) {
+  multiplyWith<false>(args, blockedGeneric);
+}
+
+struct Kernel {
+  const char *name;
+  void (*multiply)(const GemmArguments &);
+};
+
+Kernel selectKernel() {
+  switch (Simd::getLevel()) {
+#if NN_X86
+  case SimdLevel::Avx512:
+    return {"avx512", multiplyAvx512};
+  case SimdLevel::Avx2:
+    return {"avx2", multiplyAvx2};
+#endif
+  default:
+    return {"generic", multiplyGeneric};
+  }
+}
+
+const Kernel &getKernel() {
+  static const Kernel kernel = selectKernel();
+  return kernel;
+}
+
+} // namespace
+
+void Gemm::multiply(int m, int n, int k, Scalar alpha, GemmOperand a,
+                    GemmOperand b, Scalar beta, Scalar *c, int cRowStride) {
+  if (m <= 0 || n <= 0) {
+    return;
+  }
+  if (k <= 0) {
+    // Empty product, only the scaling of C is left.
+    for (int i = 0; i < m; ++i) {
+      Scalar *cRow = c + static_cast<std::size_t>(i) * cRowStride;
+      for (int j = 0; j < n; ++j) {
+        cRow[j] = beta == 0 ? Scalar(0) : beta * cRow[j];
+      }
+    }
+    return;
+  }
+  const Kernel &kernel = getKernel();
+  const GemmArguments args{m, n, k, alpha, a, b, beta, c, cRowStride};
+  const double flops = 2.0 * m * n * k;
+  ThreadPool &pool = ThreadPool::getInstance();
+  if (flops < kMinParallelFlops || pool.getNumberOfThreads() == 1) {
+    kernel.multiply(args);
+    return;
+  }
+
+  // Every thread owns a tile of C, tiles are cut along the longer side.
+  const double flopsPerLine = flops / std::max(m, n);
+  const int minimumLines =
+      static_cast<int>(std::ceil(kMinParallelFlops / flopsPerLine));
+  if (m >= n) {
+    pool.parallelFor(0, m, std::max(kStreamingRows + 1, minimumLines),
+                     [&](int begin, int end) {
+                       GemmArguments tile = args;
+                       tile.m = end - begin;
+                       tile.a.data +=
+                           static_cast<std::size_t>(begin) * a.rowStride;
+                       tile.c += static_cast<std::size_t>(begin) * cRowStride;
+                       kernel.multiply(tile);
+                     });
+  } else {
+    pool.parallelFor(0, n, std::max(64, minimumLines), [&](int begin, int end) {
+      GemmArguments tile = args;
+      tile.n = end - begin;
+      tile.b.data += static_cast<std::size_t>(begin) * b.columnStride;
+      tile.c += begin;
+      kernel.multiply(tile);
+    });
+  }
+}
+
+std::string Gemm::getKernelName() { return getKernel().name; }
@@ -0,0 +1,53 @@
+#ifndef _GEMM_H
+#define _GEMM_H
+
+#include <string>
+
+#include "scalar.h"
+
+/**
+ * @brief One operand of a matrix multiplication. Value at (row, column) is
+ * data[row * rowStride + column * columnStride], so a transposed matrix is
+ * just the same buffer with swapped strides.
+ */
+struct GemmOperand {
+  /** First value of the operand.*/
+  const Scalar *data;
+  /** Distance between two neighbouring rows.*/
+  int rowStride;
+  /** Distance between two neighbouring columns.*/
+  int columnStride;
+};
+
+class Gemm {
+public:
+  /**
+   * @brief General matrix multiplication C = alpha * A * B + beta * C.
+   *
+   * A is (m x k), B is (k x n) and C is (m x n) stored row by row. The
+   * product is computed with cache blocking and a register tiled micro
+   * kernel, using the widest instruction set the CPU supports. When beta is
+   * zero C is not read, so it may hold garbage.
+   *
+   * @param m number of rows of A and C.
+   * @param n number of columns of B and C.
+   * @param k number of columns of A and rows of B.
+   * @param alpha scale of the product.
+   * @param a left operand.
+   * @param b right operand.
+   * @param beta scale of the values already in C.
+   * @param c result matrix.
+   * @param cRowStride distance between two neighbouring rows of C.
+   */
+  static void multiply(int m, int n, int k, Scalar alpha, GemmOperand a,
+                       GemmOperand b, Scalar beta, Scalar *c, int cRowStride);
+
+  /**
+   * @brief Get the name of the kernel selected for this CPU.
+   *
+   * @return std::string "avx512", "avx2" or "generic".
+   */
+  static std::string getKernelName();
+};
+
+#endif // _GEMM_H
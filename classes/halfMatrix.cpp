@@ -0,0 +1,624 @@
+#include "halfMatrix.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "simd.h"
+#include "threadPool.h"
+
+#if NN_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/** Rows of B widened at once, a KC x NC block of floats stays in L1.*/
+constexpr int kBlockDepth = 64;
+/** Columns of B widened at once and of the result computed by one task.*/
+constexpr int kBlockColumns = 64;
+/** Values narrowed by one task of assign.*/
+constexpr int kMinValuesPerTask = 1 << 14;
+/** Products below this many floating point operations are not split across
+ * threads.*/
+constexpr double kMinParallelFlops = 1 << 18;
+/** Rows of the result an AVX-512 task keeps in registers, 4 x 64 sums are
+ * 16 of the 32 vector registers. AVX2 has 16 registers, one row of 64 sums
+ * takes half of them.*/
+constexpr int kAvx512RowGroup = 4;
+/** Values converted at once when Scalar is not float.*/
+constexpr std::size_t kChunk = 256;
+
+float bFloat16ToFloat(std::uint16_t value) {
+  const std::uint32_t bits = static_cast<std::uint32_t>(value) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+std::uint16_t floatToBFloat16(float value) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    // NaN stays NaN, a quiet one.
+    return static_cast<std::uint16_t>((bits >> 16) | 0x40);
+  }
+  // Round to nearest, ties to even.
+  return static_cast<std::uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >>
+                                    16);
+}
+
+float float16ToFloat(std::uint16_t value) {
+  const std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000) << 16;
+  const std::uint32_t exponent = (value >> 10) & 0x1f;
+  const std::uint32_t mantissa = value & 0x3ff;
+  std::uint32_t bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else {
+    // Zero or subnormal, mantissa * 2^-24 is exact in a float.
+    const float magnitude = static_cast<float>(mantissa) * 0x1p-24f;
+    return sign != 0 ? -magnitude : magnitude;
+  }
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+std::uint16_t floatToFloat16(float value) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const std::uint16_t sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000);
+  std::uint32_t magnitude = bits & 0x7fffffff;
+  if (magnitude >= 0x7f800000) {
+    // Infinity, or a quiet NaN.
+    return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+  }
+  if (magnitude >= 0x477ff000) {
+    // 65520 and above round to infinity.
+    return sign | 0x7c00;
+  }
+  if (magnitude < 0x38800000) {
+    // Below the smallest normal half, adding 0.5 lets the float unit round
+    // the subnormal mantissa into the low bits.
+    float shifted;
+    std::memcpy(&shifted, &magnitude, sizeof(shifted));
+    shifted += 0.5f;
+    std::memcpy(&magnitude, &shifted, sizeof(magnitude));
+    return sign | static_cast<std::uint16_t>(magnitude - 0x3f000000);
+  }
+  // Rebias the exponent from 127 to 15, round to nearest, ties to even.
+  const std::uint32_t odd = (magnitude >> 13) & 1;
+  magnitude = magnitude - (112u << 23) + 0xfff + odd;
+  return sign | static_cast<std::uint16_t>(magnitude >> 13);
+}
+
+using NarrowFunction = void (*)(const float *, std::uint16_t *,
+                                std::size_t);
+using WidenFunction = void (*)(const std::uint16_t *, float *, std::size_t);
+
+template <HalfType Type>
+NN_ALWAYS_INLINE void narrowAny(const float *source, std::uint16_t *target,
+                                std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    target[i] = Type == HalfType::BFloat16 ? floatToBFloat16(source[i])
+                                           : floatToFloat16(source[i]);
+  }
+}
+
+template <HalfType Type>
+NN_ALWAYS_INLINE void widenAny(const std::uint16_t *source, float *target,
+                               std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    target[i] = Type == HalfType::BFloat16 ? bFloat16ToFloat(source[i])
+                                           : float16ToFloat(source[i]);
+  }
+}
+
+void narrowBFloat16Generic(const float *source, std::uint16_t *target,
+                           std::size_t n) {
+  narrowAny<HalfType::BFloat16>(source, target, n);
+}
+
+void narrowFloat16Generic(const float *source, std::uint16_t *target,
+                          std::size_t n) {
+  narrowAny<HalfType::Float16>(source, target, n);
+}
+
+void widenBFloat16Generic(const std::uint16_t *source, float *target,
+                          std::size_t n) {
+  widenAny<HalfType::BFloat16>(source, target, n);
+}
+
+void widenFloat16Generic(const std::uint16_t *source, float *target,
+                         std::size_t n) {
+  widenAny<HalfType::Float16>(source, target, n);
+}
+
+#if NN_X86
+// vcvtneps2bf16 rounds to nearest even like floatToBFloat16, but flushes
+// float subnormals (below 1.2e-38) to zero.
+NN_TARGET("avx512f,avx512bf16")
+void narrowBFloat16Avx512Bf16(const float *source, std::uint16_t *target,
+                              std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256bh half = _mm512_cvtneps_pbh(_mm512_loadu_ps(source + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i),
+                        reinterpret_cast<const __m256i &>(half));
+  }
+  narrowAny<HalfType::BFloat16>(source + i, target + i, n - i);
+}
+
+NN_TARGET("avx512f")
+void narrowBFloat16Avx512(const float *source, std::uint16_t *target,
+                          std::size_t n) {
+  narrowAny<HalfType::BFloat16>(source, target, n);
+}
+
+NN_TARGET("avx512f")
+void narrowFloat16Avx512(const float *source, std::uint16_t *target,
+                         std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(target + i),
+        _mm512_cvtps_ph(_mm512_loadu_ps(source + i),
+                        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  }
+  narrowAny<HalfType::Float16>(source + i, target + i, n - i);
+}
+
+// A bfloat16 is the upper half of a float, widening is a shift.
+NN_TARGET("avx512f")
+void widenBFloat16Avx512(const std::uint16_t *source, float *target,
+                         std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256i half =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+    _mm512_storeu_ps(target + i,
+                     _mm512_castsi512_ps(_mm512_slli_epi32(
+                         _mm512_cvtepu16_epi32(half), 16)));
+  }
+  widenAny<HalfType::BFloat16>(source + i, target + i, n - i);
+}
+
+NN_TARGET("avx512f")
+void widenFloat16Avx512(const std::uint16_t *source, float *target,
+                        std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(target + i,
+                     _mm512_cvtph_ps(_mm256_loadu_si256(
+                         reinterpret_cast<const __m256i *>(source + i))));
+  }
+  widenAny<HalfType::Float16>(source + i, target + i, n - i);
+}
+
+NN_TARGET("avx2,fma,f16c")
+void narrowBFloat16Avx2(const float *source, std::uint16_t *target,
+                        std::size_t n) {
+  narrowAny<HalfType::BFloat16>(source, target, n);
+}
+
+NN_TARGET("avx2,fma,f16c")
+void narrowFloat16Avx2(const float *source, std::uint16_t *target,
+                       std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(target + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(source + i),
+                        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  }
+  narrowAny<HalfType::Float16>(source + i, target + i, n - i);
+}
+
+NN_TARGET("avx2,fma,f16c")
+void widenBFloat16Avx2(const std::uint16_t *source, float *target,
+                       std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i half =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+    _mm256_storeu_ps(target + i,
+                     _mm256_castsi256_ps(_mm256_slli_epi32(
+                         _mm256_cvtepu16_epi32(half), 16)));
+  }
+  widenAny<HalfType::BFloat16>(source + i, target + i, n - i);
+}
+
+NN_TARGET("avx2,fma,f16c")
+void widenFloat16Avx2(const std::uint16_t *source, float *target,
+                      std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(target + i,
+                     _mm256_cvtph_ps(_mm_loadu_si128(
+                         reinterpret_cast<const __m128i *>(source + i))));
+  }
+  widenAny<HalfType::Float16>(source + i, target + i, n - i);
+}
+#endif
+
+/** One product of a dense and a 16 bit matrix, or a part of it.*/
+struct HalfArguments {
+  int m;
+  int n;
+  int k;
+  const Scalar *a;
+  int aRowStride;
+  const std::uint16_t *b;
+  int bRowStride;
+  Scalar *c;
+  int cRowStride;
+  HalfType type;
+  /** Blocks of kBlockColumns columns computed by this task.*/
+  int begin;
+  int end;
+};
+
+/** Adds scale times a widened row to a row of the result, Width 0 reads
+ * the width from n.*/
+template <bool Fused, int Width>
+NN_ALWAYS_INLINE void addScaledRow(Scalar scale, const float *__restrict row,
+                                   Scalar *__restrict target, int n) {
+  const int width = Width > 0 ? Width : n;
+  for (int j = 0; j < width; ++j) {
+    if constexpr (Fused) {
+      target[j] = fusedMultiplyAdd(scale, row[j], target[j]);
+    } else {
+      target[j] += scale * row[j];
+    }
+  }
+}
+
+/** Rows [r, r + Rows) of a against the widened rows of the block, row q
+ * of the panel is row depth + used[q] of b. A full block keeps its Rows x
+ * Width sums in registers while it runs over q, a partial one adds to c.
+ * The sums run over p in order, as in Gemm.*/
+template <bool Fused, int Width, int Rows>
+NN_ALWAYS_INLINE void accumulateRows(const HalfArguments &args,
+                                     const float *panel, const int *used,
+                                     int rows, int r, int depth, int column,
+                                     int width) {
+  const Scalar *aRows[Rows];
+  Scalar *cRows[Rows];
+  for (int i = 0; i < Rows; ++i) {
+    aRows[i] =
+        args.a + static_cast<std::size_t>(r + i) * args.aRowStride + depth;
+    cRows[i] =
+        args.c + static_cast<std::size_t>(r + i) * args.cRowStride + column;
+  }
+  if constexpr (Width > 0) {
+    Scalar sums[Rows][Width];
+    for (int i = 0; i < Rows; ++i) {
+      std::copy(cRows[i], cRows[i] + Width, sums[i]);
+    }
+    for (int q = 0; q < rows; ++q) {
+      for (int i = 0; i < Rows; ++i) {
+        addScaledRow<Fused, Width>(aRows[i][used[q]],
+                                   panel + q * kBlockColumns, sums[i], Width);
+      }
+    }
+    for (int i = 0; i < Rows; ++i) {
+      std::copy(sums[i], sums[i] + Width, cRows[i]);
+    }
+  } else {
+    for (int i = 0; i < Rows; ++i) {
+      for (int q = 0; q < rows; ++q) {
+        addScaledRow<Fused, 0>(aRows[i][used[q]], panel + q * kBlockColumns,
+                               cRows[i], width);
+      }
+    }
+  }
+}
+
+/** Every row of a against the widened rows of the block, RowGroup rows
+ * share every load of the block.*/
+template <bool Fused, int RowGroup, int Width>
+NN_ALWAYS_INLINE void accumulateBlock(const HalfArguments &args,
+                                      const float *panel, const int *used,
+                                      int rows, int depth, int column,
+                                      int width) {
+  int r = 0;
+  for (; r + RowGroup <= args.m; r += RowGroup) {
+    accumulateRows<Fused, Width, RowGroup>(args, panel, used, rows, r, depth,
+                                           column, width);
+  }
+  for (; r < args.m; ++r) {
+    accumulateRows<Fused, Width, 1>(args, panel, used, rows, r, depth, column,
+                                    width);
+  }
+}
+
+/** Column blocks [begin, end) of a * b. Each KC x NC block of b is widened
+ * once into a float buffer on the stack and used for all rows of a. Rows
+ * of b whose inputs are zero in every row of a are left out, for a sparse
+ * batch that is most of them. RowGroup rows of full sums fit into the
+ * vector registers.*/
+template <WidenFunction Widen, bool Fused, int RowGroup>
+NN_ALWAYS_INLINE void multiplyBlocks(const HalfArguments &args) {
+  alignas(kMatrixAlignment) float panel[kBlockDepth * kBlockColumns];
+  int used[kBlockDepth];
+  for (int block = args.begin; block < args.end; ++block) {
+    const int column = block * kBlockColumns;
+    const int width = std::min(kBlockColumns, args.n - column);
+    for (int r = 0; r < args.m; ++r) {
+      Scalar *cRow =
+          args.c + static_cast<std::size_t>(r) * args.cRowStride + column;
+      std::fill(cRow, cRow + width, Scalar(0));
+    }
+    for (int depth = 0; depth < args.k; depth += kBlockDepth) {
+      const int depthEnd = std::min(kBlockDepth, args.k - depth);
+      int rows = 0;
+      for (int p = 0; p < depthEnd; ++p) {
+        bool isUsed = false;
+        for (int r = 0; r < args.m && !isUsed; ++r) {
+          isUsed = args.a[static_cast<std::size_t>(r) * args.aRowStride +
+                          depth + p] != 0;
+        }
+        if (isUsed) {
+          Widen(args.b +
+                    static_cast<std::size_t>(depth + p) * args.bRowStride +
+                    column,
+                panel + rows * kBlockColumns, width);
+          used[rows++] = p;
+        }
+      }
+      if (width == kBlockColumns) {
+        accumulateBlock<Fused, RowGroup, kBlockColumns>(
+            args, panel, used, rows, depth, column, width);
+      } else {
+        accumulateBlock<Fused, RowGroup, 0>(args, panel, used, rows, depth,
+                                            column, width);
+      }
+    }
+  }
+}
+
+#if NN_X86
+NN_TARGET("avx512f")
+void multiplyAvx512(const HalfArguments &args) {
+  if (args.type == HalfType::BFloat16) {
+    multiplyBlocks<widenBFloat16Avx512, true, kAvx512RowGroup>(args);
+  } else {
+    multiplyBlocks<widenFloat16Avx512, true, kAvx512RowGroup>(args);
+  }
+}
+
+NN_TARGET("avx2,fma,f16c")
+void multiplyAvx2(const HalfArguments &args) {
+  if (args.type == HalfType::BFloat16) {
+    multiplyBlocks<widenBFloat16Avx2, true, 1>(args);
+  } else {
+    multiplyBlocks<widenFloat16Avx2, true, 1>(args);
+  }
+}
+#endif
+
+void multiplyGeneric(const HalfArguments &args) {
+  if (args.type == HalfType::BFloat16) {
+    multiplyBlocks<widenBFloat16Generic, false, 1>(args);
+  } else {
+    multiplyBlocks<widenFloat16Generic, false, 1>(args);
+  }
+}
+
+struct HalfKernels {
+  /** Instruction set of the fp16 kernels and of the bfloat16 widening.*/
+  const char *name;
+  /** Instruction set of the bfloat16 kernels, their rounding can use an
+   * extension of its own.*/
+  const char *bFloat16Name;
+  NarrowFunction narrowBFloat16;
+  NarrowFunction narrowFloat16;
+  WidenFunction widenBFloat16;
+  WidenFunction widenFloat16;
+  void (*multiply)(const HalfArguments &);
+};
+
+HalfKernels selectKernels() {
+  const SimdLevel level = Simd::getLevel();
+#if NN_X86
+  if (level == SimdLevel::Avx512) {
+    const bool isBFloat16 = __builtin_cpu_supports("avx512bf16");
+    return {"avx512",
+            isBFloat16 ? "avx512bf16" : "avx512",
+            isBFloat16 ? narrowBFloat16Avx512Bf16 : narrowBFloat16Avx512,
+            narrowFloat16Avx512,
+            widenBFloat16Avx512,
+            widenFloat16Avx512,
+            multiplyAvx512};
+  }
+  if (level == SimdLevel::Avx2 && __builtin_cpu_supports("f16c")) {
+    return {"avx2",
+            "avx2",
+            narrowBFloat16Avx2,
+            narrowFloat16Avx2,
+            widenBFloat16Avx2,
+            widenFloat16Avx2,
+            multiplyAvx2};
+  }
+#endif
+  return {"generic",
+          "generic",
+          narrowBFloat16Generic,
+          narrowFloat16Generic,
+          widenBFloat16Generic,
+          widenFloat16Generic,
+          multiplyGeneric};
+}
+
+const HalfKernels &getKernels() {
+  static const HalfKernels kernels = selectKernels();
+  return kernels;
+}
+
+/** Float values go to the kernels as they are, double values a chunk at
+ * a time through a float buffer.*/
+void narrowValues(NarrowFunction kernel, const float *source,
+                  std::uint16_t *target, std::size_t n) {
+  kernel(source, target, n);
+}
+
+template <typename Value>
+void narrowValues(NarrowFunction kernel, const Value *source,
+                  std::uint16_t *target, std::size_t n) {
+  float chunk[kChunk];
+  for (std::size_t i = 0; i < n; i += kChunk) {
+    const std::size_t size = std::min(kChunk, n - i);
+    std::copy(source + i, source + i + size, chunk);
+    kernel(chunk, target + i, size);
+  }
+}
+
+void widenValues(WidenFunction kernel, const std::uint16_t *source,
+                 float *target, std::size_t n) {
+  kernel(source, target, n);
+}
+
+template <typename Value>
+void widenValues(WidenFunction kernel, const std::uint16_t *source,
+                 Value *target, std::size_t n) {
+  float chunk[kChunk];
+  for (std::size_t i = 0; i < n; i += kChunk) {
+    const std::size_t size = std::min(kChunk, n - i);
+    kernel(source + i, chunk, size);
+    std::copy(chunk, chunk + size, target + i);
+  }
+}
+
+void checkType(HalfType type) {
+  if (type != HalfType::BFloat16 && type != HalfType::Float16) {
+    throw std::runtime_error("A half matrix needs a 16 bit type.");
+  }
+}
+
+} // namespace
+
+HalfMatrix::HalfMatrix(HalfType type)
+    : m_type(type), m_numberOfRows(0), m_numberOfColumns(0), m_stride(0) {
+  checkType(type);
+}
+
+HalfType HalfMatrix::typeFromString(const std::string &name) {
+  if (name.empty() || name == "none") {
+    return HalfType::None;
+  } else if (name == "bf16") {
+    return HalfType::BFloat16;
+  } else if (name == "fp16") {
+    return HalfType::Float16;
+  }
+  throw std::runtime_error("Invalid 16 bit type: " + name);
+}
+
+std::string HalfMatrix::getTypeName(HalfType type) {
+  switch (type) {
+  case HalfType::BFloat16:
+    return "bf16";
+  case HalfType::Float16:
+    return "fp16";
+  default:
+    return "none";
+  }
+}
+
+void HalfMatrix::assign(const Matrix &source) {
+  const int rows = source.getNumberOfRows();
+  const int columns = source.getNumberOfColumns();
+  if (rows != m_numberOfRows || columns != m_numberOfColumns) {
+    // 32 values are 64 bytes, every row starts aligned.
+    m_stride = (columns + 31) / 32 * 32;
+    m_values.assign(static_cast<std::size_t>(rows) * m_stride, 0);
+    m_numberOfRows = rows;
+    m_numberOfColumns = columns;
+  }
+  ThreadPool::getInstance().parallelFor(
+      0, rows, std::max(1, kMinValuesPerTask / std::max(1, columns)),
+      [&](int begin, int end) {
+        for (int r = begin; r < end; ++r) {
+          narrow(source.row(r).data(),
+                 m_values.data() + static_cast<std::size_t>(r) * m_stride,
+                 columns, m_type);
+        }
+      });
+}
+
+void HalfMatrix::multiply(const Matrix &a, const HalfMatrix &b,
+                          Matrix &result) {
+  if (a.getNumberOfColumns() != b.m_numberOfRows) {
+    throw std::runtime_error("Matrix multiplication not possible.\n");
+  }
+  multiply(a.data(), a.getNumberOfRows(), a.getStride(), b, result);
+}
+
+void HalfMatrix::multiply(const Scalar *a, int rows, int aRowStride,
+                          const HalfMatrix &b, Matrix &result) {
+  if (result.getNumberOfRows() != rows ||
+      result.getNumberOfColumns() != b.m_numberOfColumns) {
+    throw std::runtime_error("Matrix multiplication not possible.\n");
+  }
+  const HalfArguments args{rows,
+                           b.m_numberOfColumns,
+                           b.m_numberOfRows,
+                           a,
+                           aRowStride,
+                           b.m_values.data(),
+                           b.m_stride,
+                           result.data(),
+                           result.getStride(),
+                           b.m_type,
+                           0,
+                           0};
+  const auto kernel = getKernels().multiply;
+  const int blocks = (args.n + kBlockColumns - 1) / kBlockColumns;
+  const double flopsPerBlock =
+      2.0 * args.m * static_cast<double>(args.k) * kBlockColumns;
+  const int grain = static_cast<int>(
+      std::max(1.0, kMinParallelFlops / std::max(1.0, flopsPerBlock)));
+  ThreadPool::getInstance().parallelFor(0, blocks, grain,
+                                        [&](int begin, int end) {
+                                          HalfArguments task = args;
+                                          task.begin = begin;
+                                          task.end = end;
+                                          kernel(task);
+                                        });
+}
+
+void HalfMatrix::narrow(const Scalar *source, std::uint16_t *target,
+                        std::size_t n, HalfType type) {
+  checkType(type);
+  const NarrowFunction kernel = type == HalfType::BFloat16
+                                    ? getKernels().narrowBFloat16
+                                    : getKernels().narrowFloat16;
+  narrowValues(kernel, source, target, n);
+}
+
+void HalfMatrix::widen(const std::uint16_t *source, Scalar *target,
+                       std::size_t n, HalfType type) {
+  checkType(type);
+  const WidenFunction kernel = type == HalfType::BFloat16
+                                   ? getKernels().widenBFloat16
+                                   : getKernels().widenFloat16;
+  widenValues(kernel, source, target, n);
+}
+
+int HalfMatrix::getNumberOfRows() const { return m_numberOfRows; }
+
+int HalfMatrix::getNumberOfColumns() const { return m_numberOfColumns; }
+
+HalfType HalfMatrix::getType() const { return m_type; }
+
+std::size_t HalfMatrix::getBytes() const {
+  return sizeof(std::uint16_t) * static_cast<std::size_t>(m_numberOfRows) *
+         m_numberOfColumns;
+}
+
+std::string HalfMatrix::getKernelName(HalfType type) {
+  return type == HalfType::BFloat16 ? getKernels().bFloat16Name
+                                    : getKernels().name;
+}
@@ -0,0 +1,143 @@
+#ifndef _HALF_MATRIX_H
+#define _HALF_MATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "alignedAllocator.h"
+#include "matrix.h"
+
+/** 16 bit formats a HalfMatrix stores its values in.*/
+enum class HalfType {
+  /** No 16 bit copy, the Scalar values are used.*/
+  None,
+  /** bfloat16, the upper half of a float: the range of a float with 8
+   * bits of mantissa.*/
+  BFloat16,
+  /** IEEE 754 half precision, 11 bits of mantissa up to 65504.*/
+  Float16
+};
+
+/**
+ * @brief Matrix of 16 bit values, half the bytes of a float matrix. Weights
+ * of memory bound layers are stored in it and widened to float right
+ * before they are multiplied, the sums are kept in Scalar. Values are
+ * rounded to the nearest 16 bit value, ties to even.
+ *
+ * Conversions use AVX-512 (and AVX-512 BF16 to narrow to bfloat16) or
+ * AVX2 with F16C where the CPU has them, and portable code otherwise.
+ */
+class HalfMatrix {
+public:
+  /**
+   * @brief Construct a new empty Half Matrix object.
+   *
+   * @param type format of the values.
+   */
+  explicit HalfMatrix(HalfType type = HalfType::BFloat16);
+
+  /**
+   * @brief Get the format from its name in a config file.
+   *
+   * @param name "" for none, "bf16" or "fp16".
+   * @return HalfType format.
+   * @throws std::runtime_error for any other name.
+   */
+  static HalfType typeFromString(const std::string &name);
+
+  /**
+   * @brief Get the name of a format.
+   *
+   * @param type format.
+   * @return std::string "none", "bf16" or "fp16".
+   */
+  static std::string getTypeName(HalfType type);
+
+  /**
+   * @brief Round a matrix to 16 bits, the rows are spread over the
+   * threads. The matrix takes the shape of source.
+   *
+   * @param source values to store.
+   */
+  void assign(const Matrix &source);
+
+  /**
+   * @brief Multiply a with a 16 bit matrix. Rows of b are widened to float
+   * a block at a time and reused for every row of a, inputs that are zero
+   * are skipped.
+   *
+   * @param a left matrix (m x k).
+   * @param b right matrix (k x n).
+   * @param result (m x n) matrix that receives a * b.
+   * @throws std::runtime_error when the shapes do not fit.
+   */
+  static void multiply(const Matrix &a, const HalfMatrix &b, Matrix &result);
+
+  /**
+   * @brief Multiply rows of a with a 16 bit matrix.
+   *
+   * @param a values of the first row of the left matrix.
+   * @param rows number of rows of a.
+   * @param aRowStride distance between two neighbouring rows of a.
+   * @param b right matrix (k x n).
+   * @param result (rows x n) matrix that receives a * b.
+   * @throws std::runtime_error when the shapes do not fit.
+   */
+  static void multiply(const Scalar *a, int rows, int aRowStride,
+                       const HalfMatrix &b, Matrix &result);
+
+  /**
+   * @brief Round values to 16 bits.
+   *
+   * @param source values to round.
+   * @param target n 16 bit values are written here.
+   * @param n number of values.
+   * @param type format of the 16 bit values.
+   */
+  static void narrow(const Scalar *source, std::uint16_t *target,
+                     std::size_t n, HalfType type);
+
+  /**
+   * @brief Widen 16 bit values, exactly.
+   *
+   * @param source 16 bit values.
+   * @param target n values are written here.
+   * @param n number of values.
+   * @param type format of the 16 bit values.
+   */
+  static void widen(const std::uint16_t *source, Scalar *target,
+                    std::size_t n, HalfType type);
+
+  int getNumberOfRows() const;
+  int getNumberOfColumns() const;
+  HalfType getType() const;
+
+  /**
+   * @brief Get the number of bytes of the stored values, padding
+   * excluded.
+   *
+   * @return std::size_t size of the values.
+   */
+  std::size_t getBytes() const;
+
+  /**
+   * @brief Get the name of the kernels selected for this CPU for a format.
+   *
+   * @param type format of the values.
+   * @return std::string "avx512bf16" (bfloat16 only), "avx512", "avx2" or
+   * "generic".
+   */
+  static std::string getKernelName(HalfType type);
+
+private:
+  HalfType m_type;
+  int m_numberOfRows;
+  int m_numberOfColumns;
+  /** Distance between two rows, columns rounded up to 64 bytes.*/
+  int m_stride;
+  std::vector<std::uint16_t, AlignedAllocator<std::uint16_t>> m_values;
+};
+
+#endif // _HALF_MATRIX_H
@@ -0,0 +1,149 @@
+#include "inference.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+Inference::Inference(const std::vector<int> &topology,
+                     const std::vector<ActivationType> &activations,
+                     const std::vector<std::shared_ptr<Matrix>> &weights,
+                     double bias)
+    : m_topology(topology), m_activations(activations),
+      m_weightMatrices(weights), m_bias(bias), m_sparseInputThreshold(0.0),
+      m_inputScale(1.0) {
+  if (m_topology.size() < 2 || m_activations.size() != m_topology.size() ||
+      m_weightMatrices.size() + 1 != m_topology.size()) {
+    throw std::runtime_error("Weights do not fit the topology.");
+  }
+  for (std::size_t i = 0; i < m_weightMatrices.size(); ++i) {
+    if (m_weightMatrices.at(i)->getNumberOfRows() != m_topology.at(i) ||
+        m_weightMatrices.at(i)->getNumberOfColumns() != m_topology.at(i + 1)) {
+      throw std::runtime_error("Weights do not fit the topology.");
+    }
+  }
+}
+
+InferenceBuffers Inference::createBuffers(int rows) const {
+  InferenceBuffers buffers;
+  for (std::size_t i = 1; i < m_topology.size(); ++i) {
+    buffers.values.emplace_back(rows, m_topology.at(i), false);
+    buffers.activated.emplace_back(rows, m_topology.at(i), false);
+  }
+  return buffers;
+}
+
+const Matrix &Inference::forward(const Matrix &inputs,
+                                 InferenceBuffers &buffers) const {
+  if (inputs.getNumberOfColumns() != m_topology.front()) {
+    throw std::runtime_error(
+        "Input size is not the same as the INPUT LAYER SIZE.");
+  }
+  if (buffers.values.size() + 1 != m_topology.size()) {
+    buffers = createBuffers(inputs.getNumberOfRows());
+  }
+  const int rows = inputs.getNumberOfRows();
+  // The input layer is used as it is, like in NeuralNetwork::feedForward,
+  // after the scale the batches of the training run had.
+  const Matrix *left = &inputs;
+  if (m_inputScale != 1.0) {
+    Matrix &scaled = buffers.scaledInputs;
+    scaled.resize(rows, inputs.getNumberOfColumns());
+    for (int row = 0; row < rows; ++row) {
+      const Scalar *source = inputs.row(row).data();
+      Scalar *target = scaled.row(row).data();
+      for (int column = 0; column < inputs.getNumberOfColumns(); ++column) {
+        target[column] = static_cast<Scalar>(source[column] * m_inputScale);
+      }
+    }
+    left = &scaled;
+  }
+  const Matrix &firstInputs = *left;
+  const Scalar bias = static_cast<Scalar>(m_bias);
+  for (std::size_t i = 0; i + 1 < m_topology.size(); ++i) {
+    Matrix &values = buffers.values.at(i);
+    Matrix &activated = buffers.activated.at(i);
+    values.resize(rows, m_topology.at(i + 1));
+    activated.resize(rows, m_topology.at(i + 1));
+    if (!m_halfWeights.empty()) {
+      // Rows of zero inputs are skipped by the kernel itself.
+      HalfMatrix::multiply(*left, *m_halfWeights.at(i), values);
+    } else if (i == 0 && buffers.sparseInput.compress(
+                             firstInputs, m_sparseInputThreshold)) {
+      SparseMatrix::multiply(buffers.sparseInput, *m_weightMatrices.at(i),
+                             values);
+    } else {
+      Matrix::multiply(*left, *m_weightMatrices.at(i), values);
+    }
+    Scalar *data = values.data();
+    const std::size_t size =
+        static_cast<std::size_t>(rows) * values.getStride();
+    for (std::size_t v = 0; v < size; ++v) {
+      data[v] += bias;
+    }
+    Activation::apply(m_activations.at(i + 1), data, activated.data(),
+                      nullptr, size);
+    left = &activated;
+  }
+  return *left;
+}
+
+void Inference::setSparseInputThreshold(double threshold) {
+  m_sparseInputThreshold = threshold;
+}
+
+void Inference::setInputScale(double scale) { m_inputScale = scale; }
+
+double Inference::getInputScale() const { return m_inputScale; }
+
+void Inference::setHalfType(HalfType type) {
+  if (m_weightMatrices.empty()) {
+    throw std::runtime_error("The full precision weights were released.");
+  }
+  m_halfWeights.clear();
+  if (type == HalfType::None) {
+    return;
+  }
+  for (const auto &weights : m_weightMatrices) {
+    auto half = std::make_shared<HalfMatrix>(type);
+    half->assign(*weights);
+    m_halfWeights.push_back(half);
+  }
+}
+
+void Inference::releaseFullWeights() {
+  if (m_halfWeights.empty()) {
+    throw std::runtime_error("There are no 16 bit weights to keep.");
+  }
+  m_weightMatrices.clear();
+}
+
+HalfType Inference::getHalfType() const {
+  return m_halfWeights.empty() ? HalfType::None
+                               : m_halfWeights.front()->getType();
+}
+
+int Inference::argmax(StridedView<const Scalar> row) {
+  int best = 0;
+  for (int i = 1; i < row.size(); ++i) {
+    if (row[i] > row[best]) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+int Inference::getInputSize() const { return m_topology.front(); }
+
+int Inference::getOutputSize() const { return m_topology.back(); }
+
+const std::vector<int> &Inference::getTopology() const { return m_topology; }
+
+const std::vector<ActivationType> &Inference::getActivations() const {
+  return m_activations;
+}
+
+const std::vector<std::shared_ptr<Matrix>> &
+Inference::getWeightMatrices() const {
+  return m_weightMatrices;
+}
+
+double Inference::getBias() const { return m_bias; }
@@ -0,0 +1,182 @@
+#ifndef _INFERENCE_H
+#define _INFERENCE_H
+
+#include <memory>
+#include <vector>
+
+#include "activation.h"
+#include "halfMatrix.h"
+#include "matrix.h"
+#include "sparseMatrix.h"
+
+/** Values of every layer for one batch. Each evaluating thread owns its own
+ * buffers, so threads share nothing but the read only weights.*/
+struct InferenceBuffers {
+  /** Values at the neurons of every layer after the input (batch x
+   * neurons).*/
+  std::vector<Matrix> values;
+  /** Activated values of every layer after the input, the last one is the
+   * output of the network.*/
+  std::vector<Matrix> activated;
+  /** Non zero values of a sparse input batch.*/
+  SparseMatrix sparseInput;
+  /** Inputs multiplied by the input scale, when it is not 1.*/
+  Matrix scaledInputs{0, 0, false};
+};
+
+class Inference {
+public:
+  /**
+   * @brief Construct a new Inference object over trained weights. The
+   * weights are shared, not copied, and never written.
+   *
+   * @param topology number of neurons in each layer.
+   * @param activations activation function of each layer.
+   * @param weights (topology - 1) weight matrices.
+   * @param bias added to every neuron after the input layer.
+   * @throws std::runtime_error when the weights do not fit the topology.
+   */
+  Inference(const std::vector<int> &topology,
+            const std::vector<ActivationType> &activations,
+            const std::vector<std::shared_ptr<Matrix>> &weights, double bias);
+
+  /**
+   * @brief Create buffers for batches of up to rows samples.
+   *
+   * @param rows largest number of samples in a batch.
+   * @return InferenceBuffers buffers for one thread.
+   */
+  InferenceBuffers createBuffers(int rows) const;
+
+  /**
+   * @brief Feed a batch forward through the network. Only the buffers are
+   * written, so threads with their own buffers can run this at the same
+   * time.
+   *
+   * @param inputs (batch x input layer) matrix, one sample per row.
+   * @param buffers buffers of the calling thread, resized to the batch.
+   * @return const Matrix& (batch x output layer) output of the network,
+   * it lives in buffers.
+   */
+  const Matrix &forward(const Matrix &inputs, InferenceBuffers &buffers) const;
+
+  /**
+   * @brief Let the first layer skip the zeros of batches with a smaller
+   * share of non zero inputs than threshold.
+   *
+   * @param threshold share of non zero inputs, 0 turns it off.
+   */
+  void setSparseInputThreshold(double threshold);
+
+  /**
+   * @brief Multiply every input value by scale before the first layer, the
+   * same scale the network was trained with.
+   *
+   * @param scale inputScale of the training run, 1 leaves them as they are.
+   */
+  void setInputScale(double scale);
+
+  /**
+   * @brief Get the factor every input value is multiplied by.
+   *
+   * @return double input scale.
+   */
+  double getInputScale() const;
+
+  /**
+   * @brief Multiply with 16 bit copies of the weights, which are rounded
+   * once here. The sums stay in Scalar, the shared weights are not
+   * changed.
+   *
+   * @param type format of the copies, HalfType::None drops them.
+   * @throws std::runtime_error after releaseFullWeights().
+   */
+  void setHalfType(HalfType type);
+
+  /**
+   * @brief Drop this object's share of the full precision weights, forward
+   * then only reads the 16 bit copies.
+   *
+   * @throws std::runtime_error when there are no 16 bit copies.
+   */
+  void releaseFullWeights();
+
+  /**
+   * @brief Get the format the weights are multiplied in.
+   *
+   * @return HalfType format of the copies, HalfType::None without them.
+   */
+  HalfType getHalfType() const;
+
+  /**
+   * @brief Get the position of the highest value in a row, which is the
+   * class the network predicts for an output row.
+   *
+   * @param row values of one sample.
+   * @return int position of the highest value.
+   */
+  static int argmax(StridedView<const Scalar> row);
+
+  /**
+   * @brief Get the number of neurons in the input layer.
+   *
+   * @return int size of one sample.
+   */
+  int getInputSize() const;
+
+  /**
+   * @brief Get the number of neurons in the output layer.
+   *
+   * @return int size of one output row.
+   */
+  int getOutputSize() const;
+
+  /**
+   * @brief Get the number of neurons in each layer.
+   *
+   * @return const std::vector<int>& topology of the network.
+   */
+  const std::vector<int> &getTopology() const;
+
+  /**
+   * @brief Get the activation function of each layer.
+   *
+   * @return const std::vector<ActivationType>& activation functions.
+   */
+  const std::vector<ActivationType> &getActivations() const;
+
+  /**
+   * @brief Get the weight matrices, (topology - 1) of them, none after
+   * releaseFullWeights().
+   *
+   * @return const std::vector<std::shared_ptr<Matrix>>& shared weights.
+   */
+  const std::vector<std::shared_ptr<Matrix>> &getWeightMatrices() const;
+
+  /**
+   * @brief Get the bias added to every neuron after the input layer.
+   *
+   * @return double bias.
+   */
+  double getBias() const;
+
+private:
+  /** Number of neurons in each layer.*/
+  std::vector<int> m_topology;
+  /** Activation function of each layer.*/
+  std::vector<ActivationType> m_activations;
+  /** Weight matrices, shared with their owner and only read.*/
+  std::vector<std::shared_ptr<Matrix>> m_weightMatrices;
+  /** Added to every neuron after the input layer.*/
+  double m_bias;
+  /** Share of non zero inputs below which the first layer works on the
+   * sparse input, 0 for never.*/
+  double m_sparseInputThreshold;
+  /** Every input value is multiplied by this before the first layer.*/
+  double m_inputScale;
+  /** 16 bit copies of the weights, empty when the Scalar weights are
+   * used.*/
+  std::vector<std::shared_ptr<const HalfMatrix>> m_halfWeights;
+};
+
+#endif // _INFERENCE_H
@@ -0,0 +1,299 @@
+#include "inferenceServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+/** Bytes read from a client at once.*/
+constexpr std::size_t kReadSize = 1 << 16;
+
+/**
+ * Parse comma or space separated values. Returns an empty string on
+ * success, otherwise the reason the line is not a sample.
+ */
+std::string parseValues(const std::string &line, std::size_t expected,
+                        std::vector<double> &values) {
+  values.clear();
+  const char *position = line.data();
+  const char *end = position + line.size();
+  while (position < end) {
+    while (position < end && (*position == ',' || *position == ' ' ||
+                              *position == '\t')) {
+      ++position;
+    }
+    if (position == end) {
+      break;
+    }
+    double value;
+    const auto result = std::from_chars(position, end, value);
+    if (result.ec != std::errc()) {
+      return "invalid value " + std::to_string(values.size() + 1);
+    }
+    values.push_back(value);
+    position = result.ptr;
+  }
+  if (values.size() != expected) {
+    return "expected " + std::to_string(expected) + " values, got " +
+           std::to_string(values.size());
+  }
+  return "";
+}
+
+/** Write everything, a client that went away is ignored.*/
+void writeAll(int fd, const std::string &text) {
+  const char *data = text.data();
+  std::size_t left = text.size();
+  while (left > 0) {
+    const ssize_t written = ::write(fd, data, left);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    data += written;
+    left -= written;
+  }
+}
+
+} // namespace
+
+InferenceServer::Connection::~Connection() {
+  if (isOwner) {
+    ::close(fd);
+  }
+}
+
+InferenceServer::InferenceServer(Inference inference,
+                                 const ServerOptions &options)
+    : m_inference(std::move(inference)), m_options(options),
+      m_inputs(std::max(1, options.maxBatchSize), m_inference.getInputSize(),
+               false),
+      m_isClosed(false), m_requests(0), m_batches(0) {
+  m_options.maxBatchSize = std::max(1, m_options.maxBatchSize);
+  m_options.maxLatencyMs = std::max(0.0, m_options.maxLatencyMs);
+  m_buffers = m_inference.createBuffers(m_options.maxBatchSize);
+}
+
+void InferenceServer::run() {
+  // Writing to a client that is gone must not end the server.
+  std::signal(SIGPIPE, SIG_IGN);
+  std::thread batcher(&InferenceServer::evaluateBatches, this);
+  try {
+    if (m_options.socketPath.empty()) {
+      std::cerr << "Serving requests from stdin" << std::endl;
+      readRequests(STDIN_FILENO,
+                   std::make_shared<Connection>(STDOUT_FILENO, false));
+    } else {
+      serveSocket();
+    }
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_isClosed = true;
+    }
+    m_wakeUp.notify_all();
+    batcher.join();
+    throw;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_isClosed = true;
+  }
+  m_wakeUp.notify_all();
+  batcher.join();
+  std::cerr << "Answered " << m_requests << " requests in " << m_batches
+            << " batches" << std::endl;
+}
+
+void InferenceServer::serveSocket() {
+  const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    throw std::runtime_error("Could not create a socket: " +
+                             std::string(std::strerror(errno)));
+  }
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (m_options.socketPath.size() >= sizeof(address.sun_path)) {
+    ::close(listener);
+    throw std::runtime_error("Socket path is too long: " +
+                             m_options.socketPath);
+  }
+  std::strcpy(address.sun_path, m_options.socketPath.c_str());
+  // A socket file left behind by an earlier server is replaced.
+  ::unlink(m_options.socketPath.c_str());
+  if (::bind(listener, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) < 0 ||
+      ::listen(listener, SOMAXCONN) < 0) {
+    const std::string reason = std::strerror(errno);
+    ::close(listener);
+    throw std::runtime_error("Could not listen on " + m_options.socketPath +
+                             ": " + reason);
+  }
+  std::cerr << "Serving requests on " << m_options.socketPath << std::endl;
+
+  while (true) {
+    const int client = ::accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      const std::string reason = std::strerror(errno);
+      ::close(listener);
+      throw std::runtime_error("Could not accept a client: " + reason);
+    }
+    // The connection closes the socket after its last answer.
+    std::thread(&InferenceServer::readRequests, this, client,
+                std::make_shared<Connection>(client, true))
+        .detach();
+  }
+}
+
+void InferenceServer::readRequests(int fd,
+                                   std::shared_ptr<Connection> connection) {
+  std::vector<char> buffer(kReadSize);
+  std::string line;
+  while (true) {
+    const ssize_t size = ::read(fd, buffer.data(), buffer.size());
+    if (size < 0 && errno == EINTR) {
+      continue;
+    }
+    if (size <= 0) {
+      break;
+    }
+    const char *position = buffer.data();
+    const char *end = position + size;
+    while (position < end) {
+      const char *newLine = static_cast<const char *>(
+          std::memchr(position, '\n', end - position));
+      if (newLine == nullptr) {
+        line.append(position, end);
+        break;
+      }
+      line.append(position, newLine);
+      submit(line, connection);
+      line.clear();
+      position = newLine + 1;
+    }
+  }
+  // The last line does not need a line break.
+  submit(line, connection);
+}
+
+void InferenceServer::submit(const std::string &line,
+                             const std::shared_ptr<Connection> &connection) {
+  std::string text = line;
+  if (!text.empty() && text.back() == '\r') {
+    text.pop_back();
+  }
+  if (text.find_first_not_of(" \t") == std::string::npos) {
+    return;
+  }
+  Request request;
+  request.connection = connection;
+  request.error = parseValues(text, m_inference.getInputSize(),
+                              request.inputs);
+  request.arrival = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(std::move(request));
+  }
+  m_wakeUp.notify_one();
+}
+
+void InferenceServer::evaluateBatches() {
+  const auto latency = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(
+      std::chrono::duration<double, std::milli>(m_options.maxLatencyMs));
+  const std::size_t maxBatchSize = m_options.maxBatchSize;
+  std::vector<Request> batch;
+  batch.reserve(maxBatchSize);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wakeUp.wait(lock, [this] { return !m_queue.empty() || m_isClosed; });
+      if (m_queue.empty()) {
+        return;
+      }
+      // Wait for the batch to fill, at most until the oldest request has
+      // used up its latency budget.
+      const auto deadline = m_queue.front().arrival + latency;
+      m_wakeUp.wait_until(lock, deadline, [&] {
+        return m_queue.size() >= maxBatchSize || m_isClosed;
+      });
+      const std::size_t count = std::min(m_queue.size(), maxBatchSize);
+      for (std::size_t i = 0; i < count; ++i) {
+        batch.push_back(std::move(m_queue.front()));
+        m_queue.pop_front();
+      }
+    }
+    evaluate(batch);
+    batch.clear();
+  }
+}
+
+void InferenceServer::evaluate(std::vector<Request> &batch) {
+  int rows = 0;
+  for (const Request &request : batch) {
+    rows += request.error.empty() ? 1 : 0;
+  }
+  const Matrix *outputs = nullptr;
+  if (rows > 0) {
+    m_inputs.resize(rows, m_inference.getInputSize());
+    int row = 0;
+    for (const Request &request : batch) {
+      if (request.error.empty()) {
+        std::copy(request.inputs.begin(), request.inputs.end(),
+                  m_inputs.row(row++).data());
+      }
+    }
+    outputs = &m_inference.forward(m_inputs, m_buffers);
+  }
+
+  // Answers to the same client that follow each other are written at once.
+  std::string answers;
+  char number[32];
+  int row = 0;
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    const Request &request = batch[i];
+    if (!request.error.empty()) {
+      answers += "error: " + request.error;
+    } else {
+      auto output = outputs->row(row++);
+      const int predicted = Inference::argmax(output);
+      answers += std::to_string(predicted);
+      if (m_options.isProbabilities) {
+        // Softmax of the output layer.
+        double sum = 0.0;
+        for (int j = 0; j < output.size(); ++j) {
+          sum += std::exp(output[j] - output[predicted]);
+        }
+        for (int j = 0; j < output.size(); ++j) {
+          std::snprintf(number, sizeof(number), ",%.6g",
+                        std::exp(output[j] - output[predicted]) / sum);
+          answers += number;
+        }
+      }
+    }
+    answers += '\n';
+    if (i + 1 == batch.size() ||
+        batch[i + 1].connection != request.connection) {
+      writeAll(request.connection->fd, answers);
+      answers.clear();
+    }
+  }
+  m_requests += batch.size();
+  m_batches++;
+}
@@ -0,0 +1,121 @@
+#ifndef _INFERENCE_SERVER_H
+#define _INFERENCE_SERVER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "inference.h"
+
+struct ServerOptions {
+  /** Unix domain socket to listen on, empty reads requests from stdin.*/
+  std::string socketPath;
+  /** Most requests evaluated together in one batch.*/
+  int maxBatchSize = 64;
+  /** Longest time in milliseconds a request waits for others to join its
+   * batch, 0 evaluates whatever is queued right away.*/
+  double maxLatencyMs = 1.0;
+  /** Answer with the softmax of the output layer after the class.*/
+  bool isProbabilities = false;
+};
+
+/**
+ * @brief Keeps a trained network in memory and answers requests, one sample
+ * per line. Requests of all clients go into one queue and are evaluated
+ * together in micro batches: a batch is started when it is full or when its
+ * oldest request has waited for the latency budget. Every client gets its
+ * answers in the order it sent the samples.
+ *
+ * A request is one line of comma or space separated input values, the
+ * answer is one line with the predicted class, followed by the
+ * probabilities of all classes when they are asked for. A line that is not
+ * a sample is answered with "error: " and the reason.
+ */
+class InferenceServer {
+public:
+  /**
+   * @brief Construct a new Inference Server object.
+   *
+   * @param inference trained network, evaluated by one batching thread.
+   * @param options where requests come from and how they are batched.
+   */
+  InferenceServer(Inference inference, const ServerOptions &options);
+
+  InferenceServer(const InferenceServer &) = delete;
+  InferenceServer &operator=(const InferenceServer &) = delete;
+
+  /**
+   * @brief Serve requests. From stdin this returns once stdin is closed and
+   * every request is answered, a socket is served until the process ends.
+   *
+   * @throws std::runtime_error when the socket can not be opened.
+   */
+  void run();
+
+private:
+  /** Where the answers of one client are written.*/
+  struct Connection {
+    explicit Connection(int fd, bool isOwner) : fd(fd), isOwner(isOwner) {}
+    ~Connection();
+    int fd;
+    /** Close the descriptor together with the connection.*/
+    bool isOwner;
+  };
+
+  struct Request {
+    std::shared_ptr<Connection> connection;
+    /** Input values, empty for a line that could not be parsed.*/
+    std::vector<double> inputs;
+    /** Why the line is not a sample.*/
+    std::string error;
+    std::chrono::steady_clock::time_point arrival;
+  };
+
+  /**
+   * @brief Read lines from a client until it closes its end and queue them
+   * as requests.
+   *
+   * @param fd descriptor requests are read from.
+   * @param connection where the answers go.
+   */
+  void readRequests(int fd, std::shared_ptr<Connection> connection);
+
+  /** Queue one line as a request.*/
+  void submit(const std::string &line,
+              const std::shared_ptr<Connection> &connection);
+
+  /** Take batches from the queue and answer them until the queue is
+   * closed and empty.*/
+  void evaluateBatches();
+
+  /** Evaluate one batch and write the answers.*/
+  void evaluate(std::vector<Request> &batch);
+
+  /** Accept clients on the socket forever.*/
+  void serveSocket();
+
+  /** Trained network.*/
+  Inference m_inference;
+  ServerOptions m_options;
+  /** Buffers of the batching thread.*/
+  InferenceBuffers m_buffers;
+  /** Samples of the current batch, one per row.*/
+  Matrix m_inputs;
+  /** Requests waiting for a batch, oldest first.*/
+  std::deque<Request> m_queue;
+  /** No more requests will be queued.*/
+  bool m_isClosed;
+  std::mutex m_mutex;
+  std::condition_variable m_wakeUp;
+  /** Number of answered requests.*/
+  std::size_t m_requests;
+  /** Number of evaluated batches.*/
+  std::size_t m_batches;
+};
+
+#endif // _INFERENCE_SERVER_H
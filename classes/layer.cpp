@@ -1,58 +1,70 @@
 #include "layer.h"
 
-Layer::Layer(int size, std::string activatedType) : m_size(size) {
+Layer::Layer(int size, std::string activatedType)
+    : m_size(size),
+      m_activationType(Activation::fromString(activatedType)) {
+  resize(1);
+}
 
-  try {
-    if (activatedType.empty()) {
-      for (std::size_t i = 0; i < m_size; ++i) {
-        std::shared_ptr<Neuron> n = std::make_shared<Neuron>(0.0);
-        m_neurons.push_back(n);
-      }
-    } else {
-      for (std::size_t i = 0; i < m_size; ++i) {
-        std::shared_ptr<Neuron> n =
-            std::make_shared<Neuron>(0.0, activatedType);
-        m_neurons.push_back(n);
-      }
-    }
-  } catch (std::exception &err) {
-    std::cerr << "Error creating neurons: " << err.what() << std::endl;
+void Layer::resize(int rows) {
+  if (!m_values) {
+    m_values = std::make_shared<Matrix>(rows, m_size, false);
+    m_activatedValues = std::make_shared<Matrix>(rows, m_size, false);
+    m_derivedValues = std::make_shared<Matrix>(rows, m_size, false);
+    activate();
+    return;
+  }
+  if (m_values->getNumberOfRows() == rows) {
+    return;
   }
+  // Buffers keep their capacity, so a short last batch does not allocate.
+  m_values->resize(rows, m_size);
+  m_activatedValues->resize(rows, m_size);
+  m_derivedValues->resize(rows, m_size);
 }
 
-void Layer::setValueOfNeuron(int i, double value) {
+void Layer::setValueOfNeuron(int i, Scalar value) {
   try {
-    m_neurons.at(i)->setValue(value);
-  } catch (const std::runtime_error &err) {
+    m_values->setValue(0, i, value);
+    // Only this neuron changed, the rest of the batch keeps its values.
+    Activation::apply(m_activationType, m_values->row(0).data() + i,
+                      m_activatedValues->row(0).data() + i,
+                      m_derivedValues->row(0).data() + i, 1);
+  } catch (const std::exception &err) {
     std::cerr << "Error setting neuron value: " << err.what() << std::endl;
   }
 }
 
-std::shared_ptr<Matrix> Layer::layerAsMatrix() {
-  auto inputLayerMatrix = std::make_shared<Matrix>(1, m_neurons.size(), false);
-  for (std::size_t i = 0; i < m_neurons.size(); ++i) {
-    inputLayerMatrix->setValue(0, i, m_neurons.at(i)->getValue());
+void Layer::setValues(std::shared_ptr<Matrix> values) {
+  if (values->getNumberOfColumns() != m_size) {
+    throw std::runtime_error("Number of values is not the LAYER SIZE.\n");
   }
-  return inputLayerMatrix;
+  const int rows = values->getNumberOfRows();
+  if (m_activatedValues->getNumberOfRows() != rows) {
+    m_activatedValues->resize(rows, m_size);
+    m_derivedValues->resize(rows, m_size);
+  }
+  m_values = values;
+  activate();
+}
+
+void Layer::activate() {
+  Activation::apply(m_activationType, m_values->data(),
+                    m_activatedValues->data(), m_derivedValues->data(),
+                    static_cast<std::size_t>(m_values->getNumberOfRows()) *
+                        m_values->getStride());
 }
 
+std::shared_ptr<Matrix> Layer::layerAsMatrix() { return m_values; }
+
 std::shared_ptr<Matrix> Layer::layerDerivedAsMatrix() {
-  auto inputLayerDerivedMatrix =
-      std::make_shared<Matrix>(1, m_neurons.size(), false);
-  for (std::size_t i = 0; i < m_neurons.size(); ++i) {
-    inputLayerDerivedMatrix->setValue(0, i, m_neurons.at(i)->getDerivedValue());
-  }
-  return inputLayerDerivedMatrix;
+  return m_derivedValues;
 }
 
 std::shared_ptr<Matrix> Layer::layerActivatedAsMatrix() {
-  auto inputLayerActivatedMatrix =
-      std::make_shared<Matrix>(1, m_neurons.size(), false);
-  for (std::size_t i = 0; i < m_neurons.size(); ++i) {
-    inputLayerActivatedMatrix->setValue(0, i,
-                                        m_neurons.at(i)->getActivatedValue());
-  }
-  return inputLayerActivatedMatrix;
+  return m_activatedValues;
 }
 
-std::vector<std::shared_ptr<Neuron>> Layer::getNeurons() { return m_neurons; }
\ No newline at end of file
+int Layer::getSize() const { return m_size; }
+
+ActivationType Layer::getActivationType() const { return m_activationType; }
\ No newline at end of file
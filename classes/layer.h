@@ -1,8 +1,8 @@
 #ifndef _LAYER_H
 #define _LAYER_H
 
+#include "activation.h"
 #include "matrix.h"
-#include "neuron.h"
 
 class Layer {
 public:
@@ -24,48 +24,87 @@ public:
   virtual ~Layer() = default;
 
   /**
-   * @brief Set the Value Of Neuron in a layer.
+   * @brief Set the Value Of Neuron in a layer, for the first sample in the
+   * batch.
    *
    * @param i position of neuron in a layer.
    * @param value of neuron
    */
-  void setValueOfNeuron(int i, double value);
+  void setValueOfNeuron(int i, Scalar value);
 
   /**
-   * @brief Convert layer into (1 x values).
-   * For easier multiplication.
+   * @brief Make the layer hold values for rows samples. Values are kept
+   * when the number of rows does not change.
    *
-   * @return std::unique_ptr<Matrix> Pointer to converted matrix.
+   * @param rows number of samples in the batch.
+   */
+  void resize(int rows);
+
+  /**
+   * @brief Take values at the neurons for the whole batch, one sample per
+   * row, and calculate activated and derived values. The matrix is used as
+   * it is, without copying.
+   *
+   * @param values (batch size x number of neurons) matrix.
+   */
+  void setValues(std::shared_ptr<Matrix> values);
+
+  /**
+   * @brief Calculate activated and derived values from the values at the
+   * neurons, after they were written through layerAsMatrix().
+   *
+   */
+  void activate();
+
+  /**
+   * @brief Values at the neurons (batch size x neurons). The returned
+   * matrix is the layer's own buffer, not a copy.
+   *
+   * @return std::shared_ptr<Matrix> Pointer to the values.
    */
   std::shared_ptr<Matrix> layerAsMatrix();
 
   /**
-   * @brief Convert layer into (1 x derived values)
+   * @brief Derived values at the neurons (batch size x neurons), not a
+   * copy.
    *
-   * @return std::shared_ptr<Matrix> Pointer to converted matrix.
+   * @return std::shared_ptr<Matrix> Pointer to the derived values.
    */
   std::shared_ptr<Matrix> layerDerivedAsMatrix();
 
   /**
-   * @brief Convert layer into (1 x activated values)
+   * @brief Activated values at the neurons (batch size x neurons), not a
+   * copy.
    *
-   * @return std::shared_ptr<Matrix> Pointer to converted matrix.
+   * @return std::shared_ptr<Matrix> Pointer to the activated values.
    */
   std::shared_ptr<Matrix> layerActivatedAsMatrix();
 
   /**
-   * @brief Get all the neurons in a layer.
+   * @brief Get the number of neurons in a layer.
+   *
+   * @return int number of neurons.
+   */
+  int getSize() const;
+
+  /**
+   * @brief Get the activation function of the layer.
    *
-   * @return std::vector<std::shared_ptr<Neuron>> Vector of the neuron in a
-   * Layer.
+   * @return ActivationType activation function.
    */
-  std::vector<std::shared_ptr<Neuron>> getNeurons();
+  ActivationType getActivationType() const;
 
 private:
   /** Number of neurons in a layer.*/
   int m_size;
-  //** Vector of all neurons in a layer. */
-  std::vector<std::shared_ptr<Neuron>> m_neurons;
+  /** Activation function of every neuron in a layer.*/
+  ActivationType m_activationType;
+  /** Values at the neurons, one sample per row.*/
+  std::shared_ptr<Matrix> m_values;
+  /** Activated values at the neurons, one sample per row.*/
+  std::shared_ptr<Matrix> m_activatedValues;
+  /** Derived values at the neurons, one sample per row.*/
+  std::shared_ptr<Matrix> m_derivedValues;
 };
 
 #endif // _LAYER_H
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "mappedFile.h"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &filePath, bool isCopyOnWrite)
+    : m_data(nullptr), m_isCopyOnWrite(isCopyOnWrite), m_size(0) {
+  const int descriptor = open(filePath.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    throw std::runtime_error("Can not open a file " + filePath);
+  }
+  struct stat status;
+  if (fstat(descriptor, &status) != 0) {
+    close(descriptor);
+    throw std::runtime_error("Can not read size of a file " + filePath);
+  }
+  m_size = static_cast<std::size_t>(status.st_size);
+  if (m_size > 0) {
+    const int protection = isCopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *mapping =
+        mmap(nullptr, m_size, protection, MAP_PRIVATE, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+      close(descriptor);
+      throw std::runtime_error("Can not map a file " + filePath);
+    }
+    m_data = static_cast<char *>(mapping);
+  }
+  // The mapping stays valid after the descriptor is closed.
+  close(descriptor);
+}
+
+void MappedFile::adviseSequential() const {
+  if (m_data != nullptr) {
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (m_data != nullptr) {
+    munmap(m_data, m_size);
+  }
+}
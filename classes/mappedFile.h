@@ -0,0 +1,71 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Memory mapping of a whole file. The file itself is never changed,
+ * pages written through a copy on write mapping become private copies. The
+ * mapping is released when the object is destroyed, so views into it must
+ * not outlive it.
+ */
+class MappedFile {
+public:
+  /**
+   * @brief Map a file into memory.
+   *
+   * @param filePath path to the file.
+   * @param isCopyOnWrite If 'true', the mapped values may be written,
+   * otherwise writing to them is an error.
+   * @throws std::runtime_error when the file can not be opened or mapped.
+   */
+  explicit MappedFile(const std::string &filePath, bool isCopyOnWrite = false);
+
+  /**
+   * @brief Destroy the Mapped File object and unmap the file.
+   *
+   */
+  virtual ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /**
+   * @brief Get the pointer to the first byte of the file.
+   *
+   * @return const char* first byte, nullptr for an empty file.
+   */
+  const char *data() const { return m_data; }
+
+  /**
+   * @brief Get the pointer to the first byte of a copy on write mapping.
+   *
+   * @return char* first byte, nullptr for an empty file.
+   */
+  char *writableData() const { return m_isCopyOnWrite ? m_data : nullptr; }
+
+  /**
+   * @brief Tell the kernel the file is read front to back once, so it reads
+   * ahead aggressively and drops pages behind.
+   *
+   */
+  void adviseSequential() const;
+
+  /**
+   * @brief Get the size of the file.
+   *
+   * @return std::size_t number of bytes.
+   */
+  std::size_t size() const { return m_size; }
+
+private:
+  /** First byte of the mapping.*/
+  char *m_data;
+  /** Whether the mapping may be written.*/
+  bool m_isCopyOnWrite;
+  /** Size of the file in bytes.*/
+  std::size_t m_size;
+};
+
+#endif // _MAPPED_FILE_H
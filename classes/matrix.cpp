@@ -1,32 +1,94 @@
 #include "matrix.h"
 
+#include "gemm.h"
+#include "threadPool.h"
+#include "weightInitializer.h"
+
+namespace {
+/** Element-wise work below this many values stays on the calling thread,
+ * so the 1x1 scalars and single rows are never split.*/
+constexpr int kMinParallelValues = 1 << 14;
+
+/**
+ * @brief Number of rows one thread should at least get.
+ *
+ * @param numberOfColumns values in every row.
+ * @return int rows per task.
+ */
+int rowGrain(int numberOfColumns) {
+  return std::max(1, kMinParallelValues / std::max(1, numberOfColumns));
+}
+} // namespace
+
 Matrix::Matrix(int numberOfRows, int numberOfColumns, bool isRandom)
-    : m_numberOfRows(numberOfRows), m_numberOfColumns(numberOfColumns) {
-  for (std::size_t row = 0; row < m_numberOfRows; row++) {
-    std::vector<double> temporary;
-    for (std::size_t column = 0; column < m_numberOfColumns; column++) {
-      if (isRandom) {
-        temporary.push_back(generateRandomNumber());
-      } else {
-        temporary.push_back(0.0);
-      }
-    }
-    m_matrixValues.push_back(temporary);
+    : m_numberOfRows(numberOfRows), m_numberOfColumns(numberOfColumns),
+      m_stride(numberOfColumns),
+      m_matrixValues(static_cast<std::size_t>(numberOfRows) * numberOfColumns,
+                     0.0),
+      m_data(m_matrixValues.data()) {
+  if (isRandom) {
+    // One seed per matrix, the values are drawn by all threads.
+    WeightInitializer::fillUniform(*this, 0, 1, std::random_device{}(), 0);
+  }
+}
+
+Matrix::Matrix(int numberOfRows, int numberOfColumns, Scalar *values,
+               std::shared_ptr<void> owner)
+    : m_numberOfRows(numberOfRows), m_numberOfColumns(numberOfColumns),
+      m_stride(numberOfColumns), m_data(values),
+      m_storageOwner(std::move(owner)) {}
+
+Matrix::Matrix(const Matrix &other)
+    : m_numberOfRows(other.m_numberOfRows),
+      m_numberOfColumns(other.m_numberOfColumns), m_stride(other.m_stride),
+      m_matrixValues(other.m_matrixValues),
+      m_data(other.m_storageOwner ? other.m_data : m_matrixValues.data()),
+      m_storageOwner(other.m_storageOwner) {}
+
+Matrix::Matrix(Matrix &&other) noexcept
+    : m_numberOfRows(other.m_numberOfRows),
+      m_numberOfColumns(other.m_numberOfColumns), m_stride(other.m_stride),
+      m_matrixValues(std::move(other.m_matrixValues)), m_data(other.m_data),
+      m_storageOwner(std::move(other.m_storageOwner)) {
+  other.m_numberOfRows = 0;
+  other.m_numberOfColumns = 0;
+  other.m_data = other.m_matrixValues.data();
+}
+
+Matrix &Matrix::operator=(const Matrix &other) {
+  if (this != &other) {
+    Matrix copy(other);
+    *this = std::move(copy);
   }
+  return *this;
 }
 
-double Matrix::generateRandomNumber() {
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_real_distribution<double> dis(0, 1);
+Matrix &Matrix::operator=(Matrix &&other) noexcept {
+  if (this != &other) {
+    m_numberOfRows = other.m_numberOfRows;
+    m_numberOfColumns = other.m_numberOfColumns;
+    m_stride = other.m_stride;
+    m_matrixValues = std::move(other.m_matrixValues);
+    m_data = other.m_data;
+    m_storageOwner = std::move(other.m_storageOwner);
+    other.m_numberOfRows = 0;
+    other.m_numberOfColumns = 0;
+    other.m_data = other.m_matrixValues.data();
+  }
+  return *this;
+}
 
-  return dis(gen);
+Scalar Matrix::generateRandomNumber() {
+  // Seeded once per thread, not once per number.
+  thread_local std::mt19937 generator(std::random_device{}());
+  std::uniform_real_distribution<Scalar> distribution(0, 1);
+  return distribution(generator);
 }
 
 void Matrix::printMatrixValues() {
-  for (std::size_t row = 0; row < m_numberOfRows; ++row) {
-    for (std::size_t col = 0; col < m_numberOfColumns; ++col) {
-      std::cout << m_matrixValues.at(row).at(col);
+  for (int row = 0; row < m_numberOfRows; ++row) {
+    for (int col = 0; col < m_numberOfColumns; ++col) {
+      std::cout << (*this)(row, col);
       if (col < m_numberOfColumns - 1) {
         std::cout << ",";
       }
@@ -35,38 +97,159 @@ void Matrix::printMatrixValues() {
   }
 }
 
-double Matrix::getValue(int row, int column) const {
-  if (!m_matrixValues.empty()) {
-    return m_matrixValues.at(row).at(column);
-  } else {
+Scalar Matrix::getValue(int row, int column) const {
+  if (m_numberOfRows == 0 || m_numberOfColumns == 0) {
     throw std::runtime_error("Matrix is empty.\n");
   }
+  if (row < 0 || row >= m_numberOfRows || column < 0 ||
+      column >= m_numberOfColumns) {
+    throw std::out_of_range("Matrix position out of range.\n");
+  }
+  return (*this)(row, column);
 }
 
 int Matrix::getNumberOfColumns() const { return m_numberOfColumns; }
 
 int Matrix::getNumberOfRows() const { return m_numberOfRows; }
 
-void Matrix::setValue(int row, int column, double value) {
-  if (!m_matrixValues.empty()) {
-    m_matrixValues.at(row).at(column) = value;
-  } else {
+void Matrix::setValue(int row, int column, Scalar value) {
+  if (m_numberOfRows == 0 || m_numberOfColumns == 0) {
     throw std::runtime_error("Matrix is empty.\n");
   }
+  if (row < 0 || row >= m_numberOfRows || column < 0 ||
+      column >= m_numberOfColumns) {
+    throw std::out_of_range("Matrix position out of range.\n");
+  }
+  (*this)(row, column) = value;
+}
+
+StridedView<Scalar> Matrix::row(int row) {
+  return StridedView<Scalar>(data() + static_cast<std::size_t>(row) * m_stride,
+                             m_numberOfColumns, 1);
+}
+
+StridedView<const Scalar> Matrix::row(int row) const {
+  return StridedView<const Scalar>(
+      data() + static_cast<std::size_t>(row) * m_stride, m_numberOfColumns, 1);
+}
+
+StridedView<Scalar> Matrix::column(int column) {
+  return StridedView<Scalar>(data() + column, m_numberOfRows, m_stride);
+}
+
+StridedView<const Scalar> Matrix::column(int column) const {
+  return StridedView<const Scalar>(data() + column, m_numberOfRows, m_stride);
 }
 
 std::shared_ptr<Matrix> Matrix::transpose() {
   std::shared_ptr<Matrix> transposeMatrix =
       std::make_shared<Matrix>(m_numberOfColumns, m_numberOfRows, false);
-  for (std::size_t r = 0; r < m_numberOfRows; ++r) {
-    for (std::size_t c = 0; c < m_numberOfColumns; ++c) {
-      transposeMatrix->setValue(c, r, getValue(r, c));
-    }
-  }
+  transpose(*transposeMatrix);
   return transposeMatrix;
 }
 
-std::vector<std::vector<double>> Matrix::getMatrix() { return m_matrixValues; }
+void Matrix::transpose(Matrix &result) const {
+  if (result.m_numberOfRows != m_numberOfColumns ||
+      result.m_numberOfColumns != m_numberOfRows) {
+    throw std::runtime_error("Transpose has a wrong shape.\n");
+  }
+  // Go over the matrix in square tiles, so both the reads and the writes
+  // stay inside a few cache lines. Threads split the bands of tile rows.
+  constexpr int tile = 32;
+  const Scalar *source = data();
+  Scalar *destination = result.data();
+  const int destinationStride = result.getStride();
+  const int numberOfBands = (m_numberOfRows + tile - 1) / tile;
+  ThreadPool::getInstance().parallelFor(
+      0, numberOfBands,
+      std::max(1, rowGrain(m_numberOfColumns) / tile),
+      [&](int bandBegin, int bandEnd) {
+        for (int rowTile = bandBegin * tile;
+             rowTile < std::min(bandEnd * tile, m_numberOfRows);
+             rowTile += tile) {
+          const int rowEnd = std::min(rowTile + tile, m_numberOfRows);
+          for (int colTile = 0; colTile < m_numberOfColumns; colTile += tile) {
+            const int colEnd = std::min(colTile + tile, m_numberOfColumns);
+            for (int r = rowTile; r < rowEnd; ++r) {
+              const Scalar *sourceRow =
+                  source + static_cast<std::size_t>(r) * m_stride;
+              for (int c = colTile; c < colEnd; ++c) {
+                destination[static_cast<std::size_t>(c) * destinationStride +
+                            r] = sourceRow[c];
+              }
+            }
+          }
+        }
+      });
+}
+
+void Matrix::multiply(const Matrix &a, const Matrix &b, Matrix &result) {
+  if (a.m_numberOfColumns != b.m_numberOfRows ||
+      result.m_numberOfRows != a.m_numberOfRows ||
+      result.m_numberOfColumns != b.m_numberOfColumns) {
+    throw std::runtime_error("Matrix multiplication not possible.\n");
+  }
+  Gemm::multiply(a.m_numberOfRows, b.m_numberOfColumns, a.m_numberOfColumns,
+                 1.0, {a.data(), a.m_stride, 1}, {b.data(), b.m_stride, 1},
+                 0.0, result.data(), result.m_stride);
+}
+
+void Matrix::multiplyTransposedLeft(const Matrix &a, const Matrix &b,
+                                    Matrix &result) {
+  if (a.m_numberOfRows != b.m_numberOfRows ||
+      result.m_numberOfRows != a.m_numberOfColumns ||
+      result.m_numberOfColumns != b.m_numberOfColumns) {
+    throw std::runtime_error("Matrix multiplication not possible.\n");
+  }
+  // The transpose is the same buffer with the strides swapped.
+  Gemm::multiply(a.m_numberOfColumns, b.m_numberOfColumns, a.m_numberOfRows,
+                 1.0, {a.data(), 1, a.m_stride}, {b.data(), b.m_stride, 1},
+                 0.0, result.data(), result.m_stride);
+}
+
+void Matrix::multiplyTransposedRight(const Matrix &a, const Matrix &b,
+                                     Matrix &result) {
+  if (a.m_numberOfColumns != b.m_numberOfColumns ||
+      result.m_numberOfRows != a.m_numberOfRows ||
+      result.m_numberOfColumns != b.m_numberOfRows) {
+    throw std::runtime_error("Matrix multiplication not possible.\n");
+  }
+  Gemm::multiply(a.m_numberOfRows, b.m_numberOfRows, a.m_numberOfColumns,
+                 1.0, {a.data(), a.m_stride, 1}, {b.data(), 1, b.m_stride},
+                 0.0, result.data(), result.m_stride);
+}
+
+void Matrix::addOuterProducts(Scalar alpha, const Matrix &a, const Matrix &b,
+                              Matrix &result) {
+  if (a.m_numberOfRows != b.m_numberOfRows ||
+      result.m_numberOfRows != a.m_numberOfColumns ||
+      result.m_numberOfColumns != b.m_numberOfColumns) {
+    throw std::runtime_error("Matrix multiplication not possible.\n");
+  }
+  Gemm::multiply(a.m_numberOfColumns, b.m_numberOfColumns, a.m_numberOfRows,
+                 alpha, {a.data(), 1, a.m_stride}, {b.data(), b.m_stride, 1},
+                 1.0, result.data(), result.m_stride);
+}
+
+void Matrix::resize(int numberOfRows, int numberOfColumns) {
+  m_numberOfRows = numberOfRows;
+  m_numberOfColumns = numberOfColumns;
+  m_stride = numberOfColumns;
+  m_storageOwner.reset();
+  m_matrixValues.resize(static_cast<std::size_t>(numberOfRows) *
+                        numberOfColumns);
+  m_data = m_matrixValues.data();
+}
+
+std::vector<std::vector<Scalar>> Matrix::getMatrix() {
+  std::vector<std::vector<Scalar>> values;
+  values.reserve(m_numberOfRows);
+  for (int r = 0; r < m_numberOfRows; ++r) {
+    const Scalar *rowBegin = data() + static_cast<std::size_t>(r) * m_stride;
+    values.emplace_back(rowBegin, rowBegin + m_numberOfColumns);
+  }
+  return values;
+}
 
 std::shared_ptr<Matrix>
 Matrix::operator*(const std::shared_ptr<Matrix> &other) const {
@@ -74,21 +257,35 @@ Matrix::operator*(const std::shared_ptr<Matrix> &other) const {
   if (m_numberOfColumns == 1 && m_numberOfRows == 1) {
     std::shared_ptr<Matrix> c = std::make_shared<Matrix>(
         other->m_numberOfRows, other->m_numberOfColumns, false);
-    for (std::size_t row = 0; row < other->m_numberOfRows; ++row) {
-      for (std::size_t col = 0; col < other->m_numberOfColumns; ++col) {
-        c->setValue(row, col, getValue(0, 0) * other->getValue(row, col));
-      }
-    }
+    const Scalar scalar = (*this)(0, 0);
+    ThreadPool::getInstance().parallelFor(
+        0, other->m_numberOfRows, rowGrain(other->m_numberOfColumns),
+        [&](int rowBegin, int rowEnd) {
+          for (int row = rowBegin; row < rowEnd; ++row) {
+            const Scalar *in = other->row(row).data();
+            Scalar *out = c->row(row).data();
+            for (int col = 0; col < other->m_numberOfColumns; ++col) {
+              out[col] = scalar * in[col];
+            }
+          }
+        });
     return c;
   }
   if (other->m_numberOfColumns == 1 && other->m_numberOfRows == 1) {
     std::shared_ptr<Matrix> c =
         std::make_shared<Matrix>(m_numberOfRows, m_numberOfColumns, false);
-    for (std::size_t row = 0; row < m_numberOfRows; ++row) {
-      for (std::size_t col = 0; col < m_numberOfColumns; ++col) {
-        c->setValue(row, col, getValue(row, col) * other->getValue(0, 0));
-      }
-    }
+    const Scalar scalar = (*other)(0, 0);
+    ThreadPool::getInstance().parallelFor(
+        0, m_numberOfRows, rowGrain(m_numberOfColumns),
+        [&](int rowBegin, int rowEnd) {
+          for (int row = rowBegin; row < rowEnd; ++row) {
+            const Scalar *in = this->row(row).data();
+            Scalar *out = c->row(row).data();
+            for (int col = 0; col < m_numberOfColumns; ++col) {
+              out[col] = in[col] * scalar;
+            }
+          }
+        });
     return c;
   }
   if (m_numberOfColumns != other->m_numberOfRows) {
@@ -100,14 +297,10 @@ Matrix::operator*(const std::shared_ptr<Matrix> &other) const {
   std::shared_ptr<Matrix> c =
       std::make_shared<Matrix>(m_numberOfRows, other->m_numberOfColumns, false);
 
-  for (std::size_t i = 0; i < m_numberOfRows; ++i) {
-    for (std::size_t j = 0; j < other->m_numberOfColumns; ++j) {
-      for (std::size_t k = 0; k < other->m_numberOfRows; ++k) {
-        c->setValue(
-            i, j, c->getValue(i, j) + (getValue(i, k) * other->getValue(k, j)));
-      }
-    }
-  }
+  Gemm::multiply(m_numberOfRows, other->m_numberOfColumns, m_numberOfColumns,
+                 1.0, {data(), m_stride, 1},
+                 {other->data(), other->m_stride, 1}, 0.0, c->data(),
+                 c->m_stride);
   return c;
 }
 
@@ -119,7 +312,7 @@ std::shared_ptr<Matrix> operator*(const std::shared_ptr<Matrix> &lhs,
 
 std::shared_ptr<Matrix>
 Matrix::operator-(const std::shared_ptr<Matrix> &other) const {
-  if (m_numberOfRows != other->m_numberOfRows &&
+  if (m_numberOfRows != other->m_numberOfRows ||
       m_numberOfColumns != other->m_numberOfColumns) {
     std::cerr << "Matrix subtraction not possible.\n";
     return std::make_shared<Matrix>(0, 0, false);
@@ -128,12 +321,18 @@ Matrix::operator-(const std::shared_ptr<Matrix> &other) const {
   std::shared_ptr<Matrix> c =
       std::make_shared<Matrix>(m_numberOfRows, m_numberOfColumns, false);
 
-  for (std::size_t row = 0; row < m_numberOfRows; ++row) {
-    for (std::size_t column = 0; column < m_numberOfColumns; ++column) {
-      c->setValue(row, column,
-                  (getValue(row, column) - other->getValue(row, column)));
-    }
-  }
+  ThreadPool::getInstance().parallelFor(
+      0, m_numberOfRows, rowGrain(m_numberOfColumns),
+      [&](int rowBegin, int rowEnd) {
+        for (int row = rowBegin; row < rowEnd; ++row) {
+          const Scalar *left = this->row(row).data();
+          const Scalar *right = other->row(row).data();
+          Scalar *out = c->row(row).data();
+          for (int column = 0; column < m_numberOfColumns; ++column) {
+            out[column] = left[column] - right[column];
+          }
+        }
+      });
   return c;
 }
 
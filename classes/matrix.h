@@ -1,12 +1,78 @@
 #ifndef _MATRIX_H
 #define _MATRIX_H
 
+#include <algorithm>
+#include <cassert>
 #include <exception>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <stdexcept>
 #include <vector>
 
+#include "alignedAllocator.h"
 #include "nlohmann/json.hpp"
+#include "scalar.h"
+
+/**
+ * @brief Non-owning view over values of a matrix that are a fixed distance
+ * (stride) apart. A row of a matrix has stride 1, a column has the stride
+ * of the matrix.
+ *
+ * @tparam T Scalar or const Scalar.
+ */
+template <typename T> class StridedView {
+public:
+  /**
+   * @brief Construct a new Strided View object.
+   *
+   * @param data pointer to the first value.
+   * @param size number of values in the view.
+   * @param stride distance between two neighbouring values.
+   */
+  StridedView(T *data, int size, int stride)
+      : m_data(data), m_size(size), m_stride(stride) {}
+
+  /**
+   * @brief Unchecked access to i-th value in the view.
+   *
+   * @param i position in the view.
+   * @return T& reference to the value.
+   */
+  T &operator[](int i) const {
+    assert(i >= 0 && i < m_size);
+    return m_data[static_cast<std::size_t>(i) * m_stride];
+  }
+
+  /**
+   * @brief Get the pointer to the first value.
+   *
+   * @return T* pointer to the first value.
+   */
+  T *data() const { return m_data; }
+
+  /**
+   * @brief Get the number of values in the view.
+   *
+   * @return int size of the view.
+   */
+  int size() const { return m_size; }
+
+  /**
+   * @brief Get the distance between two neighbouring values.
+   *
+   * @return int stride of the view.
+   */
+  int stride() const { return m_stride; }
+
+private:
+  /** First value of the view.*/
+  T *m_data;
+  /** Number of values in the view.*/
+  int m_size;
+  /** Distance between two neighbouring values.*/
+  int m_stride;
+};
 
 class Matrix {
 public:
@@ -15,11 +81,45 @@ public:
    *
    * @param numberOfRows
    * @param numberOfColumns
-   * @param isRandom If 'true', the matrix is populated with random numbers,
-   * otherwise, it retains the same default values.
+   * @param isRandom If 'true', the matrix is populated with random numbers
+   * between 0 and 1 from a new seed, otherwise, it retains the same default
+   * values. Weights are drawn by WeightInitializer instead.
    */
   Matrix(int numberOfRows, int numberOfColumns, bool isRandom);
 
+  /**
+   * @brief Construct a Matrix over values that live somewhere else, for
+   * example in a memory mapped file. Nothing is copied, the owner is kept
+   * alive as long as the matrix (or a copy of it) uses the values.
+   *
+   * @param numberOfRows
+   * @param numberOfColumns
+   * @param values first value, rows are stored one after another.
+   * @param owner keeps the values alive.
+   */
+  Matrix(int numberOfRows, int numberOfColumns, Scalar *values,
+         std::shared_ptr<void> owner);
+
+  /**
+   * @brief Copy values of another type into a new matrix, for example a
+   * file written by a build with the other Scalar type.
+   *
+   * @tparam Source type of the stored values.
+   * @param values first value, rows are stored one after another.
+   * @param numberOfRows
+   * @param numberOfColumns
+   * @return std::shared_ptr<Matrix> new matrix that owns its values.
+   */
+  template <typename Source>
+  static std::shared_ptr<Matrix> convert(const Source *values,
+                                         int numberOfRows,
+                                         int numberOfColumns);
+
+  Matrix(const Matrix &other);
+  Matrix(Matrix &&other) noexcept;
+  Matrix &operator=(const Matrix &other);
+  Matrix &operator=(Matrix &&other) noexcept;
+
   /**
    * @brief Destroy the Matrix object.
    *
@@ -33,30 +133,175 @@ public:
    */
   std::shared_ptr<Matrix> transpose();
 
+  /**
+   * @brief Write transpose of the matrix into an existing matrix.
+   *
+   * @param result (columns x rows) matrix that receives the transpose.
+   */
+  void transpose(Matrix &result) const;
+
+  /**
+   * @brief Multiply two matrices into an existing matrix, nothing is
+   * allocated.
+   *
+   * @param a left matrix (m x k).
+   * @param b right matrix (k x n).
+   * @param result (m x n) matrix that receives a * b.
+   */
+  static void multiply(const Matrix &a, const Matrix &b, Matrix &result);
+
+  /**
+   * @brief Multiply the transpose of a with b, a is read in its stored
+   * layout and never transposed.
+   *
+   * @param a left matrix (k x m), used as (m x k).
+   * @param b right matrix (k x n).
+   * @param result (m x n) matrix that receives a^T * b.
+   */
+  static void multiplyTransposedLeft(const Matrix &a, const Matrix &b,
+                                     Matrix &result);
+
+  /**
+   * @brief Multiply a with the transpose of b, b is read in its stored
+   * layout and never transposed.
+   *
+   * @param a left matrix (m x k).
+   * @param b right matrix (n x k), used as (k x n).
+   * @param result (m x n) matrix that receives a * b^T.
+   */
+  static void multiplyTransposedRight(const Matrix &a, const Matrix &b,
+                                      Matrix &result);
+
+  /**
+   * @brief Rank-k update result += alpha * a^T * b, the sum of the outer
+   * products of the k rows of a and b. With one row it is a single outer
+   * product.
+   *
+   * @param alpha scale of the update.
+   * @param a (k x m) matrix.
+   * @param b (k x n) matrix.
+   * @param result (m x n) matrix that is updated in place.
+   */
+  static void addOuterProducts(Scalar alpha, const Matrix &a, const Matrix &b,
+                               Matrix &result);
+
+  /**
+   * @brief Change the shape of the matrix. The buffer is reused when it is
+   * big enough, so shrinking and growing back does not allocate. Values are
+   * not preserved. A matrix over external values gets its own buffer.
+   *
+   * @param numberOfRows
+   * @param numberOfColumns
+   */
+  void resize(int numberOfRows, int numberOfColumns);
+
   /**
    * @brief Set the Value at specific position((row, column)) in matrix.
+   * Position is checked, for hot loops use operator().
    *
    * @param row
    * @param column
    * @param value
    */
-  void setValue(int row, int column, double value);
+  void setValue(int row, int column, Scalar value);
 
   /**
    * @brief Get the the specific value at position (row,column).
+   * Position is checked, for hot loops use operator().
+   *
+   * @param row
+   * @param column
+   * @return Scalar
+   */
+  Scalar getValue(int row, int column) const;
+
+  /**
+   * @brief Unchecked access to the value at position (row, column).
+   * Position is only asserted in debug builds.
    *
    * @param row
    * @param column
-   * @return double
+   * @return Scalar& reference to the value.
+   */
+  Scalar &operator()(int row, int column) {
+    assert(row >= 0 && row < m_numberOfRows && column >= 0 &&
+           column < m_numberOfColumns);
+    return m_data[static_cast<std::size_t>(row) * m_stride + column];
+  }
+
+  /**
+   * @brief Unchecked read of the value at position (row, column).
+   *
+   * @param row
+   * @param column
+   * @return Scalar value at the position.
+   */
+  Scalar operator()(int row, int column) const {
+    assert(row >= 0 && row < m_numberOfRows && column >= 0 &&
+           column < m_numberOfColumns);
+    return m_data[static_cast<std::size_t>(row) * m_stride + column];
+  }
+
+  /**
+   * @brief Get the pointer to the first value, values are stored row by row
+   * and rows are getStride() values apart.
+   *
+   * @return Scalar* pointer to the contiguous buffer.
+   */
+  Scalar *data() { return m_data; }
+
+  /**
+   * @brief Get the pointer to the first value.
+   *
+   * @return const Scalar* pointer to the contiguous buffer.
+   */
+  const Scalar *data() const { return m_data; }
+
+  /**
+   * @brief Get the distance between the starts of two neighbouring rows.
+   *
+   * @return int stride of the rows.
+   */
+  int getStride() const { return m_stride; }
+
+  /**
+   * @brief Get a view over one row of the matrix.
+   *
+   * @param row index of a row.
+   * @return StridedView<Scalar> view with stride 1.
    */
-  double getValue(int row, int column) const;
+  StridedView<Scalar> row(int row);
+
+  /**
+   * @brief Get a read only view over one row of the matrix.
+   *
+   * @param row index of a row.
+   * @return StridedView<const Scalar> view with stride 1.
+   */
+  StridedView<const Scalar> row(int row) const;
+
+  /**
+   * @brief Get a view over one column of the matrix.
+   *
+   * @param column index of a column.
+   * @return StridedView<Scalar> view with the stride of the matrix.
+   */
+  StridedView<Scalar> column(int column);
+
+  /**
+   * @brief Get a read only view over one column of the matrix.
+   *
+   * @param column index of a column.
+   * @return StridedView<const Scalar> view with the stride of the matrix.
+   */
+  StridedView<const Scalar> column(int column) const;
 
   /**
    * @brief Generate random number between 0 and 1.
    *
-   * @return double returns random number.
+   * @return Scalar returns random number.
    */
-  double generateRandomNumber();
+  Scalar generateRandomNumber();
 
   /**
    * @brief Prints all values in the metric.
@@ -81,17 +326,24 @@ public:
   /**
    * @brief Get the Matrix as row * columns.
    *
-   * @return std::vector<std::vector<double>>  All values in matrix.
+   * @return std::vector<std::vector<Scalar>>  All values in matrix.
    */
-  std::vector<std::vector<double>> getMatrix();
+  std::vector<std::vector<Scalar>> getMatrix();
 
 private:
   /** Number of rows in a matrix*/
   int m_numberOfRows;
   /** Number of columns in matrix. */
   int m_numberOfColumns;
-  /** All matrix values rows times columns.*/
-  std::vector<std::vector<double>> m_matrixValues;
+  /** Distance between the starts of two neighbouring rows. */
+  int m_stride;
+  /** All matrix values rows times columns, stored row after row in one
+   * aligned buffer. Empty when the values are external.*/
+  std::vector<Scalar, AlignedAllocator<Scalar>> m_matrixValues;
+  /** First value, either in m_matrixValues or in external storage.*/
+  Scalar *m_data;
+  /** Keeps external values alive, empty for own values.*/
+  std::shared_ptr<void> m_storageOwner;
 
 public:
   /**
@@ -138,4 +390,17 @@ public:
                                            const std::shared_ptr<Matrix> &rhs);
 };
 
+template <typename Source>
+std::shared_ptr<Matrix> Matrix::convert(const Source *values,
+                                        int numberOfRows,
+                                        int numberOfColumns) {
+  auto matrix = std::make_shared<Matrix>(numberOfRows, numberOfColumns, false);
+  for (int row = 0; row < numberOfRows; ++row) {
+    const Source *source =
+        values + static_cast<std::size_t>(row) * numberOfColumns;
+    std::copy(source, source + numberOfColumns, matrix->row(row).data());
+  }
+  return matrix;
+}
+
 #endif // _MATRIX_H
\ No newline at end of file
@@ -1,13 +1,26 @@
 #include "neuralNetwork.h"
 
 NeuralNetwork::NeuralNetwork(Params &params)
-    : m_error(0.0), m_bias(params.bias),
-      m_momentum(std::make_shared<Matrix>(1, 1, false)),
-      m_learningRate(std::make_shared<Matrix>(1, 1, false)) {
-
+    : m_error(0.0), m_bias(params.bias), m_epochErrorSum(0.0),
+      m_epochBatches(0), m_checkpointPath(params.checkpointPath),
+      m_checkpointEverySamples(params.checkpointEverySamples),
+      m_checkpointEveryEpochs(params.checkpointEveryEpochs),
+      m_calibrationSamples(0),
+      m_trainingMode(ParallelTrainer::modeFromString(params.trainingMode)),
+      m_metricsFile(params.metricsFile),
+      m_metricsFormat(params.metricsFormat),
+      m_sparseInputThreshold(params.sparseInputThreshold),
+      m_halfType(HalfMatrix::typeFromString(params.halfWeights)),
+      m_weightUpdateSeconds(0.0) {
+
+  ThreadPool::getInstance().setNumberOfThreads(params.numberOfThreads);
   m_topologySize = params.numOfNeuronsActivationFunction.size();
-  m_momentum->setValue(0, 0, params.momentum);
-  m_learningRate->setValue(0, 0, params.learningRate);
+  m_batchSize = std::max(1, params.batchSize);
+  m_loaderOptions.batchSize = m_batchSize;
+  m_loaderOptions.prefetchDepth = std::max(1, params.prefetchDepth);
+  m_loaderOptions.shuffle = params.shuffle;
+  m_loaderOptions.seed = params.seed;
+  m_loaderOptions.inputScale = params.inputScale;
 
   for (auto const &numOfLayer : params.numOfNeuronsActivationFunction) {
     m_layers.push_back(std::make_shared<Layer>(
@@ -15,44 +28,187 @@ NeuralNetwork::NeuralNetwork(Params &params)
     m_topology.push_back(numOfLayer.numberOfNeuronsInLayer);
   }
 
+  // Every matrix is drawn from its own stream of the seed, with the scheme
+  // of the layer it feeds.
+  const InitializationType initialization =
+      WeightInitializer::typeFromString(params.weightInitialization);
   for (std::size_t numberOfMatrices = 0;
        numberOfMatrices < (m_topologySize - 1); numberOfMatrices++) {
-    m_weightMatrices.push_back(
+    auto weights =
         std::make_shared<Matrix>(m_topology.at(numberOfMatrices),
-                                 m_topology.at(numberOfMatrices + 1), true));
+                                 m_topology.at(numberOfMatrices + 1), false);
+    WeightInitializer::initialize(
+        *weights,
+        WeightInitializer::resolve(
+            initialization,
+            m_layers.at(numberOfMatrices + 1)->getActivationType()),
+        params.seed, static_cast<std::uint32_t>(numberOfMatrices));
+    m_weightMatrices.push_back(weights);
+  }
+  allocateWorkspace(m_batchSize);
+  resizeBatch(m_batchSize);
+
+  OptimizerOptions optimizerOptions;
+  optimizerOptions.type = Optimizer::typeFromString(params.optimizer);
+  optimizerOptions.learningRate = params.learningRate;
+  optimizerOptions.momentum = params.momentum;
+  if (optimizerOptions.type != OptimizerType::Adam) {
+    if (params.momentum == 1.0) {
+      // Configs from before the optimizers used 1 for plain gradient
+      // descent, with a velocity it would keep every step forever.
+      std::cerr << "momentum 1 is taken as 0, plain gradient descent."
+                << std::endl;
+      optimizerOptions.momentum = 0.0;
+    } else if (params.momentum < 0.0 || params.momentum > 1.0) {
+      throw std::runtime_error("momentum must be at least 0 and below 1.");
+    }
+  }
+  optimizerOptions.beta1 = params.beta1;
+  optimizerOptions.beta2 = params.beta2;
+  optimizerOptions.epsilon = params.epsilon;
+  m_optimizer =
+      std::make_shared<Optimizer>(optimizerOptions, m_weightMatrices);
+
+  m_trainingData = Dataset::open(params.trainingDataPath);
+  m_labelsData = Dataset::open(params.labelDataPath);
+  if (!params.resumeFrom.empty()) {
+    resumeFrom(params.resumeFrom);
   }
-
-  m_trainingData = Utils::getDataFromFile(params.trainingDataPath);
-  m_labelsData = Utils::getDataFromFile(params.labelDataPath);
 }
 
 // Constructor for predicting.
 NeuralNetwork::NeuralNetwork(Predict &predict)
-    : m_error(0.0), m_bias(predict.bias),
-      m_momentum(std::make_shared<Matrix>(1, 1, false)),
-      m_learningRate(std::make_shared<Matrix>(1, 1, false)) {
-
+    : m_error(0.0), m_bias(predict.bias), m_epochErrorSum(0.0),
+      m_epochBatches(0), m_checkpointEverySamples(0),
+      m_checkpointEveryEpochs(0),
+      m_calibrationDataPath(predict.calibrationDataPath),
+      m_calibrationSamples(predict.calibrationSamples),
+      m_trainingMode(TrainingMode::Serial),
+      m_sparseInputThreshold(predict.sparseInputThreshold),
+      m_halfType(HalfMatrix::typeFromString(predict.halfWeights)),
+      m_weightUpdateSeconds(0.0) {
+
+  ThreadPool::getInstance().setNumberOfThreads(predict.numberOfThreads);
   m_topologySize = predict.numOfNeuronsActivationFunction.size();
+  m_batchSize = std::max(1, predict.batchSize);
+  m_serverOptions.socketPath = predict.socketPath;
+  m_serverOptions.maxBatchSize = predict.maxBatchSize;
+  m_serverOptions.maxLatencyMs = predict.maxLatencyMs;
+  m_serverOptions.isProbabilities = predict.probabilities;
+  m_loaderOptions.inputScale = predict.inputScale;
 
   for (auto const &numOfLayer : predict.numOfNeuronsActivationFunction) {
     m_layers.push_back(std::make_shared<Layer>(
         numOfLayer.numberOfNeuronsInLayer, numOfLayer.activationFunction));
     m_topology.push_back(numOfLayer.numberOfNeuronsInLayer);
   }
-
-  m_weightMatrices = Utils::loadWeights(predict.loadWeightsPath);
-  m_labelsPredictionData = Utils::getDataFromFile(predict.testLabelDataPath);
-  m_predictionData = Utils::getDataFromFile(predict.testDataPath);
+  resizeBatch(m_batchSize);
+
+  if (Checkpoint::isCheckpoint(predict.loadWeightsPath)) {
+    // Weights are used straight from the mapped file.
+    CheckpointData checkpoint = Checkpoint::load(predict.loadWeightsPath);
+    checkTopology(checkpoint);
+    m_weightMatrices = checkpoint.weights;
+  } else {
+    m_weightMatrices = Utils::loadWeights(predict.loadWeightsPath);
+  }
+  if (predict.serve) {
+    // Samples come from the clients, there is no test data.
+    return;
+  }
+  m_labelsPredictionData = Dataset::open(predict.testLabelDataPath);
+  m_predictionData = Dataset::open(predict.testDataPath);
   std::cout << "in constructor,"
-            << "predict size: " << m_predictionData.size() << std::endl;
+            << "predict size: " << m_predictionData->getNumberOfRows()
+            << std::endl;
+  if (m_predictionData->getNumberOfRows() !=
+      m_labelsPredictionData->getNumberOfRows()) {
+    throw std::runtime_error(
+        "Test data and labels have a different number of rows.");
+  }
+}
+
+void NeuralNetwork::resizeBatch(int rows) {
+  for (auto &layer : m_layers) {
+    layer->resize(rows);
+  }
+  if (!m_target) {
+    m_target = std::make_shared<Matrix>(rows, m_topology.back(), false);
+    m_errors = std::make_shared<Matrix>(rows, m_topology.back(), false);
+    m_derivedErrors = std::make_shared<Matrix>(rows, m_topology.back(), false);
+  } else if (m_target->getNumberOfRows() != rows) {
+    m_target->resize(rows, m_topology.back());
+  }
+  m_errors->resize(rows, m_topology.back());
+  m_derivedErrors->resize(rows, m_topology.back());
+  if (!m_workspace.gradients.empty()) {
+    for (std::size_t i = 0; i < m_layers.size(); ++i) {
+      m_workspace.gradients.at(i)->resize(rows, m_topology.at(i));
+    }
+  }
+}
+
+void NeuralNetwork::allocateWorkspace(int rows) {
+  m_workspace = TrainingWorkspace();
+  for (std::size_t i = 0; i < m_layers.size(); ++i) {
+    m_workspace.gradients.push_back(
+        std::make_shared<Matrix>(rows, m_topology.at(i), false));
+  }
+  for (std::size_t i = 0; i + 1 < m_layers.size(); ++i) {
+    m_workspace.deltaWeights.push_back(std::make_shared<Matrix>(
+        m_topology.at(i), m_topology.at(i + 1), false));
+  }
 }
 
 void NeuralNetwork::setValuesToNeuronsInputLayer(
     std::vector<double> valuesAtNeurons) {
-  m_inputLayer = valuesAtNeurons;
-  for (std::size_t i = 0; i < valuesAtNeurons.size(); i++) {
-    m_layers.at(0)->setValueOfNeuron(i, valuesAtNeurons.at(i));
+  if (valuesAtNeurons.size() != m_topology.at(0)) {
+    throw std::runtime_error(
+        "Input size is not the same as the INPUT LAYER SIZE.");
+  }
+  resizeBatch(1);
+  std::copy(valuesAtNeurons.begin(), valuesAtNeurons.end(),
+            getNeuronMatrix(0)->data());
+  m_layers.at(0)->activate();
+}
+
+void NeuralNetwork::setBatch(const Dataset &data, const Dataset &labels,
+                             std::size_t first, std::size_t count) {
+  if (data.getNumberOfColumns() != m_topology.front()) {
+    throw std::runtime_error(
+        "Input size is not the same as the INPUT LAYER SIZE.");
+  }
+  if (labels.getNumberOfColumns() != m_topology.back()) {
+    throw std::runtime_error(
+        "Target size is not the same as the output LAYER SIZE.");
+  }
+  resizeBatch(count);
+  data.readRows(first, count, *getNeuronMatrix(0));
+  labels.readRows(first, count, *m_target);
+  m_layers.at(0)->activate();
+}
+
+void NeuralNetwork::setBatch(const Batch &batch) {
+  if (batch.inputs.getNumberOfColumns() != m_topology.front()) {
+    throw std::runtime_error(
+        "Input size is not the same as the INPUT LAYER SIZE.");
+  }
+  if (batch.targets.getNumberOfColumns() != m_topology.back()) {
+    throw std::runtime_error(
+        "Target size is not the same as the output LAYER SIZE.");
   }
+  const int rows = batch.inputs.getNumberOfRows();
+  resizeBatch(rows);
+  auto input = getNeuronMatrix(0);
+  for (int row = 0; row < rows; ++row) {
+    std::copy(batch.inputs.row(row).data(),
+              batch.inputs.row(row).data() + m_topology.front(),
+              input->row(row).data());
+    std::copy(batch.targets.row(row).data(),
+              batch.targets.row(row).data() + m_topology.back(),
+              m_target->row(row).data());
+  }
+  m_layers.at(0)->activate();
 }
 
 void NeuralNetwork::setNeuronValue(int indexLayer, int indexNeuron,
@@ -97,175 +253,534 @@ std::vector<std::shared_ptr<Matrix>> NeuralNetwork::getWeightMatrices() {
   return m_weightMatrices;
 }
 
+std::vector<double> NeuralNetwork::getHistoricalErrors() const {
+  return m_historicalErrors;
+}
+
+void NeuralNetwork::checkTopology(const CheckpointData &checkpoint) const {
+  if (checkpoint.layerSizes != m_topology) {
+    throw std::runtime_error(
+        "Topology of the checkpoint is not the topology of the config.");
+  }
+  for (std::size_t i = 0; i < m_layers.size(); ++i) {
+    if (checkpoint.activations.at(i) != m_layers.at(i)->getActivationType()) {
+      throw std::runtime_error("Activation of layer " + std::to_string(i) +
+                               " differs from the checkpoint.");
+    }
+  }
+}
+
+void NeuralNetwork::resumeFrom(const std::string &filePath) {
+  CheckpointData checkpoint = Checkpoint::load(filePath);
+  checkTopology(checkpoint);
+  // Values are copied, the network keeps its own aligned buffers.
+  for (std::size_t i = 0; i < m_weightMatrices.size(); ++i) {
+    const Matrix &source = *checkpoint.weights.at(i);
+    Matrix &weights = *m_weightMatrices.at(i);
+    for (int row = 0; row < source.getNumberOfRows(); ++row) {
+      std::copy(source.row(row).data(),
+                source.row(row).data() + source.getNumberOfColumns(),
+                weights.row(row).data());
+    }
+  }
+  m_loaderOptions.firstEpoch = checkpoint.epoch;
+  m_loaderOptions.firstSample = checkpoint.sampleOffset;
+  m_epochErrorSum = checkpoint.epochErrorSum;
+  m_epochBatches =
+      (checkpoint.sampleOffset + m_batchSize - 1) / m_batchSize;
+  if (checkpoint.optimizerState.size() == m_optimizer->getState().size()) {
+    // One step per batch, Adam needs the count for its bias correction.
+    const std::uint64_t batchesPerEpoch =
+        (m_trainingData->getNumberOfRows() + m_batchSize - 1) / m_batchSize;
+    m_optimizer->setState(checkpoint.optimizerState,
+                          checkpoint.epoch * batchesPerEpoch + m_epochBatches);
+  } else {
+    std::cerr << filePath << " has no state for this optimizer, it starts "
+              << "from zero." << std::endl;
+  }
+  std::cout << "Resuming from " << filePath << " at epoch "
+            << checkpoint.epoch + 1 << ", sample " << checkpoint.sampleOffset
+            << std::endl;
+}
+
+void NeuralNetwork::submitCheckpoint(CheckpointWriter &writer,
+                                     std::size_t epoch,
+                                     std::size_t sampleOffset) {
+  CheckpointData data = getCheckpointData();
+  data.epoch = epoch;
+  data.sampleOffset = sampleOffset;
+  data.epochErrorSum = sampleOffset == 0 ? 0.0 : m_epochErrorSum;
+  writer.submit(data);
+}
+
+CheckpointData NeuralNetwork::getCheckpointData() const {
+  CheckpointData data;
+  data.layerSizes = m_topology;
+  for (const auto &layer : m_layers) {
+    data.activations.push_back(layer->getActivationType());
+  }
+  data.weights = m_weightMatrices;
+  if (m_optimizer) {
+    data.optimizerState = m_optimizer->getState();
+  }
+  return data;
+}
+
 void NeuralNetwork::feedForward() {
-  std::shared_ptr<Matrix> newMatrix = nullptr;
+  // A mostly zero batch is multiplied without its zeros, backPropagation
+  // uses the same representation for the first weight delta.
+  m_workspace.isSparseInput = m_workspace.sparseInput.compress(
+      *getNeuronMatrix(0), m_sparseInputThreshold);
+  const Scalar bias = static_cast<Scalar>(m_bias);
   for (std::size_t i = 0; i < m_layers.size() - 1; ++i) {
-    if (i != 0) {
-      newMatrix = getActivatedNeuronMatrix(i) * getWeightMatrix(i);
+    auto left = i != 0 ? getActivatedNeuronMatrix(i) : getNeuronMatrix(i);
+    auto newMatrix = getNeuronMatrix(i + 1);
+    if (!m_halfWeights.empty()) {
+      HalfMatrix::multiply(*left, m_halfWeights.at(i), *newMatrix);
+    } else if (i == 0 && m_workspace.isSparseInput) {
+      SparseMatrix::multiply(m_workspace.sparseInput, *getWeightMatrix(i),
+                             *newMatrix);
     } else {
-      newMatrix = getNeuronMatrix(i) * getWeightMatrix(i);
+      Matrix::multiply(*left, *getWeightMatrix(i), *newMatrix);
     }
-    for (std::size_t c_index = 0; c_index < newMatrix->getNumberOfColumns();
-         c_index++) {
-      setNeuronValue(i + 1, c_index, newMatrix->getValue(0, c_index) + m_bias);
+    Scalar *values = newMatrix->data();
+    const std::size_t size =
+        static_cast<std::size_t>(newMatrix->getNumberOfRows()) *
+        newMatrix->getStride();
+    for (std::size_t v = 0; v < size; ++v) {
+      values[v] += bias;
     }
+    m_layers.at(i + 1)->activate();
   }
 }
 
 double NeuralNetwork::getTotalError() const { return m_error; }
 
-std::vector<double> NeuralNetwork::getErrors() const { return m_errors; }
+std::shared_ptr<Matrix> NeuralNetwork::getErrors() const { return m_errors; }
 
 void NeuralNetwork::setCurrentTarget(std::vector<double> target) {
-  m_target = target;
+  if (m_target->getNumberOfRows() != 1 ||
+      m_target->getNumberOfColumns() != target.size()) {
+    m_target = std::make_shared<Matrix>(1, target.size(), false);
+  }
+  std::copy(target.begin(), target.end(), m_target->data());
 }
 
 void NeuralNetwork::setErrors() {
-  if (m_target.size() == 0) {
+  if (m_target->getNumberOfRows() == 0) {
     throw std::runtime_error("No defined target for this  NEURAL NETWORK.");
   }
-  if (m_target.size() !=
-      (m_layers.at(m_layers.size() - 1))->getNeurons().size()) {
+  std::size_t indexOfOutputLayer = m_layers.size() - 1;
+  auto output = getActivatedNeuronMatrix(indexOfOutputLayer);
+  if (m_target->getNumberOfColumns() != output->getNumberOfColumns()) {
     throw std::runtime_error(
         "Target size is not the same as the output LAYER SIZE.");
   }
+  if (m_target->getNumberOfRows() != output->getNumberOfRows()) {
+    throw std::runtime_error(
+        "Number of targets is not the same as the BATCH SIZE.");
+  }
   // Calculate error on the every neuron at the OUTPUT LAYER.
+  const int rows = output->getNumberOfRows();
+  const int columns = output->getNumberOfColumns();
   m_error = 0.0;
-  m_errors.clear();
-  m_derivedErrors.clear();
-  std::size_t indexOfOutputLayer = m_layers.size() - 1;
   // here we calculate error in one way, but there is more ways in which you
   // can calculate errors.
-  for (std::size_t i = 0; i < m_target.size(); ++i) {
-    double tempError = m_layers.at(indexOfOutputLayer)
-                           ->getNeurons()
-                           .at(i)
-                           ->getActivatedValue() -
-                       m_target.at(i);
-
-    double err = 0.5 * pow(tempError, 2);
-    m_errors.push_back(err);
-
-    m_derivedErrors.push_back(2.0 * (m_layers.at(indexOfOutputLayer)
-                                         ->getNeurons()
-                                         .at(i)
-                                         ->getActivatedValue() -
-                                     m_target.at(i)));
-    m_error += err;
+  for (int row = 0; row < rows; ++row) {
+    for (int i = 0; i < columns; ++i) {
+      double tempError = (*output)(row, i) - (*m_target)(row, i);
+
+      double err = 0.5 * pow(tempError, 2);
+      (*m_errors)(row, i) = err;
+      (*m_derivedErrors)(row, i) = 2.0 * tempError;
+      m_error += err;
+    }
   }
-  // Store all global errors at each iteration of the neural network.
-  m_historicalErrors.push_back(m_error / (indexOfOutputLayer + 1));
+  // Error of one sample, averaged over the batch.
+  m_error /= rows;
+  // Only the sum is kept, m_historicalErrors gets one mean per epoch.
+  m_epochErrorSum += m_error;
+  m_epochBatches++;
 }
 
 void NeuralNetwork::backPropagation() {
+  // Sum of the gradients over the batch is scaled by 1 / batch, the
+  // optimizer gets the averaged gradient.
+  const int batchRows = getNeuronMatrix(0)->getNumberOfRows();
+  const double scale = 1.0 / batchRows;
+  m_optimizer->nextStep();
+
   // *****output to hidden layer *****
   int indexOutPutLayer = m_layers.size() - 1;
   std::shared_ptr<Matrix> derivedValuesOnOutputLayer =
-      m_layers.at(indexOutPutLayer)->layerDerivedAsMatrix();
-
-  std::shared_ptr<Matrix> gradient = std::make_shared<Matrix>(
-      1, m_layers.at(indexOutPutLayer)->getNeurons().size(), false);
-
-  for (std::size_t gg = 0; gg < m_derivedErrors.size(); ++gg) {
-    gradient->setValue(0, gg,
-                       derivedValuesOnOutputLayer->getValue(0, gg) *
-                           m_derivedErrors.at(gg));
+      getDerivedNeuronMatrix(indexOutPutLayer);
+  std::shared_ptr<Matrix> gradient =
+      m_workspace.gradients.at(indexOutPutLayer);
+
+  const std::size_t outputSize =
+      static_cast<std::size_t>(batchRows) * gradient->getStride();
+  for (std::size_t gg = 0; gg < outputSize; ++gg) {
+    gradient->data()[gg] =
+        derivedValuesOnOutputLayer->data()[gg] * m_derivedErrors->data()[gg];
   }
-  m_gradientMatrices.push_back(gradient);
-  int lastHiddenLayer = indexOutPutLayer - 1;
-
-  auto deltaWeightedMatrix =
-      (m_layers.at(lastHiddenLayer)->layerActivatedAsMatrix())->transpose() *
-      gradient;
-
-  auto updatedWeights = (m_weightMatrices.at(lastHiddenLayer) * m_momentum) -
-                        (deltaWeightedMatrix * m_learningRate);
-
-  m_updatedWeightsMatrices.insert(m_updatedWeightsMatrices.begin(),
-                                  updatedWeights);
 
   // ***** hidden to the input layer. ******
-  for (std::size_t i = lastHiddenLayer; i > 0; --i) {
-
-    auto derivedGradients =
-        std::make_shared<Matrix>(1, m_layers.at(i)->getNeurons().size(), false);
-
-    auto weightMatrix = m_weightMatrices.at(i);
-    auto originalWeightMetrix = m_weightMatrices.at(i - 1);
-    auto activatedHidden = m_layers.at(i)->layerActivatedAsMatrix();
+  // Every weight matrix is updated right after its last use, the gradient
+  // for the layer on its left still has to flow through the old weights.
+  m_weightUpdateSeconds = 0.0;
+  for (int i = indexOutPutLayer - 1; i >= 0; --i) {
+    auto leftMatrixOfNeurons =
+        i == 0 ? getNeuronMatrix(0) : getActivatedNeuronMatrix(i);
+    // (left x batch) * (batch x right), the neurons are read as they are
+    // stored.
+    if (i == 0 && m_workspace.isSparseInput) {
+      SparseMatrix::multiplyTransposedLeft(m_workspace.sparseInput,
+                                           *m_workspace.gradients.at(1),
+                                           *m_workspace.deltaWeights.at(0));
+    } else {
+      Matrix::multiplyTransposedLeft(*leftMatrixOfNeurons,
+                                     *m_workspace.gradients.at(i + 1),
+                                     *m_workspace.deltaWeights.at(i));
+    }
 
-    for (std::size_t r = 0; r < weightMatrix->getNumberOfRows(); ++r) {
-      double sum = 0;
-      for (std::size_t c = 0; c < weightMatrix->getNumberOfColumns(); ++c) {
-        double p = m_gradientMatrices.back()->getValue(0, c) *
-                   weightMatrix->getValue(r, c);
-        sum += p;
+    if (i > 0) {
+      // Gradient of every sample flows back through the weights,
+      // (batch x right) * (right x left).
+      auto derivedGradients = m_workspace.gradients.at(i);
+      Matrix::multiplyTransposedRight(*m_workspace.gradients.at(i + 1),
+                                      *m_weightMatrices.at(i),
+                                      *derivedGradients);
+
+      Scalar *g = derivedGradients->data();
+      const Scalar *activated = getActivatedNeuronMatrix(i)->data();
+      const std::size_t size =
+          static_cast<std::size_t>(batchRows) * derivedGradients->getStride();
+      for (std::size_t v = 0; v < size; ++v) {
+        g[v] *= activated[v];
       }
-      double g = sum * activatedHidden->getValue(0, r);
-      derivedGradients->setValue(0, r, g);
     }
+    const auto updateStart = std::chrono::steady_clock::now();
+    updateWeights(i, scale);
+    m_weightUpdateSeconds += TrainingMetrics::getSecondsSince(updateStart);
+  }
+}
 
-    m_gradientMatrices.push_back(derivedGradients);
-
-    auto leftMatrixOfNeurons =
-        (i - 1) == 0 ? m_layers.at(0)->layerAsMatrix()
-                     : m_layers.at(i - 1)->layerActivatedAsMatrix();
-
-    auto deltaWeights = leftMatrixOfNeurons->transpose() * derivedGradients;
-
-    auto newWeights =
-        (originalWeightMetrix * m_momentum) - (deltaWeights * m_learningRate);
-
-    m_updatedWeightsMatrices.insert(m_updatedWeightsMatrices.begin(),
-                                    newWeights);
+void NeuralNetwork::updateWeights(int index, double scale) {
+  m_optimizer->update(index, *m_workspace.deltaWeights.at(index), scale);
+  if (!m_halfWeights.empty()) {
+    m_halfWeights.at(index).assign(*m_weightMatrices.at(index));
   }
-  m_weightMatrices = m_updatedWeightsMatrices;
-  m_updatedWeightsMatrices.clear();
 }
 
 void NeuralNetwork::train(int numberOfEpoch) {
   std::cout << "Start with training..." << std::endl;
-  for (std::size_t i = 0; i < numberOfEpoch; ++i) {
-    for (std::size_t index = 0; index < m_trainingData.size(); ++index) {
-
-      setValuesToNeuronsInputLayer(m_trainingData.at(index));
-      setCurrentTarget(m_labelsData.at(index));
-      feedForward();
-      setErrors();
-      backPropagation();
-    }
-    std::cout << "Epoch " << i + 1 << ", total error: " << getTotalError()
+  // Checkpoints are written while training goes on.
+  std::unique_ptr<CheckpointWriter> checkpointWriter;
+  if (!m_checkpointPath.empty() &&
+      (m_checkpointEverySamples > 0 || m_checkpointEveryEpochs > 0)) {
+    checkpointWriter = std::make_unique<CheckpointWriter>(m_checkpointPath);
+  }
+  std::size_t samplesSinceCheckpoint = 0;
+
+  if (m_halfType != HalfType::None) {
+    std::cout << "Forward pass with " << HalfMatrix::getTypeName(m_halfType)
+              << " weights, kernel " << HalfMatrix::getKernelName(m_halfType)
               << std::endl;
   }
+  if (m_halfType != HalfType::None && m_trainingMode == TrainingMode::Serial) {
+    // The parallel trainer keeps its own copies.
+    m_halfWeights.assign(m_weightMatrices.size(), HalfMatrix(m_halfType));
+    for (std::size_t i = 0; i < m_weightMatrices.size(); ++i) {
+      m_halfWeights.at(i).assign(*m_weightMatrices.at(i));
+    }
+  }
+
+  // Every thread trains a slice of each batch with its own buffers.
+  std::unique_ptr<ParallelTrainer> trainer;
+  if (m_trainingMode != TrainingMode::Serial) {
+    trainer = std::make_unique<ParallelTrainer>(
+        m_topology, getActivations(), m_weightMatrices, m_bias, m_batchSize,
+        m_trainingMode, m_optimizer, m_sparseInputThreshold, m_halfType);
+  }
+
+  // Every phase of a step is timed, the metrics are exported per epoch.
+  TrainingMetrics metrics(m_metricsFile, m_metricsFormat);
+  auto addPhase = [&metrics](TrainingPhase phase,
+                             std::chrono::steady_clock::time_point start) {
+    metrics.add(phase, TrainingMetrics::getSecondsSince(start));
+  };
+
+  // Batches of the next steps are read while the current one trains.
+  BatchLoader loader(m_trainingData, m_labelsData, numberOfEpoch,
+                     m_loaderOptions);
+  for (std::size_t i = m_loaderOptions.firstEpoch; i < numberOfEpoch; ++i) {
+    metrics.startEpoch();
+    std::size_t epochSamples = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (const Batch *batch = loader.next()) {
+      const std::size_t rows = batch->inputs.getNumberOfRows();
+      const std::size_t sampleOffset = batch->firstSample + rows;
+      if (trainer) {
+        addPhase(TrainingPhase::DataLoading, start);
+        m_error = trainer->step(*batch);
+        const PhaseSeconds &phases = trainer->getPhaseSeconds();
+        for (std::size_t p = 0; p < phases.size(); ++p) {
+          metrics.add(static_cast<TrainingPhase>(p), phases[p]);
+        }
+        start = std::chrono::steady_clock::now();
+        loader.release();
+        addPhase(TrainingPhase::DataLoading, start);
+        m_epochErrorSum += m_error;
+        m_epochBatches++;
+      } else {
+        setBatch(*batch);
+        loader.release();
+        addPhase(TrainingPhase::DataLoading, start);
+        start = std::chrono::steady_clock::now();
+        feedForward();
+        addPhase(TrainingPhase::FeedForward, start);
+        start = std::chrono::steady_clock::now();
+        setErrors();
+        addPhase(TrainingPhase::SetErrors, start);
+        start = std::chrono::steady_clock::now();
+        backPropagation();
+        metrics.add(TrainingPhase::BackPropagation,
+                    TrainingMetrics::getSecondsSince(start) -
+                        m_weightUpdateSeconds);
+        metrics.add(TrainingPhase::WeightUpdate, m_weightUpdateSeconds);
+      }
+      epochSamples += rows;
+
+      samplesSinceCheckpoint += rows;
+      if (checkpointWriter && m_checkpointEverySamples > 0 &&
+          samplesSinceCheckpoint >= m_checkpointEverySamples) {
+        submitCheckpoint(*checkpointWriter, i, sampleOffset);
+        samplesSinceCheckpoint = 0;
+      }
+      start = std::chrono::steady_clock::now();
+    }
+    addPhase(TrainingPhase::DataLoading, start);
+    m_historicalErrors.push_back(m_epochErrorSum /
+                                 std::max<std::size_t>(1, m_epochBatches));
+    m_epochErrorSum = 0.0;
+    m_epochBatches = 0;
+    const EpochMetrics epochMetrics =
+        metrics.finishEpoch(i + 1, epochSamples, m_historicalErrors.back());
+    const BatchLoaderStatistics statistics = loader.takeStatistics();
+    std::cout << "Epoch " << i + 1
+              << ", mean error: " << m_historicalErrors.back() << std::endl;
+    std::cout << "Input: waited " << statistics.stallSeconds
+              << " s for batches, average queue depth "
+              << statistics.getAverageQueueDepth() << "/"
+              << m_loaderOptions.prefetchDepth << std::endl;
+    std::cout << "Time:";
+    for (std::size_t p = 0; p < epochMetrics.phaseSeconds.size(); ++p) {
+      std::cout << " " << TrainingMetrics::getPhaseName(
+                              static_cast<TrainingPhase>(p))
+                << " " << epochMetrics.phaseSeconds[p] << " s,";
+    }
+    std::cout << " " << epochMetrics.getSamplesPerSecond()
+              << " samples/s" << std::endl;
+    std::cout << "Memory: peak RSS " << epochMetrics.peakRssBytes
+              << " bytes, " << epochMetrics.allocations << " allocations of "
+              << epochMetrics.allocatedBytes << " bytes" << std::endl;
+    if (checkpointWriter && m_checkpointEveryEpochs > 0 &&
+        (i + 1) % m_checkpointEveryEpochs == 0) {
+      submitCheckpoint(*checkpointWriter, i + 1, 0);
+    }
+  }
 }
 
-void NeuralNetwork::predict() {
-  int correct = 0;
-  for (std::size_t index = 0; index < m_predictionData.size(); ++index) {
-    setValuesToNeuronsInputLayer(m_predictionData.at(index));
-    setCurrentTarget(m_labelsPredictionData.at(index));
+namespace {
+
+/**
+ * Predicted and actual class of every sample. Batches are spread over the
+ * threads, every chunk of batches gets its own buffers of the model, which
+ * is Inference or QuantizedInference.
+ */
+template <typename Model>
+void classify(const Model &model, const Dataset &data, const Dataset &labels,
+              int batchSize, std::vector<int> &predicted,
+              std::vector<int> &actual) {
+  const std::size_t numberOfSamples = data.getNumberOfRows();
+  const int numberOfBatches =
+      static_cast<int>((numberOfSamples + batchSize - 1) / batchSize);
+  predicted.resize(numberOfSamples);
+  actual.resize(numberOfSamples);
+
+  ThreadPool::getInstance().parallelFor(
+      0, numberOfBatches, 1, [&](int beginBatch, int endBatch) {
+        auto buffers = model.createBuffers(batchSize);
+        Matrix inputs(batchSize, data.getNumberOfColumns(), false);
+        Matrix targets(batchSize, labels.getNumberOfColumns(), false);
+        for (int batch = beginBatch; batch < endBatch; ++batch) {
+          const std::size_t first = static_cast<std::size_t>(batch) * batchSize;
+          const std::size_t count =
+              std::min<std::size_t>(batchSize, numberOfSamples - first);
+          data.readRows(first, count, inputs);
+          labels.readRows(first, count, targets);
+          const Matrix &outputs = model.forward(inputs, buffers);
+          for (std::size_t row = 0; row < count; ++row) {
+            predicted[first + row] = Inference::argmax(outputs.row(row));
+            actual[first + row] =
+                Inference::argmax(std::as_const(targets).row(row));
+          }
+        }
+      });
+}
 
-    feedForward();
-    setErrors();
+double getAccuracy(const std::vector<int> &predicted,
+                   const std::vector<int> &actual) {
+  if (predicted.empty()) {
+    return 0.0;
+  }
+  std::size_t correct = 0;
+  for (std::size_t index = 0; index < predicted.size(); ++index) {
+    correct += predicted[index] == actual[index] ? 1 : 0;
+  }
+  return 100.0 * correct / static_cast<double>(predicted.size());
+}
 
-    int ss = m_layers.size() - 1;
+double getSecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
 
-    auto minElement = std::min_element(m_errors.begin(), m_errors.end());
-    auto maxElement = std::max_element(m_labelsPredictionData.at(index).begin(),
-                                       m_labelsPredictionData.at(index).end());
-    std::size_t positionMIN = std::distance(m_errors.begin(), minElement);
-    std::size_t positionMAX =
-        std::distance(m_labelsPredictionData.at(index).begin(), maxElement);
+} // namespace
 
-    if (positionMIN == positionMAX) {
-      correct++;
-    } else {
+void NeuralNetwork::predict() {
+  if (m_labelsPredictionData->getNumberOfColumns() != m_topology.back()) {
+    throw std::runtime_error(
+        "Target size is not the same as the output LAYER SIZE.");
+  }
+  // The weights are only read, every chunk of batches has its own buffers.
+  const Inference inference = createInference();
+  std::vector<int> predicted;
+  std::vector<int> actual;
+  auto start = std::chrono::steady_clock::now();
+  classify(inference, *m_predictionData, *m_labelsPredictionData,
+           m_batchSize, predicted, actual);
+  const double seconds = getSecondsSince(start);
+
+  for (std::size_t index = 0; index < predicted.size(); ++index) {
+    if (predicted[index] != actual[index]) {
       std::cout << "Data position: " << index << std::endl;
-      std::cout << "predicted number: " << positionMIN << std::endl;
-      std::cout << "actual number: " << positionMAX << std::endl;
+      std::cout << "predicted number: " << predicted[index] << std::endl;
+      std::cout << "actual number: " << actual[index] << std::endl;
     }
   }
+  const double accuracy = getAccuracy(predicted, actual);
+  std::cout << "ACCURACY: " << accuracy << std::endl;
+
+  if (ProductionNetwork::matches(m_topology, getActivations())) {
+    // The topology is compiled in, every sample goes through it on its own.
+    const ProductionNetwork staticNetwork(m_weightMatrices, m_bias,
+                                          m_loaderOptions.inputScale);
+    std::vector<int> staticPredicted;
+    start = std::chrono::steady_clock::now();
+    classify(staticNetwork, *m_predictionData, *m_labelsPredictionData,
+             m_batchSize, staticPredicted, actual);
+    const double staticSeconds = getSecondsSince(start);
+    std::size_t differences = 0;
+    for (std::size_t index = 0; index < predicted.size(); ++index) {
+      differences += staticPredicted[index] != predicted[index] ? 1 : 0;
+    }
+    std::cout << "STATIC ACCURACY: " << getAccuracy(staticPredicted, actual)
+              << ", " << differences << " predictions differ, evaluated in "
+              << staticSeconds << " s (" << seconds << " s dynamic)"
+              << std::endl;
+  }
+  std::size_t weightBytes = 0;
+  for (auto const &weights : m_weightMatrices) {
+    weightBytes += sizeof(Scalar) * weights->getNumberOfRows() *
+                   weights->getNumberOfColumns();
+  }
+  if (m_halfType != HalfType::None) {
+    // Same network and batches, only the weights are rounded to 16 bits.
+    Inference halfInference = inference;
+    halfInference.setHalfType(m_halfType);
+    std::vector<int> halfPredicted;
+    start = std::chrono::steady_clock::now();
+    classify(halfInference, *m_predictionData, *m_labelsPredictionData,
+             m_batchSize, halfPredicted, actual);
+    const double halfSeconds = getSecondsSince(start);
+    const double halfAccuracy = getAccuracy(halfPredicted, actual);
+    std::size_t differences = 0;
+    for (std::size_t index = 0; index < predicted.size(); ++index) {
+      differences += halfPredicted[index] != predicted[index] ? 1 : 0;
+    }
+    const std::string name = HalfMatrix::getTypeName(m_halfType);
+    std::cout << "Weights as " << name << ": ACCURACY " << halfAccuracy
+              << " (" << std::showpos << halfAccuracy - accuracy
+              << std::noshowpos << " points), " << differences
+              << " predictions differ, kernel "
+              << HalfMatrix::getKernelName(m_halfType) << std::endl;
+    std::cout << "Weights: " << weightBytes << " bytes as " << kScalarName
+              << ", " << weightBytes * 2 / sizeof(Scalar) << " bytes as "
+              << name << std::endl;
+    std::cout << "Evaluation: " << seconds << " s as " << kScalarName
+              << ", " << halfSeconds << " s as " << name << std::endl;
+  }
+  if (m_calibrationDataPath.empty()) {
+    return;
+  }
 
-  std::cout << "ACCURACY: " << (correct / m_predictionData.size()) * 100
+  // Calibrate on samples spread evenly over the calibration data.
+  auto calibrationData = Dataset::open(m_calibrationDataPath);
+  const std::size_t available = calibrationData->getNumberOfRows();
+  const std::size_t samples =
+      std::min<std::size_t>(available, std::max(1, m_calibrationSamples));
+  std::vector<std::size_t> indices(samples);
+  for (std::size_t i = 0; i < samples; ++i) {
+    indices[i] = i * available / samples;
+  }
+  Matrix calibration(samples, m_topology.front(), false);
+  calibrationData->gatherRows(indices.data(), samples, calibration);
+  const QuantizedInference quantized(inference, calibration);
+
+  std::vector<int> quantizedPredicted;
+  start = std::chrono::steady_clock::now();
+  classify(quantized, *m_predictionData, *m_labelsPredictionData,
+           m_batchSize, quantizedPredicted, actual);
+  const double quantizedSeconds = getSecondsSince(start);
+  const double quantizedAccuracy = getAccuracy(quantizedPredicted, actual);
+
+  std::cout << "INT8 ACCURACY: " << quantizedAccuracy << " ("
+            << std::showpos << quantizedAccuracy - accuracy << std::noshowpos
+            << " points), calibrated on " << samples << " samples, kernel "
+            << QuantizedInference::getKernelName() << std::endl;
+  std::cout << "Weights: " << weightBytes << " bytes as " << kScalarName
+            << ", " << quantized.getWeightBytes() << " bytes as INT8"
             << std::endl;
+  std::cout << "Evaluation: " << seconds << " s as " << kScalarName << ", "
+            << quantizedSeconds << " s as INT8" << std::endl;
+}
+
+void NeuralNetwork::serve() {
+  Inference inference = createInference();
+  if (m_halfType != HalfType::None) {
+    // The server only multiplies with the 16 bit copies, the full precision
+    // weights are not kept next to them.
+    inference.setHalfType(m_halfType);
+    inference.releaseFullWeights();
+    m_weightMatrices.clear();
+  }
+  InferenceServer server(std::move(inference), m_serverOptions);
+  server.run();
+}
+
+Inference NeuralNetwork::createInference() const {
+  Inference inference(m_topology, getActivations(), m_weightMatrices, m_bias);
+  inference.setSparseInputThreshold(m_sparseInputThreshold);
+  inference.setInputScale(m_loaderOptions.inputScale);
+  return inference;
+}
+
+std::vector<ActivationType> NeuralNetwork::getActivations() const {
+  std::vector<ActivationType> activations;
+  for (auto const &layer : m_layers) {
+    activations.push_back(layer->getActivationType());
+  }
+  return activations;
 }
@@ -2,12 +2,29 @@
 #define _NEURAL_NETWORK_H
 
 #include <algorithm>
+#include <chrono>
 #include <map>
+#include <utility>
 #include <vector>
 
+#include "batchLoader.h"
+#include "checkpoint.h"
+#include "checkpointWriter.h"
+#include "dataset.h"
+#include "halfMatrix.h"
+#include "inference.h"
+#include "inferenceServer.h"
+#include "quantizedInference.h"
+#include "staticNetwork.h"
 #include "layer.h"
 #include "matrix.h"
+#include "optimizer.h"
+#include "parallelTrainer.h"
+#include "sparseMatrix.h"
+#include "threadPool.h"
+#include "trainingMetrics.h"
 #include "utils.h"
+#include "weightInitializer.h"
 
 struct Topology {
   int numberOfNeuronsInLayer;
@@ -21,14 +38,103 @@ struct Params {
   double momentum;
   std::string trainingDataPath;
   std::string labelDataPath;
+  /** Number of samples averaged into one weight update.*/
+  int batchSize = 1;
+  /** Threads used by the matrix kernels, 0 means one per core.*/
+  int numberOfThreads = 0;
+  /** Visit the training samples in a new random order every epoch.*/
+  bool shuffle = false;
+  /** Seed of the random order and of the starting weights.*/
+  std::uint64_t seed = 0;
+  /** Scheme of the starting weights: "" picks He for relu layers and
+   * Xavier for the others, "xavier" or "he" use one for all.*/
+  std::string weightInitialization;
+  /** Every input value is multiplied by this before training.*/
+  double inputScale = 1.0;
+  /** Batches prepared in the background ahead of the one in training.*/
+  int prefetchDepth = 2;
+  /** Checkpoint written in the background during training.*/
+  std::string checkpointPath;
+  /** Write a checkpoint after this many samples, 0 means never.*/
+  std::size_t checkpointEverySamples = 0;
+  /** Write a checkpoint after this many epochs, 0 means never.*/
+  int checkpointEveryEpochs = 0;
+  /** Checkpoint to continue training from, empty starts from scratch.*/
+  std::string resumeFrom;
+  /** How batches are spread over the threads: "" (only the matrix kernels
+   * are parallel), "dataParallel" or "hogwild".*/
+  std::string trainingMode;
+  /** How the gradient updates the weights: "sgd", "nesterov" or "adam".*/
+  std::string optimizer = "sgd";
+  /** Decay of the mean gradient, Adam.*/
+  double beta1 = 0.9;
+  /** Decay of the mean squared gradient, Adam.*/
+  double beta2 = 0.999;
+  /** Keeps the Adam step finite where the squared gradient is zero.*/
+  double epsilon = 1e-8;
+  /** File the metrics of every epoch are exported to, empty for none.*/
+  std::string metricsFile;
+  /** "jsonl" appends one line per epoch, "prometheus" rewrites a text file
+   * in the Prometheus exposition format.*/
+  std::string metricsFormat = "jsonl";
+  /** Batches with a smaller share of non zero inputs skip the zeros in
+   * the first layer, 0 turns that off.*/
+  double sparseInputThreshold = 0.25;
+  /** The forward pass multiplies with 16 bit copies of the weights: "",
+   * "bf16" or "fp16". Updates go to the full precision weights.*/
+  std::string halfWeights;
 };
 
 struct Predict {
   std::vector<Topology> numOfNeuronsActivationFunction;
   double bias;
+  /** Binary checkpoint, or weights exported as JSON.*/
   std::string loadWeightsPath;
   std::string testDataPath;
   std::string testLabelDataPath;
+  /** Number of samples evaluated together.*/
+  int batchSize = 64;
+  /** Threads used by the matrix kernels, 0 means one per core.*/
+  int numberOfThreads = 0;
+  /** Answer requests instead of evaluating the test data.*/
+  bool serve = false;
+  /** Unix domain socket the server listens on, empty for stdin.*/
+  std::string socketPath;
+  /** Most requests the server evaluates together.*/
+  int maxBatchSize = 64;
+  /** Longest a request waits for others to join its batch.*/
+  double maxLatencyMs = 1.0;
+  /** Answer with the probabilities of all classes too.*/
+  bool probabilities = false;
+  /** Samples to calibrate an INT8 copy of the network on, empty evaluates
+   * only the regular network.*/
+  std::string calibrationDataPath;
+  /** Number of calibration samples.*/
+  int calibrationSamples = 1000;
+  /** Batches with a smaller share of non zero inputs skip the zeros in
+   * the first layer, 0 turns that off.*/
+  double sparseInputThreshold = 0.25;
+  /** Evaluate with 16 bit weights too, "bf16" or "fp16", and compare the
+   * accuracy. The server answers with them. Empty for none.*/
+  std::string halfWeights;
+  /** Every input value is multiplied by this before the first layer, the
+   * inputScale the network was trained with.*/
+  double inputScale = 1.0;
+};
+
+/** Buffers reused by every training step. They are sized once from the
+ * topology and the batch size, so steady state training does not
+ * allocate.*/
+struct TrainingWorkspace {
+  /** Gradient at each layer (batch x neurons), index 0 is not used.*/
+  std::vector<std::shared_ptr<Matrix>> gradients;
+  /** Delta of each weight matrix (left x right).*/
+  std::vector<std::shared_ptr<Matrix>> deltaWeights;
+  /** Non zero values of the input batch, used by the first layer when
+   * isSparseInput is set.*/
+  SparseMatrix sparseInput;
+  /** The input batch of the last feedForward was sparse enough.*/
+  bool isSparseInput = false;
 };
 
 class NeuralNetwork {
@@ -55,15 +161,36 @@ public:
   virtual ~NeuralNetwork() = default;
 
   /**
-   * @brief Set the Values To Neurons at input Layer.
+   * @brief Set the Values To Neurons at input Layer. The batch becomes a
+   * single sample.
    *
    * @param std::vector<double> values at neurons in input layer.
    */
   void setValuesToNeuronsInputLayer(std::vector<double> valuesAtNeurons);
 
+  /**
+   * @brief Set consecutive samples as the current batch, one sample per row
+   * of the input layer, together with their targets.
+   *
+   * @param data samples, one per row.
+   * @param labels targets, one per row.
+   * @param first index of the first sample in the batch.
+   * @param count number of samples in the batch.
+   */
+  void setBatch(const Dataset &data, const Dataset &labels,
+                std::size_t first, std::size_t count);
+
+  /**
+   * @brief Set a prepared batch as the current one, one sample per row of
+   * the input layer, together with its targets.
+   *
+   * @param batch samples and targets.
+   */
+  void setBatch(const Batch &batch);
+
   /**
    * @brief Takes layer and then takes some specific neuron in this layer
-   * and set new value to this neuron.
+   * and set new value to this neuron, for the first sample in the batch.
    *
    * @param indexLayer which layer in neural network.
    * @param indexNeuron which neuron in the layer(indexLayer).
@@ -78,7 +205,7 @@ public:
   void printMatrixForEachLayer();
 
   /**
-   * @brief Get the Neuron values in form of matrix.
+   * @brief Get the Neuron values in form of matrix (batch size x neurons).
    *
    * @param index  which layer in neural network.
    * @return std::shared_ptr<Matrix> pointer to a metric of neuron values.
@@ -116,13 +243,14 @@ public:
    * in this specific layer and than makes a vector from this new
    * calculated matrix of multiplication so that we can do next multiplication
    * until we get to the last layer.(neurons on the left * weights to the right
-   * = neuron to the right).
+   * = neuron to the right). The whole batch is one matrix, so every layer is
+   * a single (batch x left) * (left x right) multiplication.
    *
    */
   void feedForward();
   /**
    * @brief Get the Total Error of the neural network. This is the sum of the
-   * errors in vector m_errors.
+   * errors in m_errors, averaged over the samples in the batch.
    *
    * @return double total error of the network.
    */
@@ -131,13 +259,14 @@ public:
   /**
    * @brief Get error for each neuron on the output layer.
    *
-   * @return std::vector<double> of errors on the output layer.
+   * @return std::shared_ptr<Matrix> errors on the output layer, one sample
+   * per row.
    */
-  std::vector<double> getErrors() const;
+  std::shared_ptr<Matrix> getErrors() const;
 
   /**
    * @brief Set the target of neural network. The value to which you want to
-   * get close as possible.
+   * get close as possible. The batch becomes a single sample.
    *
    * @param std::vector<double> vector of target values.
    */
@@ -153,7 +282,8 @@ public:
    * @brief Executes the back propagation algorithm.
    *
    * This function performs the back propagation algorithm in a neural network,
-   * adjusting the weights based on calculated errors.
+   * adjusting the weights based on calculated errors. Gradients are averaged
+   * over the samples in the batch.
    */
   void backPropagation();
 
@@ -162,7 +292,8 @@ public:
    *
    * This function initiates the training process for the neural network,
    * iterating over a given number of epochs to adjust weights and biases
-   * based on input data and expected outputs.
+   * based on input data and expected outputs. Weights are updated once per
+   * batch of m_batchSize samples.
    *
    * @param numberOfEpoch The number of training epochs to execute.
    */
@@ -171,10 +302,29 @@ public:
   /**
    * @brief It predicts which thing it should be on the given data.
    * The highest value on the neuron on the output layer gives
-   * prediction.
+   * prediction. Batches are evaluated in parallel, every thread with its
+   * own buffers over the same weights. With calibration data an INT8 copy
+   * of the network is evaluated too and its accuracy compared.
    */
   void predict();
 
+  /**
+   * @brief Keep the network in memory and answer prediction requests, see
+   * InferenceServer.
+   *
+   * @throws std::runtime_error when the socket can not be opened.
+   */
+  void serve();
+
+  /**
+   * @brief Get an evaluator over the current weights, which it shares and
+   * only reads.
+   *
+   * @return Inference topology, activations, weights and bias of the
+   * network.
+   */
+  Inference createInference() const;
+
   /**
    * @brief get vector of weights matrices
    *
@@ -183,7 +333,80 @@ public:
    */
   std::vector<std::shared_ptr<Matrix>> getWeightMatrices();
 
+  /**
+   * @brief Get the mean error of every finished epoch.
+   *
+   * @return std::vector<double> one mean error per epoch.
+   */
+  std::vector<double> getHistoricalErrors() const;
+
+  /**
+   * @brief Get the topology and the weights in the form a checkpoint
+   * stores them. The weight matrices are shared, not copied.
+   *
+   * @return CheckpointData topology and weights.
+   */
+  CheckpointData getCheckpointData() const;
+
+  /**
+   * @brief Continue training from a checkpoint: its weights replace the
+   * current ones and train() starts at its epoch and sample offset.
+   *
+   * @param filePath path to a checkpoint of this topology.
+   * @throws std::runtime_error when the checkpoint does not fit.
+   */
+  void resumeFrom(const std::string &filePath);
+
 private:
+  /**
+   * @brief Make the batch matrices of every layer hold rows samples.
+   *
+   * @param rows number of samples in the batch.
+   */
+  void resizeBatch(int rows);
+
+  /**
+   * @brief Allocate the training workspace for batches of up to rows
+   * samples.
+   *
+   * @param rows largest number of samples in a batch.
+   */
+  void allocateWorkspace(int rows);
+
+  /**
+   * @brief Update the weight matrix at index with its delta from the
+   * workspace, through the optimizer.
+   *
+   * @param index of a weight matrix.
+   * @param scale 1 / samples in the batch, the delta is their sum.
+   */
+  void updateWeights(int index, double scale);
+
+  /**
+   * @brief Throw when a checkpoint has another topology or other
+   * activation functions than this network.
+   *
+   */
+  void checkTopology(const CheckpointData &checkpoint) const;
+
+  /**
+   * @brief Hand a snapshot of the weights and the training position to the
+   * background writer.
+   *
+   * @param writer background checkpoint writer.
+   * @param epoch epochs finished.
+   * @param sampleOffset samples of the next epoch already trained.
+   */
+  void submitCheckpoint(CheckpointWriter &writer, std::size_t epoch,
+                        std::size_t sampleOffset);
+
+  /**
+   * @brief Get the activation function of every layer.
+   *
+   * @return std::vector<ActivationType> one per layer.
+   */
+  std::vector<ActivationType> getActivations() const;
+
   /** Number of neurons in each layer. */
   std::vector<int> m_topology;
   /** Number of layers in neural network.*/
@@ -192,13 +415,13 @@ private:
   std::vector<std::shared_ptr<Matrix>> m_weightMatrices;
   /** Number of layers in neural network.*/
   int m_topologySize;
-  /** Values at neurons at input layer. */
-  std::vector<double> m_inputLayer;
+  /** Number of samples in one batch.*/
+  int m_batchSize;
   /** Should have the same size as the output layer. Means that we will be
    * learning our neurons network on this targets, this will be the ones that
-   * you know.
+   * you know. One sample of the batch per row.
    */
-  std::vector<double> m_target;
+  std::shared_ptr<Matrix> m_target;
   /** Current error or total error for the current network.*/
   double m_error;
   /** Bias is an additional input to nodes/neurons, providing flexibility
@@ -206,34 +429,59 @@ private:
    * the neural network to fit non-linear patterns in data.
    */
   double m_bias;
-  /** Scaling factor for updating the parameters as matrix.
-   * This will be a scalar.
-   */
-  std::shared_ptr<Matrix> m_learningRate;
-  /** For accelerating gradient descent.
-   * This is also a scalar.
-   */
-  std::shared_ptr<Matrix> m_momentum;
-  /** Present error for each neuron in the output layer.*/
-  std::vector<double> m_errors;
-  /** Stores error at each interation.*/
+  /** Updates the weights from their gradient, with its own state.*/
+  std::shared_ptr<Optimizer> m_optimizer;
+  /** Present error for each neuron in the output layer, one sample per
+   * row.*/
+  std::shared_ptr<Matrix> m_errors;
+  /** Mean error of every finished epoch.*/
   std::vector<double> m_historicalErrors;
-  /** all gradients calculated in neural network*/
-  std::vector<std::shared_ptr<Matrix>> m_gradientMatrices;
-  /** Vector new  matrix weights, calculated as old matrix of weights - delta
-   * weight matrix*/
-  std::vector<std::shared_ptr<Matrix>> m_updatedWeightsMatrices;
-  /** this are used for back propagation*/
-  std::vector<double> m_derivedErrors;
-  /** training data from a file */
-  std::vector<std::vector<double>> m_trainingData;
+  /** Sum of the errors of the batches in the current epoch.*/
+  double m_epochErrorSum;
+  /** Number of batches in the current epoch.*/
+  std::size_t m_epochBatches;
+  /** How the training batches are prepared.*/
+  BatchLoaderOptions m_loaderOptions;
+  /** Checkpoint written in the background, empty for none.*/
+  std::string m_checkpointPath;
+  /** Samples between two checkpoints, 0 means never.*/
+  std::size_t m_checkpointEverySamples;
+  /** Epochs between two checkpoints, 0 means never.*/
+  int m_checkpointEveryEpochs;
+  /** How prediction requests are served.*/
+  ServerOptions m_serverOptions;
+  /** Samples to calibrate the INT8 network on, empty for none.*/
+  std::string m_calibrationDataPath;
+  /** Number of calibration samples.*/
+  int m_calibrationSamples;
+  /** How batches are spread over the threads.*/
+  TrainingMode m_trainingMode;
+  /** File the metrics of every epoch are exported to, empty for none.*/
+  std::string m_metricsFile;
+  /** Format of the metrics file.*/
+  std::string m_metricsFormat;
+  /** Share of non zero inputs below which the first layer works on the
+   * sparse input.*/
+  double m_sparseInputThreshold;
+  /** Format of the 16 bit weights, HalfType::None for none.*/
+  HalfType m_halfType;
+  /** 16 bit copies of the weights the forward pass multiplies with during
+   * training, each one rounded again after its matrix is updated.*/
+  std::vector<HalfMatrix> m_halfWeights;
+  /** Time spent in updateWeights by the last backPropagation.*/
+  double m_weightUpdateSeconds;
+  /** Buffers reused by every training step.*/
+  TrainingWorkspace m_workspace;
+  /** this are used for back propagation, one sample per row*/
+  std::shared_ptr<Matrix> m_derivedErrors;
+  /** training data from a file, read one batch at a time */
+  std::shared_ptr<Dataset> m_trainingData;
   /** label data from a file*/
-  std::vector<std::vector<double>> m_labelsData;
+  std::shared_ptr<Dataset> m_labelsData;
   /** data for prediction*/
-  std::vector<std::vector<double>>
-      m_predictionData; // try with float see how it goes
+  std::shared_ptr<Dataset> m_predictionData;
   /** labels to check prediction*/
-  std::vector<std::vector<double>> m_labelsPredictionData;
+  std::shared_ptr<Dataset> m_labelsPredictionData;
 };
 
 #endif // _NEURAL_NETWORK_H
\ No newline at end of file
@@ -0,0 +1,356 @@
+#include "optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "simd.h"
+#include "threadPool.h"
+
+namespace {
+
+/** Weight values updated by one task.*/
+constexpr int kMinValuesPerTask = 1 << 14;
+
+/** Everything one row update needs, fixed for a step.*/
+struct StepParameters {
+  OptimizerType type;
+  /** Learning rate, with the Adam bias correction.*/
+  Scalar rate;
+  Scalar momentum;
+  Scalar beta1;
+  Scalar beta2;
+  Scalar epsilon;
+  /** Turns the summed gradient into the mean one.*/
+  Scalar scale;
+  /** Part of the batch a Hogwild slice holds, 1 for a whole batch.*/
+  Scalar share;
+};
+
+/** The settings of a step in the type of the weights, the kernels then
+ * stay in that type.*/
+StepParameters makeStep(const OptimizerOptions &options, double rate,
+                        double scale, double share = 1.0) {
+  return {options.type,
+          static_cast<Scalar>(rate),
+          static_cast<Scalar>(options.momentum),
+          static_cast<Scalar>(options.beta1),
+          static_cast<Scalar>(options.beta2),
+          static_cast<Scalar>(options.epsilon),
+          static_cast<Scalar>(scale),
+          static_cast<Scalar>(share)};
+}
+
+/** One pass over a row: gradient in, state and weight updated.*/
+template <OptimizerType Type>
+NN_ALWAYS_INLINE void updateKernel(const StepParameters &step,
+                                   Scalar *__restrict weights,
+                                   Scalar *__restrict first,
+                                   Scalar *__restrict second,
+                                   const Scalar *__restrict delta,
+                                   int columns) {
+  for (int c = 0; c < columns; ++c) {
+    const Scalar gradient = delta[c] * step.scale;
+    if constexpr (Type == OptimizerType::Adam) {
+      const Scalar mean = step.beta1 * first[c] + (1 - step.beta1) * gradient;
+      const Scalar square =
+          step.beta2 * second[c] + (1 - step.beta2) * gradient * gradient;
+      first[c] = mean;
+      second[c] = square;
+      // The square is never negative. This file is compiled without errno
+      // for math functions, so the root does not stop vectorization.
+      weights[c] -= step.rate * mean / (std::sqrt(square) + step.epsilon);
+    } else {
+      const Scalar velocity = step.momentum * first[c] - step.rate * gradient;
+      first[c] = velocity;
+      if constexpr (Type == OptimizerType::Nesterov) {
+        weights[c] += step.momentum * velocity - step.rate * gradient;
+      } else {
+        weights[c] += velocity;
+      }
+    }
+  }
+}
+
+template <OptimizerType Type>
+NN_ALWAYS_INLINE void decayKernel(const StepParameters &step,
+                                  Scalar *__restrict weights,
+                                  Scalar *__restrict first,
+                                  Scalar *__restrict second, int columns) {
+  for (int c = 0; c < columns; ++c) {
+    if constexpr (Type == OptimizerType::Adam) {
+      first[c] *= step.beta1;
+      second[c] *= step.beta2;
+    } else {
+      // The part of the step that comes from the velocity of the batch
+      // before, the slices then add the parts of their gradients.
+      const Scalar velocity = step.momentum * first[c];
+      first[c] = velocity;
+      weights[c] += Type == OptimizerType::Nesterov ? step.momentum * velocity
+                                                    : velocity;
+    }
+  }
+}
+
+/** Hogwild rows are read and written by several threads, each value with
+ * one relaxed atomic access.*/
+NN_ALWAYS_INLINE Scalar load(const Scalar *value) {
+  Scalar result;
+  __atomic_load(value, &result, __ATOMIC_RELAXED);
+  return result;
+}
+
+NN_ALWAYS_INLINE void store(Scalar *target, Scalar value) {
+  __atomic_store(target, &value, __ATOMIC_RELAXED);
+}
+
+/** The part of one Hogwild slice in a step whose decay is already done.
+ * Together the slices add the gradient of the whole batch once.*/
+template <OptimizerType Type>
+NN_ALWAYS_INLINE void sharedKernel(const StepParameters &step,
+                                   Scalar *weights, Scalar *first,
+                                   Scalar *second, const Scalar *delta,
+                                   int columns) {
+  for (int c = 0; c < columns; ++c) {
+    // Sum of the slice over the samples of the whole batch.
+    const Scalar gradient = delta[c] * step.scale;
+    if constexpr (Type == OptimizerType::Adam) {
+      // The square of the mean of the slice, weighted by its share.
+      const Scalar mean = load(first + c) + (1 - step.beta1) * gradient;
+      const Scalar square = load(second + c) + (1 - step.beta2) * gradient *
+                                                   gradient / step.share;
+      store(first + c, mean);
+      store(second + c, square);
+      store(weights + c,
+            load(weights + c) - step.share * step.rate * mean /
+                                    (std::sqrt(square) + step.epsilon));
+    } else {
+      const Scalar change = -step.rate * gradient;
+      store(first + c, load(first + c) + change);
+      store(weights + c,
+            load(weights + c) + (Type == OptimizerType::Nesterov
+                                     ? (1 + step.momentum) * change
+                                     : change));
+    }
+  }
+}
+
+NN_ALWAYS_INLINE void updateAny(const StepParameters &step, Scalar *weights,
+                                Scalar *first, Scalar *second,
+                                const Scalar *delta, int columns) {
+  switch (step.type) {
+  case OptimizerType::Adam:
+    updateKernel<OptimizerType::Adam>(step, weights, first, second, delta,
+                                      columns);
+    break;
+  case OptimizerType::Nesterov:
+    updateKernel<OptimizerType::Nesterov>(step, weights, first, second,
+                                          delta, columns);
+    break;
+  default:
+    updateKernel<OptimizerType::Sgd>(step, weights, first, second, delta,
+                                     columns);
+    break;
+  }
+}
+
+#if NN_X86
+NN_TARGET("avx512f")
+void updateAvx512(const StepParameters &step, Scalar *weights, Scalar *first,
+                  Scalar *second, const Scalar *delta, int columns) {
+  updateAny(step, weights, first, second, delta, columns);
+}
+
+NN_TARGET("avx2,fma")
+void updateAvx2(const StepParameters &step, Scalar *weights, Scalar *first,
+                Scalar *second, const Scalar *delta, int columns) {
+  updateAny(step, weights, first, second, delta, columns);
+}
+#endif
+
+void updateGeneric(const StepParameters &step, Scalar *weights,
+                   Scalar *first, Scalar *second, const Scalar *delta,
+                   int columns) {
+  updateAny(step, weights, first, second, delta, columns);
+}
+
+using UpdateFunction = void (*)(const StepParameters &, Scalar *, Scalar *,
+                                Scalar *, const Scalar *, int);
+
+UpdateFunction selectKernel() {
+  switch (Simd::getLevel()) {
+#if NN_X86
+  case SimdLevel::Avx512:
+    return updateAvx512;
+  case SimdLevel::Avx2:
+    return updateAvx2;
+#endif
+  default:
+    return updateGeneric;
+  }
+}
+
+} // namespace
+
+Optimizer::Optimizer(const OptimizerOptions &options,
+                     const std::vector<std::shared_ptr<Matrix>> &weights)
+    : m_options(options), m_weightMatrices(weights), m_steps(0),
+      m_stepRate(options.learningRate) {
+  const int states = getNumberOfStates(m_options.type);
+  for (int s = 0; s < states; ++s) {
+    for (const auto &matrix : m_weightMatrices) {
+      m_state.push_back(std::make_shared<Matrix>(
+          matrix->getNumberOfRows(), matrix->getNumberOfColumns(), false));
+    }
+  }
+}
+
+OptimizerType Optimizer::typeFromString(const std::string &name) {
+  if (name.empty() || name == "sgd") {
+    return OptimizerType::Sgd;
+  } else if (name == "nesterov") {
+    return OptimizerType::Nesterov;
+  } else if (name == "adam") {
+    return OptimizerType::Adam;
+  }
+  throw std::runtime_error("Invalid optimizer: " + name);
+}
+
+int Optimizer::getNumberOfStates(OptimizerType type) {
+  return type == OptimizerType::Adam ? 2 : 1;
+}
+
+void Optimizer::nextStep() {
+  ++m_steps;
+  if (m_options.type == OptimizerType::Adam) {
+    const double steps = static_cast<double>(m_steps);
+    m_stepRate = m_options.learningRate *
+                 std::sqrt(1.0 - std::pow(m_options.beta2, steps)) /
+                 (1.0 - std::pow(m_options.beta1, steps));
+  }
+}
+
+void Optimizer::update(int index, const Matrix &delta, double scale) {
+  const int columns = m_weightMatrices.at(index)->getNumberOfColumns();
+  ThreadPool::getInstance().parallelFor(
+      0, m_weightMatrices.at(index)->getNumberOfRows(),
+      std::max(1, kMinValuesPerTask / columns),
+      [&](int rowBegin, int rowEnd) {
+        updateRows(index, rowBegin, rowEnd, delta, scale);
+      });
+}
+
+void Optimizer::updateRows(int index, int rowBegin, int rowEnd,
+                           const Matrix &delta, double scale) {
+  static const UpdateFunction kernel = selectKernel();
+  const StepParameters step = makeStep(m_options, m_stepRate, scale);
+  Matrix &weights = *m_weightMatrices[index];
+  Matrix &first = *m_state[index];
+  // Sgd and Nesterov have no second state.
+  Matrix &second = m_state.size() > m_weightMatrices.size()
+                       ? *m_state[m_weightMatrices.size() + index]
+                       : first;
+  for (int r = rowBegin; r < rowEnd; ++r) {
+    kernel(step, weights.row(r).data(), first.row(r).data(),
+           second.row(r).data(), delta.row(r).data(),
+           weights.getNumberOfColumns());
+  }
+}
+
+void Optimizer::beginShared() {
+  if (m_options.type == OptimizerType::Sgd && m_options.momentum == 0.0) {
+    // Nothing carries over from the batch before.
+    return;
+  }
+  const StepParameters step = makeStep(m_options, m_stepRate, 1.0);
+  for (std::size_t index = 0; index < m_weightMatrices.size(); ++index) {
+    Matrix &weights = *m_weightMatrices[index];
+    Matrix &first = *m_state[index];
+    Matrix &second = m_state.size() > m_weightMatrices.size()
+                         ? *m_state[m_weightMatrices.size() + index]
+                         : first;
+    const int columns = weights.getNumberOfColumns();
+    ThreadPool::getInstance().parallelFor(
+        0, weights.getNumberOfRows(), std::max(1, kMinValuesPerTask / columns),
+        [&](int rowBegin, int rowEnd) {
+          for (int r = rowBegin; r < rowEnd; ++r) {
+            Scalar *w = weights.row(r).data();
+            Scalar *f = first.row(r).data();
+            Scalar *s = second.row(r).data();
+            switch (step.type) {
+            case OptimizerType::Adam:
+              decayKernel<OptimizerType::Adam>(step, w, f, s, columns);
+              break;
+            case OptimizerType::Nesterov:
+              decayKernel<OptimizerType::Nesterov>(step, w, f, s, columns);
+              break;
+            default:
+              decayKernel<OptimizerType::Sgd>(step, w, f, s, columns);
+              break;
+            }
+          }
+        });
+  }
+}
+
+void Optimizer::updateShared(int index, const Matrix &delta, double scale,
+                             double share) {
+  const StepParameters step = makeStep(m_options, m_stepRate, scale, share);
+  Matrix &weights = *m_weightMatrices[index];
+  Matrix &first = *m_state[index];
+  Matrix &second = m_state.size() > m_weightMatrices.size()
+                       ? *m_state[m_weightMatrices.size() + index]
+                       : first;
+  for (int r = 0; r < weights.getNumberOfRows(); ++r) {
+    Scalar *w = weights.row(r).data();
+    Scalar *f = first.row(r).data();
+    Scalar *s = second.row(r).data();
+    const Scalar *d = delta.row(r).data();
+    switch (step.type) {
+    case OptimizerType::Adam:
+      sharedKernel<OptimizerType::Adam>(step, w, f, s, d,
+                                        weights.getNumberOfColumns());
+      break;
+    case OptimizerType::Nesterov:
+      sharedKernel<OptimizerType::Nesterov>(step, w, f, s, d,
+                                            weights.getNumberOfColumns());
+      break;
+    default:
+      sharedKernel<OptimizerType::Sgd>(step, w, f, s, d,
+                                       weights.getNumberOfColumns());
+      break;
+    }
+  }
+}
+
+std::vector<std::shared_ptr<Matrix>> Optimizer::getState() const {
+  return m_state;
+}
+
+void Optimizer::setState(const std::vector<std::shared_ptr<Matrix>> &state,
+                         std::uint64_t steps) {
+  if (state.size() != m_state.size()) {
+    throw std::runtime_error("Optimizer state does not fit the optimizer.");
+  }
+  for (std::size_t i = 0; i < state.size(); ++i) {
+    const Matrix &source = *state[i];
+    Matrix &target = *m_state[i];
+    if (source.getNumberOfRows() != target.getNumberOfRows() ||
+        source.getNumberOfColumns() != target.getNumberOfColumns()) {
+      throw std::runtime_error("Optimizer state does not fit the weights.");
+    }
+    for (int row = 0; row < source.getNumberOfRows(); ++row) {
+      std::copy(source.row(row).data(),
+                source.row(row).data() + source.getNumberOfColumns(),
+                target.row(row).data());
+    }
+  }
+  m_steps = steps;
+  if (m_steps > 0) {
+    // The rate of the last step, the next nextStep() moves on from here.
+    --m_steps;
+    nextStep();
+  }
+}
+
+OptimizerType Optimizer::getType() const { return m_options.type; }
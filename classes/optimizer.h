@@ -0,0 +1,162 @@
+#ifndef _OPTIMIZER_H
+#define _OPTIMIZER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "matrix.h"
+
+/** Rules that turn the gradient of a batch into a weight update.*/
+enum class OptimizerType {
+  /** Gradient descent with a velocity, v = momentum * v - rate * g and
+   * W += v. Momentum 0 is plain gradient descent.*/
+  Sgd,
+  /** Like Sgd, but the gradient is taken where the velocity leads,
+   * W += momentum * v - rate * g with the new v.*/
+  Nesterov,
+  /** Adam, moving averages of the gradient and of its square scale the
+   * step of every weight on its own.*/
+  Adam
+};
+
+/** Settings of the optimizer from the config file.*/
+struct OptimizerOptions {
+  OptimizerType type = OptimizerType::Sgd;
+  double learningRate = 0.001;
+  /** Velocity kept from the last step, Sgd and Nesterov.*/
+  double momentum = 0.9;
+  /** Decay of the mean gradient, Adam.*/
+  double beta1 = 0.9;
+  /** Decay of the mean squared gradient, Adam.*/
+  double beta2 = 0.999;
+  /** Keeps the Adam step finite where the squared gradient is zero.*/
+  double epsilon = 1e-8;
+};
+
+/**
+ * @brief Updates the weight matrices of a network from the summed gradient
+ * of a batch. Every weight matrix has its state matrices, shaped and
+ * aligned like it, so one pass over a row reads the gradient, updates the
+ * state and writes the weight, in vector registers.
+ */
+class Optimizer {
+public:
+  /**
+   * @brief Construct a new Optimizer object over the weights of a network,
+   * with all state zero.
+   *
+   * @param options optimizer and its settings.
+   * @param weights weight matrices, updated in place.
+   */
+  Optimizer(const OptimizerOptions &options,
+            const std::vector<std::shared_ptr<Matrix>> &weights);
+
+  /**
+   * @brief Get the optimizer from its name in the config file.
+   *
+   * @param name "" or "sgd", "nesterov" or "adam".
+   * @return OptimizerType optimizer.
+   * @throws std::runtime_error for any other name.
+   */
+  static OptimizerType typeFromString(const std::string &name);
+
+  /**
+   * @brief Get the number of state matrices per weight matrix.
+   *
+   * @param type optimizer.
+   * @return int 1 for Sgd and Nesterov, 2 for Adam.
+   */
+  static int getNumberOfStates(OptimizerType type);
+
+  /**
+   * @brief Start a new training step, once per batch before its updates.
+   *
+   */
+  void nextStep();
+
+  /**
+   * @brief Update one weight matrix, its rows are spread over the threads.
+   *
+   * @param index weight matrix.
+   * @param delta gradient summed over the batch, shaped like the weights.
+   * @param scale 1 / samples in the batch.
+   */
+  void update(int index, const Matrix &delta, double scale);
+
+  /**
+   * @brief Update rows [rowBegin, rowEnd) of one weight matrix.
+   *
+   * @param index weight matrix.
+   * @param rowBegin first row.
+   * @param rowEnd row after the last.
+   * @param delta gradient summed over the batch, shaped like the weights.
+   * @param scale 1 / samples in the batch.
+   */
+  void updateRows(int index, int rowBegin, int rowEnd, const Matrix &delta,
+                  double scale);
+
+  /**
+   * @brief Apply the part of a Hogwild step that does not depend on the
+   * gradient: the decay of the velocity, with the weight change it gives,
+   * or of the Adam moments. Once per batch, after nextStep() and before
+   * the slices call updateShared().
+   *
+   */
+  void beginShared();
+
+  /**
+   * @brief Update one weight matrix while other threads update it too.
+   * Every value is read and written once without a lock, updates that
+   * overlap can be lost, as Hogwild accepts. The slices of a batch
+   * together take one step: for Sgd and Nesterov the same as update(),
+   * for Adam the moments and the step are split by the share of each
+   * slice.
+   *
+   * @param index weight matrix.
+   * @param delta gradient summed over the slice, shaped like the weights.
+   * @param scale 1 / samples in the whole batch.
+   * @param share samples in the slice / samples in the whole batch.
+   */
+  void updateShared(int index, const Matrix &delta, double scale,
+                    double share);
+
+  /**
+   * @brief Get the state, state s of weight matrix i at index
+   * s * weights + i, as CheckpointData holds it.
+   *
+   * @return std::vector<std::shared_ptr<Matrix>> state matrices.
+   */
+  std::vector<std::shared_ptr<Matrix>> getState() const;
+
+  /**
+   * @brief Continue from a saved state.
+   *
+   * @param state matrices in the order of getState().
+   * @param steps training steps taken with that state.
+   * @throws std::runtime_error when the state does not fit the weights.
+   */
+  void setState(const std::vector<std::shared_ptr<Matrix>> &state,
+                std::uint64_t steps);
+
+  /**
+   * @brief Get the optimizer type.
+   *
+   * @return OptimizerType optimizer.
+   */
+  OptimizerType getType() const;
+
+private:
+  OptimizerOptions m_options;
+  /** Weight matrices of the network, updated in place.*/
+  std::vector<std::shared_ptr<Matrix>> m_weightMatrices;
+  /** State s of weight matrix i at s * weights + i.*/
+  std::vector<std::shared_ptr<Matrix>> m_state;
+  /** Training steps taken, for the bias correction of Adam.*/
+  std::uint64_t m_steps;
+  /** Learning rate of the current step, with the Adam bias correction.*/
+  double m_stepRate;
+};
+
+#endif // _OPTIMIZER_H
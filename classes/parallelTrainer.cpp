@@ -0,0 +1,253 @@
+#include "parallelTrainer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+#include "gemm.h"
+#include "threadPool.h"
+
+namespace {
+
+/** Weight values updated by one task of the reduction.*/
+constexpr int kMinValuesPerTask = 1 << 14;
+
+} // namespace
+
+ParallelTrainer::ParallelTrainer(
+    const std::vector<int> &topology,
+    const std::vector<ActivationType> &activations,
+    const std::vector<std::shared_ptr<Matrix>> &weights, double bias,
+    int batchSize, TrainingMode mode, std::shared_ptr<Optimizer> optimizer,
+    double sparseInputThreshold, HalfType halfType)
+    : m_topology(topology), m_activations(activations),
+      m_weightMatrices(weights), m_bias(bias), m_mode(mode),
+      m_optimizer(std::move(optimizer)),
+      m_sparseInputThreshold(sparseInputThreshold) {
+  if (halfType != HalfType::None) {
+    m_halfWeights.assign(m_weightMatrices.size(), HalfMatrix(halfType));
+  }
+  const int threads = ThreadPool::getInstance().getNumberOfThreads();
+  const int rows = (std::max(1, batchSize) + threads - 1) / threads;
+  m_shards.resize(threads);
+  for (TrainingShard &shard : m_shards) {
+    for (std::size_t i = 0; i < m_topology.size(); ++i) {
+      const int neurons = i == 0 ? 0 : m_topology.at(i);
+      shard.values.emplace_back(rows, neurons, false);
+      shard.activated.emplace_back(rows, neurons, false);
+      shard.derived.emplace_back(rows, neurons, false);
+      shard.gradients.emplace_back(rows, neurons, false);
+    }
+    for (std::size_t i = 0; i + 1 < m_topology.size(); ++i) {
+      shard.deltaWeights.emplace_back(m_topology.at(i), m_topology.at(i + 1),
+                                      false);
+    }
+  }
+}
+
+TrainingMode ParallelTrainer::modeFromString(const std::string &name) {
+  if (name.empty() || name == "serial") {
+    return TrainingMode::Serial;
+  } else if (name == "dataParallel") {
+    return TrainingMode::DataParallel;
+  } else if (name == "hogwild") {
+    return TrainingMode::Hogwild;
+  }
+  throw std::runtime_error("Invalid training mode: " + name);
+}
+
+double ParallelTrainer::step(const Batch &batch) {
+  const int rows = batch.inputs.getNumberOfRows();
+  if (batch.inputs.getNumberOfColumns() != m_topology.front()) {
+    throw std::runtime_error(
+        "Input size is not the same as the INPUT LAYER SIZE.");
+  }
+  if (batch.targets.getNumberOfColumns() != m_topology.back()) {
+    throw std::runtime_error(
+        "Target size is not the same as the output LAYER SIZE.");
+  }
+  if (rows == 0) {
+    return 0.0;
+  }
+  m_optimizer->nextStep();
+  if (m_mode == TrainingMode::Hogwild) {
+    m_optimizer->beginShared();
+  }
+  // The copies are rounded once per step, hogwild shards read the weights
+  // of the step before and not the updates of the other shards.
+  for (std::size_t i = 0; i < m_halfWeights.size(); ++i) {
+    m_halfWeights[i].assign(*m_weightMatrices[i]);
+  }
+  // Every shard gets at least one sample.
+  const int shards = std::min(rows, static_cast<int>(m_shards.size()));
+  ThreadPool::getInstance().parallelFor(0, shards, 1, [&](int begin,
+                                                          int end) {
+    for (int s = begin; s < end; ++s) {
+      const int first = static_cast<int>(static_cast<long>(rows) * s / shards);
+      const int last =
+          static_cast<int>(static_cast<long>(rows) * (s + 1) / shards);
+      trainShard(m_shards[s], batch, first, last - first);
+    }
+  });
+  m_phaseSeconds = m_shards[0].phaseSeconds;
+  if (m_mode == TrainingMode::DataParallel) {
+    const auto start = std::chrono::steady_clock::now();
+    reduceAndUpdate(shards, 1.0 / rows);
+    m_phaseSeconds[static_cast<std::size_t>(TrainingPhase::WeightUpdate)] +=
+        TrainingMetrics::getSecondsSince(start);
+  }
+
+  double error = 0.0;
+  for (int s = 0; s < shards; ++s) {
+    error += m_shards[s].error;
+  }
+  return error / rows;
+}
+
+const PhaseSeconds &ParallelTrainer::getPhaseSeconds() const {
+  return m_phaseSeconds;
+}
+
+void ParallelTrainer::trainShard(TrainingShard &shard, const Batch &batch,
+                                 int first, int count) {
+  const std::size_t layers = m_topology.size();
+  const Scalar *inputs = batch.inputs.row(first).data();
+  const int inputStride = batch.inputs.getStride();
+  PhaseSeconds &phases = shard.phaseSeconds;
+  phases.fill(0.0);
+  const Scalar bias = static_cast<Scalar>(m_bias);
+  auto start = std::chrono::steady_clock::now();
+
+  // Forward, the input layer is used as it is, or without its zeros.
+  const bool isSparseInput = shard.sparseInput.compress(
+      inputs, count, m_topology[0], inputStride, m_sparseInputThreshold);
+  for (std::size_t i = 1; i < layers; ++i) {
+    Matrix &values = shard.values[i];
+    values.resize(count, m_topology[i]);
+    shard.activated[i].resize(count, m_topology[i]);
+    shard.derived[i].resize(count, m_topology[i]);
+    const Matrix &weights = *m_weightMatrices[i - 1];
+    const GemmOperand left =
+        i == 1 ? GemmOperand{inputs, inputStride, 1}
+               : GemmOperand{shard.activated[i - 1].data(),
+                             shard.activated[i - 1].getStride(), 1};
+    if (!m_halfWeights.empty()) {
+      HalfMatrix::multiply(left.data, count, left.rowStride,
+                           m_halfWeights[i - 1], values);
+    } else if (i == 1 && isSparseInput) {
+      SparseMatrix::multiply(shard.sparseInput, weights, values);
+    } else {
+      Gemm::multiply(count, m_topology[i], m_topology[i - 1], 1.0, left,
+                     {weights.data(), weights.getStride(), 1}, 0.0,
+                     values.data(), values.getStride());
+    }
+    const std::size_t size =
+        static_cast<std::size_t>(count) * values.getStride();
+    Scalar *data = values.data();
+    for (std::size_t v = 0; v < size; ++v) {
+      data[v] += bias;
+    }
+    Activation::apply(m_activations[i], data, shard.activated[i].data(),
+                      shard.derived[i].data(), size);
+  }
+
+  phases[static_cast<std::size_t>(TrainingPhase::FeedForward)] =
+      TrainingMetrics::getSecondsSince(start);
+  start = std::chrono::steady_clock::now();
+
+  // Error and gradient at the output layer, as in setErrors.
+  const std::size_t out = layers - 1;
+  const Matrix &output = shard.activated[out];
+  Matrix &outputGradient = shard.gradients[out];
+  outputGradient.resize(count, m_topology[out]);
+  shard.error = 0.0;
+  for (int row = 0; row < count; ++row) {
+    auto target = batch.targets.row(first + row);
+    for (int j = 0; j < m_topology[out]; ++j) {
+      const double difference = output(row, j) - target[j];
+      shard.error += 0.5 * difference * difference;
+      outputGradient(row, j) = shard.derived[out](row, j) * 2.0 * difference;
+    }
+  }
+
+  phases[static_cast<std::size_t>(TrainingPhase::SetErrors)] =
+      TrainingMetrics::getSecondsSince(start);
+  start = std::chrono::steady_clock::now();
+  double updateSeconds = 0.0;
+
+  // Backward, as in NeuralNetwork::backPropagation but on the slice.
+  for (std::size_t i = out; i-- > 0;) {
+    const Matrix &gradient = shard.gradients[i + 1];
+    const Matrix &weights = *m_weightMatrices[i];
+    Matrix &delta = shard.deltaWeights[i];
+    // left^T * gradient, the transpose is only a swap of the strides.
+    const GemmOperand leftTransposed =
+        i == 0 ? GemmOperand{inputs, 1, inputStride}
+               : GemmOperand{shard.activated[i].data(), 1,
+                             shard.activated[i].getStride()};
+    if (i == 0 && isSparseInput) {
+      SparseMatrix::multiplyTransposedLeft(shard.sparseInput, gradient,
+                                           delta);
+    } else {
+      Gemm::multiply(m_topology[i], m_topology[i + 1], count, 1.0,
+                     leftTransposed,
+                     {gradient.data(), gradient.getStride(), 1}, 0.0,
+                     delta.data(), delta.getStride());
+    }
+
+    if (i > 0) {
+      // gradient * W^T, flows back through the weights before they change.
+      Matrix &leftGradient = shard.gradients[i];
+      leftGradient.resize(count, m_topology[i]);
+      Gemm::multiply(count, m_topology[i], m_topology[i + 1], 1.0,
+                     {gradient.data(), gradient.getStride(), 1},
+                     {weights.data(), 1, weights.getStride()}, 0.0,
+                     leftGradient.data(), leftGradient.getStride());
+      Scalar *g = leftGradient.data();
+      const Scalar *activated = shard.activated[i].data();
+      const std::size_t size =
+          static_cast<std::size_t>(count) * leftGradient.getStride();
+      for (std::size_t v = 0; v < size; ++v) {
+        g[v] *= activated[v];
+      }
+    }
+    if (m_mode == TrainingMode::Hogwild) {
+      const auto updateStart = std::chrono::steady_clock::now();
+      // The slices of the batch share one step.
+      const double batchRows = batch.inputs.getNumberOfRows();
+      m_optimizer->updateShared(i, delta, 1.0 / batchRows, count / batchRows);
+      updateSeconds += TrainingMetrics::getSecondsSince(updateStart);
+    }
+  }
+  phases[static_cast<std::size_t>(TrainingPhase::BackPropagation)] =
+      TrainingMetrics::getSecondsSince(start) - updateSeconds;
+  phases[static_cast<std::size_t>(TrainingPhase::WeightUpdate)] =
+      updateSeconds;
+}
+
+void ParallelTrainer::reduceAndUpdate(int shards, double scale) {
+  for (std::size_t i = 0; i < m_weightMatrices.size(); ++i) {
+    Matrix &weights = *m_weightMatrices[i];
+    const int columns = weights.getNumberOfColumns();
+    ThreadPool::getInstance().parallelFor(
+        0, weights.getNumberOfRows(), std::max(1, kMinValuesPerTask / columns),
+        [&](int rowBegin, int rowEnd) {
+          for (int r = rowBegin; r < rowEnd; ++r) {
+            // Tree over the shards, the sum ends up in shard 0.
+            for (int distance = 1; distance < shards; distance *= 2) {
+              for (int s = 0; s + distance < shards; s += 2 * distance) {
+                Scalar *sum = m_shards[s].deltaWeights[i].row(r).data();
+                const Scalar *other =
+                    m_shards[s + distance].deltaWeights[i].row(r).data();
+                for (int c = 0; c < columns; ++c) {
+                  sum[c] += other[c];
+                }
+              }
+            }
+            m_optimizer->updateRows(i, r, r + 1, m_shards[0].deltaWeights[i],
+                                    scale);
+          }
+        });
+  }
+}
@@ -0,0 +1,145 @@
+#ifndef _PARALLEL_TRAINER_H
+#define _PARALLEL_TRAINER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "activation.h"
+#include "batchLoader.h"
+#include "halfMatrix.h"
+#include "matrix.h"
+#include "optimizer.h"
+#include "sparseMatrix.h"
+#include "trainingMetrics.h"
+
+/** How a batch is spread over the threads during training.*/
+enum class TrainingMode {
+  /** One batch at a time, only the matrix kernels are parallel.*/
+  Serial,
+  /** Every thread trains a slice of the batch, the weight deltas of all
+   * slices are summed before one update.*/
+  DataParallel,
+  /** Every thread trains a slice of the batch and updates the shared
+   * weights on its own, without locks.*/
+  Hogwild
+};
+
+/** Buffers of the thread that trains one slice of a batch.*/
+struct TrainingShard {
+  /** Values at the neurons of every layer, index 0 is not used.*/
+  std::vector<Matrix> values;
+  /** Activated values of every layer, index 0 is not used.*/
+  std::vector<Matrix> activated;
+  /** Derived values of every layer, index 0 is not used.*/
+  std::vector<Matrix> derived;
+  /** Gradient at every layer, index 0 is not used.*/
+  std::vector<Matrix> gradients;
+  /** Delta of every weight matrix from the samples of this slice.*/
+  std::vector<Matrix> deltaWeights;
+  /** Non zero values of the slice, when it is sparse enough.*/
+  SparseMatrix sparseInput;
+  /** Sum of the errors of the samples of this slice.*/
+  double error = 0.0;
+  /** Time spent in every phase of the last step.*/
+  PhaseSeconds phaseSeconds{};
+};
+
+/**
+ * @brief Trains the network with its batches split across the threads.
+ * Each thread runs the forward and backward pass for its slice of the
+ * batch with its own buffers. All threads read the same weight matrices.
+ * The result is the same training step as NeuralNetwork::backPropagation,
+ * only the order of the sums differs.
+ */
+class ParallelTrainer {
+public:
+  /**
+   * @brief Construct a new Parallel Trainer object over the weights of a
+   * network, which it updates in place.
+   *
+   * @param topology number of neurons in each layer.
+   * @param activations activation function of each layer.
+   * @param weights (topology - 1) weight matrices, shared.
+   * @param bias added to every neuron after the input layer.
+   * @param batchSize largest number of samples in a batch.
+   * @param mode DataParallel or Hogwild.
+   * @param optimizer updates the weights, shared with the network.
+   * @param sparseInputThreshold share of non zero inputs below which the
+   * first layer works on the sparse slice, 0 for never.
+   * @param halfType the forward pass multiplies with 16 bit copies of the
+   * weights, HalfType::None with the weights themselves.
+   */
+  ParallelTrainer(const std::vector<int> &topology,
+                  const std::vector<ActivationType> &activations,
+                  const std::vector<std::shared_ptr<Matrix>> &weights,
+                  double bias, int batchSize, TrainingMode mode,
+                  std::shared_ptr<Optimizer> optimizer,
+                  double sparseInputThreshold,
+                  HalfType halfType = HalfType::None);
+
+  /**
+   * @brief Train on one batch, the optimizer updates the weights with the
+   * gradient averaged over the samples.
+   *
+   * @param batch samples and targets.
+   * @return double error of one sample, averaged over the batch.
+   */
+  double step(const Batch &batch);
+
+  /**
+   * @brief Get the training mode from its name in the config file.
+   *
+   * @param name "" or "serial", "dataParallel" or "hogwild".
+   * @return TrainingMode training mode.
+   * @throws std::runtime_error for any other name.
+   */
+  static TrainingMode modeFromString(const std::string &name);
+
+  /**
+   * @brief Get the time spent in every phase of the last step. The forward
+   * and backward phases are those of the first slice, the weight update
+   * includes the reduction over the slices.
+   *
+   * @return const PhaseSeconds& seconds per phase.
+   */
+  const PhaseSeconds &getPhaseSeconds() const;
+
+private:
+  /**
+   * @brief Forward and backward pass over rows [first, first + count) of
+   * the batch. Hogwild applies the deltas right away.
+   */
+  void trainShard(TrainingShard &shard, const Batch &batch, int first,
+                  int count);
+
+  /**
+   * @brief Sum the deltas of the first shards in a tree, pairs of
+   * neighbours first, and update the weights with the sum. Rows of the
+   * weight matrices are spread over the threads.
+   */
+  void reduceAndUpdate(int shards, double scale);
+
+  /** Number of neurons in each layer.*/
+  std::vector<int> m_topology;
+  /** Activation function of each layer.*/
+  std::vector<ActivationType> m_activations;
+  /** Weight matrices of the network, updated in place.*/
+  std::vector<std::shared_ptr<Matrix>> m_weightMatrices;
+  /** Added to every neuron after the input layer.*/
+  double m_bias;
+  TrainingMode m_mode;
+  /** Updates the weights, shared with the network.*/
+  std::shared_ptr<Optimizer> m_optimizer;
+  /** Share of non zero inputs below which a slice is used sparse.*/
+  double m_sparseInputThreshold;
+  /** 16 bit copies of the weights for the forward pass, rounded again at
+   * the start of every step. Empty when the weights are used.*/
+  std::vector<HalfMatrix> m_halfWeights;
+  /** One shard per thread.*/
+  std::vector<TrainingShard> m_shards;
+  /** Time spent in every phase of the last step.*/
+  PhaseSeconds m_phaseSeconds{};
+};
+
+#endif // _PARALLEL_TRAINER_H
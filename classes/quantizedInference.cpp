@@ -0,0 +1,331 @@
+#include "quantizedInference.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "simd.h"
+#include "threadPool.h"
+
+#if NN_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/** Weight rows are padded to a multiple of this many values, one AVX-512
+ * register of bytes.*/
+constexpr int kPadding = 64;
+/** Largest stored weight, -127..127 keeps the range symmetric.*/
+constexpr double kWeightLimit = 127.0;
+/** Integer operations below this many are not split across threads.*/
+constexpr double kMinParallelOperations = 1 << 18;
+
+/**
+ * Dot products of one row of 8 bit inputs with n rows of 8 bit weights,
+ * out[j] = sum(inputs[p] * weights[j * k + p]). k is a multiple of 64.
+ */
+using DotFunction = void (*)(const std::uint8_t *, const std::int8_t *, int,
+                             int, std::int32_t *);
+
+void dotGeneric(const std::uint8_t *inputs, const std::int8_t *weights,
+                int k, int n, std::int32_t *out) {
+  for (int j = 0; j < n; ++j) {
+    const std::int8_t *row = weights + static_cast<std::size_t>(j) * k;
+    std::int32_t sum = 0;
+    for (int p = 0; p < k; ++p) {
+      sum += static_cast<std::int32_t>(inputs[p]) * row[p];
+    }
+    out[j] = sum;
+  }
+}
+
+#if NN_X86
+// vpdpbusd multiplies unsigned by signed bytes and adds groups of four
+// straight into 32 bit sums, four weight rows share every input load.
+NN_TARGET("avx512f,avx512bw,avx512vnni")
+void dotVnni(const std::uint8_t *inputs, const std::int8_t *weights, int k,
+             int n, std::int32_t *out) {
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    const std::int8_t *row = weights + static_cast<std::size_t>(j) * k;
+    __m512i sum0 = _mm512_setzero_si512();
+    __m512i sum1 = _mm512_setzero_si512();
+    __m512i sum2 = _mm512_setzero_si512();
+    __m512i sum3 = _mm512_setzero_si512();
+    for (int p = 0; p < k; p += kPadding) {
+      const __m512i a = _mm512_loadu_si512(inputs + p);
+      sum0 = _mm512_dpbusd_epi32(sum0, a, _mm512_loadu_si512(row + p));
+      sum1 = _mm512_dpbusd_epi32(sum1, a, _mm512_loadu_si512(row + k + p));
+      sum2 =
+          _mm512_dpbusd_epi32(sum2, a, _mm512_loadu_si512(row + 2 * k + p));
+      sum3 =
+          _mm512_dpbusd_epi32(sum3, a, _mm512_loadu_si512(row + 3 * k + p));
+    }
+    out[j] = _mm512_reduce_add_epi32(sum0);
+    out[j + 1] = _mm512_reduce_add_epi32(sum1);
+    out[j + 2] = _mm512_reduce_add_epi32(sum2);
+    out[j + 3] = _mm512_reduce_add_epi32(sum3);
+  }
+  for (; j < n; ++j) {
+    const std::int8_t *row = weights + static_cast<std::size_t>(j) * k;
+    __m512i sum = _mm512_setzero_si512();
+    for (int p = 0; p < k; p += kPadding) {
+      sum = _mm512_dpbusd_epi32(sum, _mm512_loadu_si512(inputs + p),
+                                _mm512_loadu_si512(row + p));
+    }
+    out[j] = _mm512_reduce_add_epi32(sum);
+  }
+}
+
+// Bytes are widened to 16 bits first: vpmaddubsw would saturate on
+// 255 * 127 * 2, vpmaddwd of 16 bit values can not.
+NN_TARGET("avx2")
+NN_ALWAYS_INLINE __m256i dotStepAvx2(__m256i sum, const std::uint8_t *inputs,
+                                     const std::int8_t *row) {
+  const __m256i a = _mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(inputs)));
+  const __m256i w = _mm256_cvtepi8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(row)));
+  return _mm256_add_epi32(sum, _mm256_madd_epi16(a, w));
+}
+
+NN_TARGET("avx2")
+NN_ALWAYS_INLINE std::int32_t reduceAvx2(__m256i sum) {
+  __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                               _mm256_extracti128_si256(sum, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+  return _mm_cvtsi128_si32(half);
+}
+
+NN_TARGET("avx2")
+void dotAvx2(const std::uint8_t *inputs, const std::int8_t *weights, int k,
+             int n, std::int32_t *out) {
+  int j = 0;
+  for (; j + 2 <= n; j += 2) {
+    const std::int8_t *row = weights + static_cast<std::size_t>(j) * k;
+    __m256i sum0 = _mm256_setzero_si256();
+    __m256i sum1 = _mm256_setzero_si256();
+    for (int p = 0; p < k; p += 16) {
+      sum0 = dotStepAvx2(sum0, inputs + p, row + p);
+      sum1 = dotStepAvx2(sum1, inputs + p, row + k + p);
+    }
+    out[j] = reduceAvx2(sum0);
+    out[j + 1] = reduceAvx2(sum1);
+  }
+  for (; j < n; ++j) {
+    const std::int8_t *row = weights + static_cast<std::size_t>(j) * k;
+    __m256i sum = _mm256_setzero_si256();
+    for (int p = 0; p < k; p += 16) {
+      sum = dotStepAvx2(sum, inputs + p, row + p);
+    }
+    out[j] = reduceAvx2(sum);
+  }
+}
+#endif
+
+struct DotKernel {
+  const char *name;
+  DotFunction dot;
+};
+
+DotKernel selectKernel() {
+  const SimdLevel level = Simd::getLevel();
+#if NN_X86
+  if (level == SimdLevel::Avx512 && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vnni")) {
+    return {"avx512vnni", dotVnni};
+  }
+  if (level != SimdLevel::Generic) {
+    return {"avx2", dotAvx2};
+  }
+#endif
+  return {"generic", dotGeneric};
+}
+
+const DotKernel &getKernel() {
+  static const DotKernel kernel = selectKernel();
+  return kernel;
+}
+
+} // namespace
+
+QuantizedInference::QuantizedInference(const Inference &inference,
+                                       const Matrix &calibration)
+    : m_topology(inference.getTopology()), m_bias(inference.getBias()),
+      m_inputScale(inference.getInputScale()) {
+  const int samples = calibration.getNumberOfRows();
+  if (samples == 0) {
+    throw std::runtime_error("No samples to calibrate the quantization.");
+  }
+  // The trained network gives the range of the inputs of every layer.
+  InferenceBuffers calibrationBuffers = inference.createBuffers(samples);
+  inference.forward(calibration, calibrationBuffers);
+
+  const auto &weights = inference.getWeightMatrices();
+  for (std::size_t i = 0; i < weights.size(); ++i) {
+    const Matrix &matrix = *weights.at(i);
+    QuantizedLayer layer;
+    layer.inputs = matrix.getNumberOfRows();
+    layer.outputs = matrix.getNumberOfColumns();
+    layer.paddedInputs = (layer.inputs + kPadding - 1) / kPadding * kPadding;
+    layer.activation = inference.getActivations().at(i + 1);
+
+    // The range always includes zero, so zero is stored exactly.
+    const Matrix &inputs =
+        i == 0 ? calibration : calibrationBuffers.activated.at(i - 1);
+    double lowest = 0.0;
+    double highest = 0.0;
+    for (int row = 0; row < samples; ++row) {
+      auto values = inputs.row(row);
+      for (int column = 0; column < layer.inputs; ++column) {
+        lowest = std::min<double>(lowest, values[column]);
+        highest = std::max<double>(highest, values[column]);
+      }
+    }
+    if (i == 0) {
+      // The calibration samples are raw, the first layer sees them scaled.
+      lowest *= m_inputScale;
+      highest *= m_inputScale;
+      if (lowest > highest) {
+        std::swap(lowest, highest);
+      }
+    }
+    layer.inputScale = highest > lowest ? (highest - lowest) / 255.0 : 1.0;
+    layer.inputZeroPoint = static_cast<int>(
+        std::clamp(std::round(-lowest / layer.inputScale), 0.0, 255.0));
+
+    layer.weights.assign(
+        static_cast<std::size_t>(layer.outputs) * layer.paddedInputs, 0);
+    layer.weightScales.resize(layer.outputs);
+    layer.weightSums.resize(layer.outputs);
+    for (int j = 0; j < layer.outputs; ++j) {
+      auto column = matrix.column(j);
+      double largest = 0.0;
+      for (int p = 0; p < layer.inputs; ++p) {
+        largest = std::max<double>(largest, std::fabs(column[p]));
+      }
+      const double scale = largest > 0.0 ? largest / kWeightLimit : 1.0;
+      std::int8_t *row =
+          layer.weights.data() + static_cast<std::size_t>(j) *
+                                     layer.paddedInputs;
+      std::int32_t sum = 0;
+      for (int p = 0; p < layer.inputs; ++p) {
+        row[p] = static_cast<std::int8_t>(std::clamp(
+            std::round(column[p] / scale), -kWeightLimit, kWeightLimit));
+        sum += row[p];
+      }
+      layer.weightScales[j] = scale;
+      layer.weightSums[j] = sum;
+    }
+    m_layers.push_back(std::move(layer));
+  }
+}
+
+QuantizedBuffers QuantizedInference::createBuffers(int rows) const {
+  QuantizedBuffers buffers;
+  std::size_t inputs = 0;
+  std::size_t products = 0;
+  for (const QuantizedLayer &layer : m_layers) {
+    inputs = std::max(inputs, static_cast<std::size_t>(layer.paddedInputs));
+    products = std::max(products, static_cast<std::size_t>(layer.outputs));
+  }
+  buffers.inputs.resize(inputs * rows);
+  buffers.products.resize(products * rows);
+  for (std::size_t i = 1; i < m_topology.size(); ++i) {
+    buffers.layers.values.emplace_back(rows, m_topology.at(i), false);
+    buffers.layers.activated.emplace_back(rows, m_topology.at(i), false);
+  }
+  return buffers;
+}
+
+const Matrix &QuantizedInference::forward(const Matrix &inputs,
+                                          QuantizedBuffers &buffers) const {
+  if (inputs.getNumberOfColumns() != m_topology.front()) {
+    throw std::runtime_error(
+        "Input size is not the same as the INPUT LAYER SIZE.");
+  }
+  const int rows = inputs.getNumberOfRows();
+  if (buffers.layers.values.size() != m_layers.size()) {
+    buffers = createBuffers(rows);
+  }
+  const DotFunction dot = getKernel().dot;
+
+  const Matrix *left = &inputs;
+  for (std::size_t i = 0; i < m_layers.size(); ++i) {
+    const QuantizedLayer &layer = m_layers.at(i);
+    Matrix &values = buffers.layers.values.at(i);
+    Matrix &activated = buffers.layers.activated.at(i);
+    values.resize(rows, layer.outputs);
+    activated.resize(rows, layer.outputs);
+    // Buffers only grow, a smaller batch does not allocate.
+    const std::size_t quantizedSize =
+        static_cast<std::size_t>(rows) * layer.paddedInputs;
+    const std::size_t productsSize =
+        static_cast<std::size_t>(rows) * layer.outputs;
+    if (buffers.inputs.size() < quantizedSize) {
+      buffers.inputs.resize(quantizedSize);
+    }
+    if (buffers.products.size() < productsSize) {
+      buffers.products.resize(productsSize);
+    }
+
+    const double operations =
+        static_cast<double>(layer.paddedInputs) * layer.outputs;
+    const int grain = static_cast<int>(
+        std::max(1.0, std::ceil(kMinParallelOperations / operations)));
+    ThreadPool::getInstance().parallelFor(0, rows, grain, [&](int begin,
+                                                              int end) {
+      // The input scale of the network is folded into the first layer.
+      const double inverseScale =
+          (i == 0 ? m_inputScale : 1.0) / layer.inputScale;
+      for (int row = begin; row < end; ++row) {
+        auto source = left->row(row);
+        std::uint8_t *quantized =
+            buffers.inputs.data() +
+            static_cast<std::size_t>(row) * layer.paddedInputs;
+        for (int p = 0; p < layer.inputs; ++p) {
+          const double value =
+              std::round(source[p] * inverseScale) + layer.inputZeroPoint;
+          quantized[p] =
+              static_cast<std::uint8_t>(std::clamp(value, 0.0, 255.0));
+        }
+        // Padding meets zero weights, any value does.
+        std::fill(quantized + layer.inputs, quantized + layer.paddedInputs,
+                  0);
+
+        std::int32_t *products =
+            buffers.products.data() +
+            static_cast<std::size_t>(row) * layer.outputs;
+        dot(quantized, layer.weights.data(), layer.paddedInputs,
+            layer.outputs, products);
+        auto output = values.row(row);
+        for (int j = 0; j < layer.outputs; ++j) {
+          output[j] = layer.inputScale * layer.weightScales[j] *
+                          (products[j] - layer.inputZeroPoint *
+                                             layer.weightSums[j]) +
+                      m_bias;
+        }
+      }
+    });
+    Activation::apply(layer.activation, values.data(), activated.data(),
+                      nullptr,
+                      static_cast<std::size_t>(rows) * values.getStride());
+    left = &activated;
+  }
+  return *left;
+}
+
+std::size_t QuantizedInference::getWeightBytes() const {
+  std::size_t bytes = 0;
+  for (const QuantizedLayer &layer : m_layers) {
+    bytes += layer.weights.size() * sizeof(std::int8_t) +
+             layer.weightScales.size() * sizeof(double) +
+             layer.weightSums.size() * sizeof(std::int32_t);
+  }
+  return bytes;
+}
+
+std::string QuantizedInference::getKernelName() { return getKernel().name; }
@@ -0,0 +1,110 @@
+#ifndef _QUANTIZED_INFERENCE_H
+#define _QUANTIZED_INFERENCE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "alignedAllocator.h"
+#include "inference.h"
+
+/** One weight matrix in 8 bits. Every output neuron (channel) has its own
+ * scale, inputs are stored as unsigned 8 bit values with a scale and a zero
+ * point found during calibration.*/
+struct QuantizedLayer {
+  /** Number of inputs (neurons on the left).*/
+  int inputs;
+  /** Number of outputs (neurons on the right).*/
+  int outputs;
+  /** Inputs rounded up to a multiple of 64, the length of a weight row.*/
+  int paddedInputs;
+  /** (outputs x paddedInputs) weights, one row per output neuron, padded
+   * with zeros.*/
+  std::vector<std::int8_t, AlignedAllocator<std::int8_t>> weights;
+  /** Scale of every output neuron, weight = scale * stored weight.*/
+  std::vector<double> weightScales;
+  /** Sum of the stored weights of every output neuron, removes the zero
+   * point of the inputs from the dot products.*/
+  std::vector<std::int32_t> weightSums;
+  /** Input = inputScale * (stored input - inputZeroPoint).*/
+  double inputScale;
+  int inputZeroPoint;
+  /** Activation of the output neurons.*/
+  ActivationType activation;
+};
+
+/** Buffers of one thread evaluating a quantized network.*/
+struct QuantizedBuffers {
+  /** Inputs of the current layer in 8 bits (batch x paddedInputs).*/
+  std::vector<std::uint8_t, AlignedAllocator<std::uint8_t>> inputs;
+  /** Integer dot products of the current layer (batch x outputs).*/
+  std::vector<std::int32_t> products;
+  /** Values and activated values of every layer after the input.*/
+  InferenceBuffers layers;
+};
+
+/**
+ * @brief Network with 8 bit weights for fast evaluation. Weights are
+ * quantized per output neuron from a trained network, the range of the
+ * inputs of every layer comes from running the trained network on
+ * calibration samples. Dot products are exact in 32 bit integers, only the
+ * result is scaled back to double before the bias and the activation.
+ */
+class QuantizedInference {
+public:
+  /**
+   * @brief Quantize a trained network.
+   *
+   * @param inference trained network.
+   * @param calibration samples used to find the range of every layer's
+   * inputs, one per row.
+   * @throws std::runtime_error when there are no calibration samples.
+   */
+  QuantizedInference(const Inference &inference, const Matrix &calibration);
+
+  /**
+   * @brief Create buffers for batches of up to rows samples.
+   *
+   * @param rows largest number of samples in a batch.
+   * @return QuantizedBuffers buffers for one thread.
+   */
+  QuantizedBuffers createBuffers(int rows) const;
+
+  /**
+   * @brief Feed a batch forward through the quantized network. Only the
+   * buffers are written, like Inference::forward.
+   *
+   * @param inputs (batch x input layer) matrix, one sample per row.
+   * @param buffers buffers of the calling thread.
+   * @return const Matrix& (batch x output layer) output of the network,
+   * it lives in buffers.
+   */
+  const Matrix &forward(const Matrix &inputs, QuantizedBuffers &buffers) const;
+
+  /**
+   * @brief Get the number of bytes of the quantized weights, scales
+   * included.
+   *
+   * @return std::size_t size of the model.
+   */
+  std::size_t getWeightBytes() const;
+
+  /**
+   * @brief Get the name of the dot product kernel selected for this CPU.
+   *
+   * @return std::string "avx512vnni", "avx2" or "generic".
+   */
+  static std::string getKernelName();
+
+private:
+  /** Quantized weight matrices, one per layer after the input.*/
+  std::vector<QuantizedLayer> m_layers;
+  /** Number of neurons in each layer.*/
+  std::vector<int> m_topology;
+  /** Added to every neuron after the input layer.*/
+  double m_bias;
+  /** Every input value is multiplied by this before the first layer.*/
+  double m_inputScale;
+};
+
+#endif // _QUANTIZED_INFERENCE_H
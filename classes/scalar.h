@@ -0,0 +1,35 @@
+#ifndef _SCALAR_H
+#define _SCALAR_H
+
+#include "simd.h"
+
+/**
+ * Type of every value a Matrix holds: weights, neuron values, gradients,
+ * optimizer state and samples. It is chosen when the project is
+ * configured, -DNN_SCALAR=float (the default) or -DNN_SCALAR=double. Float
+ * halves the bytes every kernel moves and fits twice as many values into a
+ * vector register. Errors, losses and other sums over many values are kept
+ * in double either way.
+ */
+#ifdef NN_SCALAR_DOUBLE
+using Scalar = double;
+/** Name of the scalar type for reports.*/
+constexpr const char *kScalarName = "double";
+#else
+using Scalar = float;
+constexpr const char *kScalarName = "float";
+#endif
+
+/**
+ * @brief a * b + c rounded once, for kernels whose sums must round like
+ * Gemm's on every instruction set.
+ */
+NN_ALWAYS_INLINE Scalar fusedMultiplyAdd(Scalar a, Scalar b, Scalar c) {
+#ifdef NN_SCALAR_DOUBLE
+  return __builtin_fma(a, b, c);
+#else
+  return __builtin_fmaf(a, b, c);
+#endif
+}
+
+#endif // _SCALAR_H
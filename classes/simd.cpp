@@ -0,0 +1,38 @@
+#include "simd.h"
+
+#include <cstdlib>
+
+namespace {
+SimdLevel detectLevel() {
+  const char *forced = std::getenv("NN_SIMD");
+  const std::string wanted = forced != nullptr ? forced : "";
+#if NN_X86
+  __builtin_cpu_init();
+  if ((wanted.empty() || wanted == "avx512") &&
+      __builtin_cpu_supports("avx512f")) {
+    return SimdLevel::Avx512;
+  }
+  if ((wanted.empty() || wanted == "avx512" || wanted == "avx2") &&
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return SimdLevel::Avx2;
+  }
+#endif
+  return SimdLevel::Generic;
+}
+} // namespace
+
+SimdLevel Simd::getLevel() {
+  static const SimdLevel level = detectLevel();
+  return level;
+}
+
+std::string Simd::getLevelName(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Avx512:
+    return "avx512";
+  case SimdLevel::Avx2:
+    return "avx2";
+  default:
+    return "generic";
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef _SIMD_H
+#define _SIMD_H
+
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NN_X86 1
+/** Compile a function for the given instruction set, e.g. "avx2,fma".*/
+#define NN_TARGET(isa) __attribute__((target(isa)))
+/** Kernel templates are inlined into every NN_TARGET function that uses
+ * them, so each gets compiled for that instruction set.*/
+#define NN_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define NN_X86 0
+#define NN_TARGET(isa)
+#define NN_ALWAYS_INLINE inline
+#endif
+
+/** Instruction sets the kernels are compiled for.*/
+enum class SimdLevel { Generic, Avx2, Avx512 };
+
+class Simd {
+public:
+  /**
+   * @brief Get the widest instruction set the CPU supports. Environment
+   * variable NN_SIMD ("generic", "avx2" or "avx512") can force a narrower
+   * one, for comparing kernels.
+   *
+   * @return SimdLevel instruction set kernels should use.
+   */
+  static SimdLevel getLevel();
+
+  /**
+   * @brief Get the name of an instruction set.
+   *
+   * @param level instruction set.
+   * @return std::string "generic", "avx2" or "avx512".
+   */
+  static std::string getLevelName(SimdLevel level);
+};
+
+#endif // _SIMD_H
@@ -0,0 +1,249 @@
+#include "sparseMatrix.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "simd.h"
+#include "threadPool.h"
+
+namespace {
+
+/** Multiply adds done by one task, smaller products stay on one thread.*/
+constexpr double kMinValuesPerTask = 1 << 16;
+/** Columns of the result updated together, the rows of a block stay in L1
+ * while the weight rows stream past.*/
+constexpr int kBlockColumns = 64;
+
+/** One product of a sparse and a dense matrix, or a part of it.*/
+struct SparseArguments {
+  const std::size_t *columnOffsets;
+  const int *rows;
+  const Scalar *values;
+  /** Number of columns of the sparse matrix.*/
+  int columns;
+  const Scalar *b;
+  int bRowStride;
+  /** Number of columns of b and of the result.*/
+  int n;
+  Scalar *c;
+  int cRowStride;
+  /** Rows of the result computed by this task.*/
+  int begin;
+  int end;
+};
+
+/** target += scale * row. Where the instruction set has them every term
+ * is a fused multiply add, so the sums round as in Gemm.*/
+template <bool Fused>
+NN_ALWAYS_INLINE void addScaledRow(Scalar scale, const Scalar *__restrict row,
+                                   Scalar *__restrict target, int n) {
+  for (int j = 0; j < n; ++j) {
+    if constexpr (Fused) {
+      target[j] = fusedMultiplyAdd(scale, row[j], target[j]);
+    } else {
+      target[j] += scale * row[j];
+    }
+  }
+}
+
+/** Rows [begin, end) of a * b. Row p of b is added to every row of c whose
+ * sample has input p set, so it is read once per block of columns while
+ * the rows of c stay in cache. The sums run over p in order, as in Gemm.*/
+template <bool Fused>
+NN_ALWAYS_INLINE void multiplyRows(const SparseArguments &args) {
+  for (int r = args.begin; r < args.end; ++r) {
+    Scalar *cRow = args.c + static_cast<std::size_t>(r) * args.cRowStride;
+    std::fill(cRow, cRow + args.n, 0.0);
+  }
+  for (int block = 0; block < args.n; block += kBlockColumns) {
+    const int width = std::min(kBlockColumns, args.n - block);
+    for (int p = 0; p < args.columns; ++p) {
+      const int *columnEnd = args.rows + args.columnOffsets[p + 1];
+      const int *row = std::lower_bound(args.rows + args.columnOffsets[p],
+                                        columnEnd, args.begin);
+      const Scalar *bRow =
+          args.b + static_cast<std::size_t>(p) * args.bRowStride + block;
+      for (; row != columnEnd && *row < args.end; ++row) {
+        Scalar *cRow =
+            args.c + static_cast<std::size_t>(*row) * args.cRowStride;
+        addScaledRow<Fused>(args.values[row - args.rows], bRow, cRow + block,
+                            width);
+      }
+    }
+  }
+}
+
+/** Rows [begin, end) of a^T * b, row r of c is the sum of the rows of b
+ * picked by column r of a, each one written once.*/
+template <bool Fused>
+NN_ALWAYS_INLINE void multiplyTransposedRows(const SparseArguments &args) {
+  for (int r = args.begin; r < args.end; ++r) {
+    Scalar *cRow = args.c + static_cast<std::size_t>(r) * args.cRowStride;
+    std::fill(cRow, cRow + args.n, 0.0);
+    for (std::size_t q = args.columnOffsets[r];
+         q < args.columnOffsets[r + 1]; ++q) {
+      addScaledRow<Fused>(
+          args.values[q],
+          args.b + static_cast<std::size_t>(args.rows[q]) * args.bRowStride,
+          cRow, args.n);
+    }
+  }
+}
+
+template <bool Fused>
+NN_ALWAYS_INLINE void multiplyAny(const SparseArguments &args,
+                                  bool transposed) {
+  if (transposed) {
+    multiplyTransposedRows<Fused>(args);
+  } else {
+    multiplyRows<Fused>(args);
+  }
+}
+
+#if NN_X86
+NN_TARGET("avx512f")
+void multiplyAvx512(const SparseArguments &args, bool transposed) {
+  multiplyAny<true>(args, transposed);
+}
+
+NN_TARGET("avx2,fma")
+void multiplyAvx2(const SparseArguments &args, bool transposed) {
+  multiplyAny<true>(args, transposed);
+}
+#endif
+
+void multiplyGeneric(const SparseArguments &args, bool transposed) {
+  multiplyAny<false>(args, transposed);
+}
+
+using MultiplyFunction = void (*)(const SparseArguments &, bool);
+
+MultiplyFunction selectKernel() {
+  switch (Simd::getLevel()) {
+#if NN_X86
+  case SimdLevel::Avx512:
+    return multiplyAvx512;
+  case SimdLevel::Avx2:
+    return multiplyAvx2;
+#endif
+  default:
+    return multiplyGeneric;
+  }
+}
+
+/** Rows of the result are spread over the threads, each task gets about
+ * kMinValuesPerTask multiply adds.*/
+void run(SparseArguments args, int resultRows, std::size_t nonZeros,
+         bool transposed) {
+  static const MultiplyFunction kernel = selectKernel();
+  const double valuesPerRow =
+      static_cast<double>(nonZeros) * args.n / std::max(1, resultRows);
+  const int grain = static_cast<int>(
+      std::max(1.0, kMinValuesPerTask / std::max(1.0, valuesPerRow)));
+  ThreadPool::getInstance().parallelFor(
+      0, resultRows, grain, [&](int begin, int end) {
+        SparseArguments task = args;
+        task.begin = begin;
+        task.end = end;
+        kernel(task, transposed);
+      });
+}
+
+} // namespace
+
+SparseMatrix::SparseMatrix()
+    : m_numberOfRows(0), m_numberOfColumns(0), m_columnOffsets(1, 0) {}
+
+bool SparseMatrix::compress(const Scalar *dense, int rows, int columns,
+                            int rowStride, double maxDensity) {
+  m_numberOfRows = rows;
+  m_numberOfColumns = columns;
+  if (maxDensity <= 0.0) {
+    return false;
+  }
+  // Count the values of every column, the dense matrix is read row by
+  // row both times.
+  m_columnOffsets.assign(static_cast<std::size_t>(columns) + 1, 0);
+  const double limit = maxDensity * rows * columns;
+  std::size_t nonZeros = 0;
+  for (int r = 0; r < rows; ++r) {
+    const Scalar *row = dense + static_cast<std::size_t>(r) * rowStride;
+    std::size_t *counts = m_columnOffsets.data() + 1;
+    for (int c = 0; c < columns; ++c) {
+      // Without a branch, a pixel is set or not at random.
+      const std::size_t isSet = row[c] != 0.0;
+      counts[c] += isSet;
+      nonZeros += isSet;
+    }
+    if (static_cast<double>(nonZeros) >= limit) {
+      return false;
+    }
+  }
+  for (int c = 0; c < columns; ++c) {
+    m_columnOffsets[c + 1] += m_columnOffsets[c];
+  }
+  m_rows.resize(nonZeros);
+  m_values.resize(nonZeros);
+  // Offset c is moved to the end of column c while it is filled, the
+  // rows come in ascending order.
+  for (int r = 0; r < rows; ++r) {
+    const Scalar *row = dense + static_cast<std::size_t>(r) * rowStride;
+    for (int c = 0; c < columns; ++c) {
+      if (row[c] != 0.0) {
+        const std::size_t q = m_columnOffsets[c]++;
+        m_rows[q] = r;
+        m_values[q] = row[c];
+      }
+    }
+  }
+  for (int c = columns; c > 0; --c) {
+    m_columnOffsets[c] = m_columnOffsets[c - 1];
+  }
+  m_columnOffsets[0] = 0;
+  return true;
+}
+
+bool SparseMatrix::compress(const Matrix &dense, double maxDensity) {
+  return compress(dense.data(), dense.getNumberOfRows(),
+                  dense.getNumberOfColumns(), dense.getStride(), maxDensity);
+}
+
+void SparseMatrix::multiply(const SparseMatrix &a, const Matrix &b,
+                            Matrix &result) {
+  if (a.m_numberOfColumns != b.getNumberOfRows() ||
+      result.getNumberOfRows() != a.m_numberOfRows ||
+      result.getNumberOfColumns() != b.getNumberOfColumns()) {
+    throw std::runtime_error("Matrix multiplication not possible.\n");
+  }
+  run({a.m_columnOffsets.data(), a.m_rows.data(), a.m_values.data(),
+       a.m_numberOfColumns, b.data(), b.getStride(), b.getNumberOfColumns(),
+       result.data(), result.getStride(), 0, 0},
+      a.m_numberOfRows, a.getNumberOfNonZeros(), false);
+}
+
+void SparseMatrix::multiplyTransposedLeft(const SparseMatrix &a,
+                                          const Matrix &b, Matrix &result) {
+  if (a.m_numberOfRows != b.getNumberOfRows() ||
+      result.getNumberOfRows() != a.m_numberOfColumns ||
+      result.getNumberOfColumns() != b.getNumberOfColumns()) {
+    throw std::runtime_error("Matrix multiplication not possible.\n");
+  }
+  run({a.m_columnOffsets.data(), a.m_rows.data(), a.m_values.data(),
+       a.m_numberOfColumns, b.data(), b.getStride(), b.getNumberOfColumns(),
+       result.data(), result.getStride(), 0, 0},
+      a.m_numberOfColumns, a.getNumberOfNonZeros(), true);
+}
+
+int SparseMatrix::getNumberOfRows() const { return m_numberOfRows; }
+
+int SparseMatrix::getNumberOfColumns() const { return m_numberOfColumns; }
+
+std::size_t SparseMatrix::getNumberOfNonZeros() const {
+  return m_values.size();
+}
+
+double SparseMatrix::getDensity() const {
+  const double size =
+      static_cast<double>(m_numberOfRows) * m_numberOfColumns;
+  return size > 0.0 ? getNumberOfNonZeros() / size : 0.0;
+}
@@ -0,0 +1,103 @@
+#ifndef _SPARSE_MATRIX_H
+#define _SPARSE_MATRIX_H
+
+#include <cstddef>
+#include <vector>
+
+#include "matrix.h"
+
+/**
+ * @brief Matrix that keeps only its non zero values, column after column in
+ * compressed sparse column (CSC) form. Input batches of images are mostly
+ * zeros, the first layer then only reads the weight rows of the pixels
+ * that are set instead of all of them. A column of the batch is one input
+ * of the network, so its weight row is read once per batch, not once per
+ * sample.
+ *
+ * The buffers keep their capacity, so compressing one batch after the
+ * other allocates only until the largest batch was seen.
+ */
+class SparseMatrix {
+public:
+  /**
+   * @brief Construct a new empty Sparse Matrix object.
+   *
+   */
+  SparseMatrix();
+
+  /**
+   * @brief Compress a dense matrix, if it is sparse enough to pay off.
+   *
+   * @param dense values of the first row.
+   * @param rows number of rows.
+   * @param columns number of columns.
+   * @param rowStride distance between two neighbouring rows.
+   * @param maxDensity give up once this share of the values is non zero.
+   * @return true the matrix holds the non zero values of dense.
+   * @return false dense is too dense, the matrix must not be used.
+   */
+  bool compress(const Scalar *dense, int rows, int columns, int rowStride,
+                double maxDensity);
+
+  /**
+   * @brief Compress a dense matrix, if it is sparse enough to pay off.
+   *
+   * @param dense matrix to compress.
+   * @param maxDensity give up once this share of the values is non zero.
+   * @return true the matrix holds the non zero values of dense.
+   * @return false dense is too dense, the matrix must not be used.
+   */
+  bool compress(const Matrix &dense, double maxDensity);
+
+  /**
+   * @brief Multiply a with a dense matrix, only the rows of b whose column
+   * of a is not all zeros are read.
+   *
+   * @param a left matrix (m x k).
+   * @param b right matrix (k x n).
+   * @param result (m x n) matrix that receives a * b.
+   */
+  static void multiply(const SparseMatrix &a, const Matrix &b,
+                       Matrix &result);
+
+  /**
+   * @brief Multiply the transpose of a with b, the sum of the outer
+   * products of the rows. Rows of the result whose column of a is all
+   * zeros are set to zero without any arithmetic, every other row is
+   * written once.
+   *
+   * @param a left matrix (k x m), used as (m x k).
+   * @param b right matrix (k x n).
+   * @param result (m x n) matrix that receives a^T * b.
+   */
+  static void multiplyTransposedLeft(const SparseMatrix &a, const Matrix &b,
+                                     Matrix &result);
+
+  int getNumberOfRows() const;
+  int getNumberOfColumns() const;
+
+  /**
+   * @brief Get the number of values that are stored.
+   *
+   * @return std::size_t non zero values.
+   */
+  std::size_t getNumberOfNonZeros() const;
+
+  /**
+   * @brief Get the share of the values that are non zero.
+   *
+   * @return double between 0 and 1.
+   */
+  double getDensity() const;
+
+private:
+  int m_numberOfRows;
+  int m_numberOfColumns;
+  /** Column c is stored at [m_columnOffsets[c], m_columnOffsets[c + 1]).*/
+  std::vector<std::size_t> m_columnOffsets;
+  /** Row of every stored value, ascending within a column.*/
+  std::vector<int> m_rows;
+  std::vector<Scalar> m_values;
+};
+
+#endif // _SPARSE_MATRIX_H
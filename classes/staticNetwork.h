@@ -0,0 +1,286 @@
+#ifndef _STATIC_NETWORK_H
+#define _STATIC_NETWORK_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "activation.h"
+#include "alignedAllocator.h"
+#include "matrix.h"
+#include "simd.h"
+
+/**
+ * @brief One layer of a StaticNetwork.
+ *
+ * @tparam Neurons number of neurons in the layer.
+ * @tparam Type activation function, not used for the input layer.
+ */
+template <int Neurons, ActivationType Type = ActivationType::Sigmoid>
+struct StaticLayer {
+  static_assert(Neurons > 0, "A layer needs at least one neuron.");
+  static constexpr int neurons = Neurons;
+  static constexpr ActivationType activation = Type;
+};
+
+/** Outputs of one batch, owned by the evaluating thread.*/
+struct StaticBuffers {
+  Matrix outputs;
+};
+
+/**
+ * @brief Forward pass of a network whose topology is known at compile time,
+ * e.g. StaticNetwork<StaticLayer<784>, StaticLayer<10, ActivationType::Relu>>.
+ * Every layer is a loop of constant trip counts that the compiler unrolls,
+ * the bias and the activation are applied while the result is still in
+ * registers and the values between the layers live on the stack, so a
+ * sample is evaluated without touching the heap.
+ *
+ * The sums run in the order of Gemm for a few rows and the activations use
+ * the formulas of Activation::apply, on the same instruction set. A sample
+ * gets bit for bit the output Inference gives for it in a batch of up to
+ * four rows.
+ *
+ * @tparam Layers StaticLayer of every layer, the input layer first.
+ */
+template <typename... Layers> class StaticNetwork {
+public:
+  /** Number of layers, the input layer included.*/
+  static constexpr std::size_t kNumberOfLayers = sizeof...(Layers);
+  static_assert(kNumberOfLayers >= 2, "A network needs at least two layers.");
+  /** Number of neurons in each layer.*/
+  static constexpr std::array<int, kNumberOfLayers> kTopology{
+      Layers::neurons...};
+  /** Activation function of each layer.*/
+  static constexpr std::array<ActivationType, kNumberOfLayers> kActivations{
+      Layers::activation...};
+
+  /**
+   * @brief Construct a new Static Network object, the weights are copied
+   * into one aligned block.
+   *
+   * @param weights weight matrices of a checkpoint or a JSON weights file.
+   * @param bias added to every neuron after the input layer.
+   * @param inputScale every input value is multiplied by it first.
+   * @throws std::runtime_error when the weights do not fit the topology.
+   */
+  StaticNetwork(const std::vector<std::shared_ptr<Matrix>> &weights,
+                double bias, double inputScale = 1.0)
+      : m_weights(kWeightOffsets.back()), m_bias(static_cast<Scalar>(bias)),
+        m_inputScale(inputScale), m_kernel(selectKernel()) {
+    if (weights.size() + 1 != kNumberOfLayers) {
+      throw std::runtime_error("Weights do not fit the static topology.");
+    }
+    for (std::size_t i = 0; i + 1 < kNumberOfLayers; ++i) {
+      const Matrix &matrix = *weights[i];
+      if (matrix.getNumberOfRows() != kTopology[i] ||
+          matrix.getNumberOfColumns() != kTopology[i + 1]) {
+        throw std::runtime_error("Weights do not fit the static topology.");
+      }
+      Scalar *target = m_weights.data() + kWeightOffsets[i];
+      for (int row = 0; row < kTopology[i]; ++row) {
+        std::copy(matrix.row(row).data(),
+                  matrix.row(row).data() + kTopology[i + 1],
+                  target + static_cast<std::size_t>(row) * kTopology[i + 1]);
+      }
+    }
+  }
+
+  /**
+   * @brief Check whether a network from a config file has this topology.
+   * The activation of the input layer is not used and not compared.
+   *
+   * @param topology number of neurons in each layer.
+   * @param activations activation function of each layer.
+   * @return true the network can be evaluated by this class.
+   */
+  static bool matches(const std::vector<int> &topology,
+                      const std::vector<ActivationType> &activations) {
+    if (topology.size() != kNumberOfLayers ||
+        activations.size() != kNumberOfLayers) {
+      return false;
+    }
+    for (std::size_t i = 0; i < kNumberOfLayers; ++i) {
+      if (topology[i] != kTopology[i] ||
+          (i > 0 && activations[i] != kActivations[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Feed one sample forward.
+   *
+   * @param input kTopology.front() values.
+   * @param output kTopology.back() values are written here.
+   */
+  void forward(const Scalar *input, Scalar *output) const {
+    if (m_inputScale == 1.0) {
+      m_kernel(m_weights.data(), m_bias, input, output);
+      return;
+    }
+    alignas(kMatrixAlignment) Scalar scaled[kTopology.front()];
+    for (int i = 0; i < kTopology.front(); ++i) {
+      scaled[i] = static_cast<Scalar>(input[i] * m_inputScale);
+    }
+    m_kernel(m_weights.data(), m_bias, scaled, output);
+  }
+
+  /**
+   * @brief Create buffers for batches of up to rows samples.
+   *
+   * @param rows largest number of samples in a batch.
+   * @return StaticBuffers buffers for one thread.
+   */
+  StaticBuffers createBuffers(int rows) const {
+    return {Matrix(rows, kTopology.back(), false)};
+  }
+
+  /**
+   * @brief Feed a batch forward one sample after the other, the same
+   * interface as Inference::forward.
+   *
+   * @param inputs (batch x input layer) matrix, one sample per row.
+   * @param buffers buffers of the calling thread, resized to the batch.
+   * @return const Matrix& (batch x output layer) output of the network,
+   * it lives in buffers.
+   */
+  const Matrix &forward(const Matrix &inputs, StaticBuffers &buffers) const {
+    if (inputs.getNumberOfColumns() != kTopology.front()) {
+      throw std::runtime_error(
+          "Input size is not the same as the INPUT LAYER SIZE.");
+    }
+    buffers.outputs.resize(inputs.getNumberOfRows(), kTopology.back());
+    for (int row = 0; row < inputs.getNumberOfRows(); ++row) {
+      forward(inputs.row(row).data(), buffers.outputs.row(row).data());
+    }
+    return buffers.outputs;
+  }
+
+private:
+  using Kernel = void (*)(const Scalar *, Scalar, const Scalar *, Scalar *);
+
+  static constexpr std::array<std::size_t, kNumberOfLayers> getOffsets() {
+    std::array<std::size_t, kNumberOfLayers> offsets{};
+    for (std::size_t i = 0; i + 1 < kNumberOfLayers; ++i) {
+      offsets[i + 1] = offsets[i] + static_cast<std::size_t>(kTopology[i]) *
+                                        kTopology[i + 1];
+    }
+    return offsets;
+  }
+
+  /** Start of every weight matrix in the block, the last entry is the size
+   * of the block.*/
+  static constexpr std::array<std::size_t, kNumberOfLayers> kWeightOffsets =
+      getOffsets();
+  /** Largest layer after the input, sizes the stack buffers.*/
+  static constexpr int kLargestLayer =
+      *std::max_element(kTopology.begin() + 1, kTopology.end());
+
+  /** Layer after Index: sums in the order of Gemm's streaming product,
+   * then bias and activation. Gemm's sums are contracted to fused multiply
+   * adds where the instruction set has them, here that is explicit, the
+   * compiler may not contract every unrolled sum.*/
+  template <std::size_t Index, bool Fused>
+  static NN_ALWAYS_INLINE void layer(const Scalar *__restrict weights,
+                                     Scalar bias,
+                                     const Scalar *__restrict in,
+                                     Scalar *__restrict out) {
+    constexpr int inputs = kTopology[Index];
+    constexpr int outputs = kTopology[Index + 1];
+    for (int j = 0; j < outputs; ++j) {
+      out[j] = 0.0;
+    }
+    for (int p = 0; p < inputs; ++p) {
+      const Scalar scale = in[p];
+      const Scalar *__restrict row =
+          weights + static_cast<std::size_t>(p) * outputs;
+      for (int j = 0; j < outputs; ++j) {
+        if constexpr (Fused) {
+          out[j] = fusedMultiplyAdd(scale, row[j], out[j]);
+        } else {
+          out[j] += scale * row[j];
+        }
+      }
+    }
+    for (int j = 0; j < outputs; ++j) {
+      out[j] = Activation::activate<kActivations[Index + 1]>(out[j] + bias);
+    }
+  }
+
+  template <bool Fused, std::size_t... Index>
+  static NN_ALWAYS_INLINE void layers(std::index_sequence<Index...>,
+                                      const Scalar *weights, Scalar bias,
+                                      const Scalar *input, Scalar *output) {
+    // Layers take turns writing to the two buffers, the last one writes
+    // the output.
+    alignas(kMatrixAlignment) Scalar buffers[2][kLargestLayer];
+    (layer<Index, Fused>(weights + kWeightOffsets[Index], bias,
+                  Index == 0 ? input : buffers[(Index + 1) % 2],
+                  Index + 2 == kNumberOfLayers ? output : buffers[Index % 2]),
+     ...);
+  }
+
+  template <bool Fused>
+  static NN_ALWAYS_INLINE void forwardAny(const Scalar *weights, Scalar bias,
+                                          const Scalar *input,
+                                          Scalar *output) {
+    layers<Fused>(std::make_index_sequence<kNumberOfLayers - 1>(), weights,
+                  bias, input, output);
+  }
+
+#if NN_X86
+  NN_TARGET("avx512f")
+  static void forwardAvx512(const Scalar *weights, Scalar bias,
+                            const Scalar *input, Scalar *output) {
+    forwardAny<true>(weights, bias, input, output);
+  }
+
+  NN_TARGET("avx2,fma")
+  static void forwardAvx2(const Scalar *weights, Scalar bias,
+                          const Scalar *input, Scalar *output) {
+    forwardAny<true>(weights, bias, input, output);
+  }
+#endif
+
+  static void forwardGeneric(const Scalar *weights, Scalar bias,
+                             const Scalar *input, Scalar *output) {
+    forwardAny<false>(weights, bias, input, output);
+  }
+
+  static Kernel selectKernel() {
+    switch (Simd::getLevel()) {
+#if NN_X86
+    case SimdLevel::Avx512:
+      return forwardAvx512;
+    case SimdLevel::Avx2:
+      return forwardAvx2;
+#endif
+    default:
+      return forwardGeneric;
+    }
+  }
+
+  /** Weight matrices one after the other, each row after row.*/
+  std::vector<Scalar, AlignedAllocator<Scalar>> m_weights;
+  /** Added to every neuron after the input layer.*/
+  Scalar m_bias;
+  /** Every input value is multiplied by this before the first layer.*/
+  double m_inputScale;
+  /** Forward pass compiled for the instruction set of the CPU.*/
+  Kernel m_kernel;
+};
+
+/** Topology of the production model, 784-428-128-10 with relu, relu, tanh
+ * and sigmoid, compiled in so predict can evaluate it without dispatch.*/
+using ProductionNetwork =
+    StaticNetwork<StaticLayer<784>, StaticLayer<428, ActivationType::Relu>,
+                  StaticLayer<128, ActivationType::Tanh>,
+                  StaticLayer<10, ActivationType::Sigmoid>>;
+
+#endif // _STATIC_NETWORK_H
@@ -0,0 +1,194 @@
+#include "threadPool.h"
+
+#include <algorithm>
+
+namespace {
+/** Index of the worker running on this thread, -1 for other threads.*/
+thread_local int t_workerIndex = -1;
+} // namespace
+
+ThreadPool &ThreadPool::getInstance() {
+  static ThreadPool pool;
+  return pool;
+}
+
+ThreadPool::ThreadPool() { setNumberOfThreads(0); }
+
+ThreadPool::~ThreadPool() { stop(); }
+
+void ThreadPool::setNumberOfThreads(int numberOfThreads) {
+  if (numberOfThreads <= 0) {
+    numberOfThreads =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  stop();
+  start(numberOfThreads - 1);
+}
+
+int ThreadPool::getNumberOfThreads() const {
+  return static_cast<int>(m_workers.size()) + 1;
+}
+
+void ThreadPool::start(int numberOfWorkers) {
+  m_stop = false;
+  m_queues.clear();
+  for (int i = 0; i < numberOfWorkers; ++i) {
+    auto queue = std::make_unique<WorkerQueue>();
+    queue->tasks.resize(kQueueCapacity);
+    m_queues.push_back(std::move(queue));
+  }
+  for (int i = 0; i < numberOfWorkers; ++i) {
+    m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+void ThreadPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_stop = true;
+  }
+  m_wakeUp.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+  m_workers.clear();
+}
+
+void ThreadPool::run(int begin, int end, int grain, RangeFunction function,
+                     void *context) {
+  const int size = end - begin;
+  if (size <= 0) {
+    return;
+  }
+  grain = std::max(1, grain);
+  const int threads = getNumberOfThreads();
+  // A few chunks per thread, so stealing can even out uneven chunks.
+  const int numberOfChunks =
+      std::min((size + grain - 1) / grain, threads * 4);
+  if (numberOfChunks <= 1 || threads == 1 || t_workerIndex >= 0) {
+    function(context, begin, end);
+    return;
+  }
+
+  Job job;
+  job.function = function;
+  job.context = context;
+  job.remaining.store(numberOfChunks);
+
+  const int chunkSize = size / numberOfChunks;
+  const int leftover = size % numberOfChunks;
+  int chunkBegin = begin;
+  int pushed = 0;
+  for (int chunk = 0; chunk < numberOfChunks; ++chunk) {
+    const int chunkEnd = chunkBegin + chunkSize + (chunk < leftover ? 1 : 0);
+    const Task task{&job, chunkBegin, chunkEnd};
+    const int queue = static_cast<int>(m_nextQueue.fetch_add(1) %
+                                       static_cast<unsigned>(m_queues.size()));
+    if (push(queue, task)) {
+      ++pushed;
+    } else {
+      // Queue is full, do it here instead.
+      execute(task);
+    }
+    chunkBegin = chunkEnd;
+  }
+  if (pushed > 0) {
+    {
+      // A worker that saw no tasks is either not waiting yet or already
+      // asleep once we own the mutex, so the notification is not lost.
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeUp.notify_all();
+  }
+
+  // Help until every chunk of this job is done.
+  while (job.remaining.load(std::memory_order_acquire) > 0) {
+    Task task;
+    if (findTask(0, task)) {
+      execute(task);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  if (job.error) {
+    std::rethrow_exception(job.error);
+  }
+}
+
+void ThreadPool::execute(const Task &task) {
+  Job *job = task.job;
+  try {
+    job->function(job->context, task.begin, task.end);
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(job->errorMutex);
+    if (!job->error) {
+      job->error = std::current_exception();
+    }
+  }
+  job->remaining.fetch_sub(1, std::memory_order_release);
+}
+
+bool ThreadPool::push(int index, const Task &task) {
+  WorkerQueue &queue = *m_queues[index];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.count == kQueueCapacity) {
+      return false;
+    }
+    queue.tasks[(queue.head + queue.count) % kQueueCapacity] = task;
+    ++queue.count;
+  }
+  m_queuedTasks.fetch_add(1);
+  return true;
+}
+
+bool ThreadPool::popBack(int index, Task &task) {
+  WorkerQueue &queue = *m_queues[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.count == 0) {
+    return false;
+  }
+  --queue.count;
+  task = queue.tasks[(queue.head + queue.count) % kQueueCapacity];
+  m_queuedTasks.fetch_sub(1);
+  return true;
+}
+
+bool ThreadPool::stealFront(int index, Task &task) {
+  WorkerQueue &queue = *m_queues[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.count == 0) {
+    return false;
+  }
+  task = queue.tasks[queue.head];
+  queue.head = (queue.head + 1) % kQueueCapacity;
+  --queue.count;
+  m_queuedTasks.fetch_sub(1);
+  return true;
+}
+
+bool ThreadPool::findTask(int preferred, Task &task) {
+  const int numberOfQueues = static_cast<int>(m_queues.size());
+  for (int offset = 0; offset < numberOfQueues; ++offset) {
+    if (stealFront((preferred + offset) % numberOfQueues, task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(int index) {
+  t_workerIndex = index;
+  while (true) {
+    Task task;
+    if (popBack(index, task) || findTask(index + 1, task)) {
+      execute(task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_wakeUp.wait(lock, [this] { return m_stop || m_queuedTasks.load() > 0; });
+    if (m_stop && m_queuedTasks.load() == 0) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,127 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool {
+public:
+  /**
+   * @brief Get the pool shared by the whole process. It is created on first
+   * use with one thread per hardware core.
+   *
+   * @return ThreadPool& the shared pool.
+   */
+  static ThreadPool &getInstance();
+
+  /**
+   * @brief Destroy the Thread Pool object, waits for the workers to stop.
+   *
+   */
+  virtual ~ThreadPool();
+
+  /**
+   * @brief Set how many threads (the calling one included) split the work.
+   * Must not be called while a parallelFor is running.
+   *
+   * @param numberOfThreads number of threads, 0 means one per hardware core.
+   */
+  void setNumberOfThreads(int numberOfThreads);
+
+  /**
+   * @brief Get the number of threads that split the work, the calling
+   * thread included.
+   *
+   * @return int number of threads.
+   */
+  int getNumberOfThreads() const;
+
+  /**
+   * @brief Splits [begin, end) into chunks of at least grain indices and
+   * calls body(chunkBegin, chunkEnd) for each of them on the pool. The
+   * calling thread helps and returns once every chunk is done. Ranges that
+   * fit into one chunk, and calls made from inside a worker, run inline.
+   *
+   * @param begin first index.
+   * @param end one past the last index.
+   * @param grain smallest number of indices worth a separate task.
+   * @param body callable as body(int chunkBegin, int chunkEnd).
+   */
+  template <typename Body>
+  void parallelFor(int begin, int end, int grain, Body &&body) {
+    using BodyType = std::remove_reference_t<Body>;
+    run(
+        begin, end, grain,
+        [](void *context, int chunkBegin, int chunkEnd) {
+          (*static_cast<BodyType *>(context))(chunkBegin, chunkEnd);
+        },
+        const_cast<void *>(static_cast<const void *>(&body)));
+  }
+
+private:
+  using RangeFunction = void (*)(void *, int, int);
+
+  /** One parallelFor call, lives on the stack of the calling thread.*/
+  struct Job {
+    RangeFunction function;
+    void *context;
+    std::atomic<int> remaining{0};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+  };
+
+  /** One chunk of a job.*/
+  struct Task {
+    Job *job;
+    int begin;
+    int end;
+  };
+
+  /** Fixed size task queue of one worker. The owner takes tasks from the
+   * back, other threads steal from the front.*/
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::vector<Task> tasks;
+    std::size_t head = 0;
+    std::size_t count = 0;
+  };
+
+  ThreadPool();
+
+  void run(int begin, int end, int grain, RangeFunction function,
+           void *context);
+  void start(int numberOfWorkers);
+  void stop();
+  void workerLoop(int index);
+  bool push(int index, const Task &task);
+  bool popBack(int index, Task &task);
+  bool stealFront(int index, Task &task);
+  bool findTask(int preferred, Task &task);
+  static void execute(const Task &task);
+
+  /** Capacity of every worker queue.*/
+  static constexpr std::size_t kQueueCapacity = 256;
+
+  /** Background threads, the calling thread is not counted.*/
+  std::vector<std::thread> m_workers;
+  /** One queue per worker.*/
+  std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+  /** Tasks pushed but not yet taken by any thread.*/
+  std::atomic<int> m_queuedTasks{0};
+  /** Next queue to receive a task.*/
+  std::atomic<unsigned> m_nextQueue{0};
+  /** Guards sleeping workers.*/
+  std::mutex m_sleepMutex;
+  /** Wakes workers when tasks arrive or the pool stops.*/
+  std::condition_variable m_wakeUp;
+  /** Set when the workers should exit.*/
+  bool m_stop = false;
+};
+
+#endif // _THREAD_POOL_H
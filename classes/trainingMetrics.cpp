@@ -0,0 +1,176 @@
+#include "trainingMetrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include <sys/resource.h>
+
+#include "allocationCounter.h"
+#include "nlohmann/json.hpp"
+
+double EpochMetrics::getSamplesPerSecond() const {
+  return seconds > 0.0 ? samples / seconds : 0.0;
+}
+
+TrainingMetrics::TrainingMetrics(const std::string &filePath,
+                                 const std::string &format)
+    : m_filePath(filePath), m_isPrometheus(false), m_totalSamples(0),
+      m_allocationsAtStart(0), m_bytesAtStart(0) {
+  if (format == "prometheus") {
+    m_isPrometheus = true;
+  } else if (format != "jsonl") {
+    throw std::runtime_error("Invalid metrics format: " + format);
+  }
+  if (!m_filePath.empty() && !m_isPrometheus) {
+    // Every run starts a new file.
+    std::ofstream file(m_filePath, std::ios::trunc);
+  }
+  startEpoch();
+}
+
+void TrainingMetrics::startEpoch() {
+  m_epochStart = std::chrono::steady_clock::now();
+  m_phaseSeconds.fill(0.0);
+  m_allocationsAtStart = AllocationCounter::getAllocations();
+  m_bytesAtStart = AllocationCounter::getBytes();
+}
+
+void TrainingMetrics::add(TrainingPhase phase, double seconds) {
+  m_phaseSeconds[static_cast<std::size_t>(phase)] += seconds;
+}
+
+EpochMetrics TrainingMetrics::finishEpoch(std::size_t epoch,
+                                          std::size_t samples,
+                                          double meanLoss) {
+  EpochMetrics metrics;
+  metrics.epoch = epoch;
+  metrics.samples = samples;
+  metrics.seconds = getSecondsSince(m_epochStart);
+  metrics.meanLoss = meanLoss;
+  metrics.phaseSeconds = m_phaseSeconds;
+  metrics.peakRssBytes = getPeakRssBytes();
+  metrics.allocations =
+      AllocationCounter::getAllocations() - m_allocationsAtStart;
+  metrics.allocatedBytes = AllocationCounter::getBytes() - m_bytesAtStart;
+
+  m_totalSamples += samples;
+  for (std::size_t i = 0; i < m_phaseSeconds.size(); ++i) {
+    m_totalPhaseSeconds[i] += m_phaseSeconds[i];
+  }
+  if (!m_filePath.empty()) {
+    if (m_isPrometheus) {
+      writePrometheus(metrics);
+    } else {
+      writeJsonLine(metrics);
+    }
+  }
+  startEpoch();
+  return metrics;
+}
+
+const char *TrainingMetrics::getPhaseName(TrainingPhase phase) {
+  switch (phase) {
+  case TrainingPhase::DataLoading:
+    return "dataLoading";
+  case TrainingPhase::FeedForward:
+    return "feedForward";
+  case TrainingPhase::SetErrors:
+    return "setErrors";
+  case TrainingPhase::BackPropagation:
+    return "backPropagation";
+  case TrainingPhase::WeightUpdate:
+    return "weightUpdate";
+  default:
+    return "unknown";
+  }
+}
+
+std::size_t TrainingMetrics::getPeakRssBytes() {
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // Linux reports kilobytes.
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+}
+
+double TrainingMetrics::getSecondsSince(
+    std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void TrainingMetrics::writeJsonLine(const EpochMetrics &metrics) const {
+  nlohmann::json line;
+  line["epoch"] = metrics.epoch;
+  line["samples"] = metrics.samples;
+  line["seconds"] = metrics.seconds;
+  line["samplesPerSecond"] = metrics.getSamplesPerSecond();
+  line["meanLoss"] = metrics.meanLoss;
+  for (std::size_t i = 0; i < metrics.phaseSeconds.size(); ++i) {
+    line["phaseSeconds"][getPhaseName(static_cast<TrainingPhase>(i))] =
+        metrics.phaseSeconds[i];
+  }
+  line["peakRssBytes"] = metrics.peakRssBytes;
+  line["allocations"] = metrics.allocations;
+  line["allocatedBytes"] = metrics.allocatedBytes;
+
+  std::ofstream file(m_filePath, std::ios::app);
+  if (!file.is_open()) {
+    std::cerr << "Could not write metrics to " << m_filePath << std::endl;
+    return;
+  }
+  file << line.dump() << "\n";
+}
+
+void TrainingMetrics::writePrometheus(const EpochMetrics &metrics) const {
+  // Written next to the target and renamed, a scraper never sees half a
+  // file.
+  const std::string temporaryPath = m_filePath + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::trunc);
+    if (!file.is_open()) {
+      std::cerr << "Could not write metrics to " << m_filePath << std::endl;
+      return;
+    }
+    file << "# HELP nn_training_epoch Epochs finished.\n"
+         << "# TYPE nn_training_epoch gauge\n"
+         << "nn_training_epoch " << metrics.epoch << "\n"
+         << "# HELP nn_training_samples_total Samples trained.\n"
+         << "# TYPE nn_training_samples_total counter\n"
+         << "nn_training_samples_total " << m_totalSamples << "\n"
+         << "# HELP nn_training_samples_per_second Throughput of the last "
+            "epoch.\n"
+         << "# TYPE nn_training_samples_per_second gauge\n"
+         << "nn_training_samples_per_second "
+         << metrics.getSamplesPerSecond() << "\n"
+         << "# HELP nn_training_mean_loss Mean error of the last epoch.\n"
+         << "# TYPE nn_training_mean_loss gauge\n"
+         << "nn_training_mean_loss " << metrics.meanLoss << "\n"
+         << "# HELP nn_training_phase_seconds_total Time spent in every "
+            "phase.\n"
+         << "# TYPE nn_training_phase_seconds_total counter\n";
+    for (std::size_t i = 0; i < m_totalPhaseSeconds.size(); ++i) {
+      file << "nn_training_phase_seconds_total{phase=\""
+           << getPhaseName(static_cast<TrainingPhase>(i)) << "\"} "
+           << m_totalPhaseSeconds[i] << "\n";
+    }
+    file << "# HELP nn_training_peak_rss_bytes Largest resident set size.\n"
+         << "# TYPE nn_training_peak_rss_bytes gauge\n"
+         << "nn_training_peak_rss_bytes " << metrics.peakRssBytes << "\n"
+         << "# HELP nn_training_allocations_total Heap allocations.\n"
+         << "# TYPE nn_training_allocations_total counter\n"
+         << "nn_training_allocations_total "
+         << AllocationCounter::getAllocations() << "\n"
+         << "# HELP nn_training_allocated_bytes_total Bytes allocated.\n"
+         << "# TYPE nn_training_allocated_bytes_total counter\n"
+         << "nn_training_allocated_bytes_total "
+         << AllocationCounter::getBytes() << "\n";
+  }
+  if (std::rename(temporaryPath.c_str(), m_filePath.c_str()) != 0) {
+    std::cerr << "Could not write metrics to " << m_filePath << std::endl;
+  }
+}
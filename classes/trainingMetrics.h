@@ -0,0 +1,134 @@
+#ifndef _TRAINING_METRICS_H
+#define _TRAINING_METRICS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/** Parts of a training step that are timed separately.*/
+enum class TrainingPhase {
+  /** Waiting for a batch and copying it into the network.*/
+  DataLoading,
+  FeedForward,
+  SetErrors,
+  /** Back propagation without the weight updates.*/
+  BackPropagation,
+  WeightUpdate,
+  /** Number of phases, not a phase.*/
+  Count
+};
+
+/** Seconds spent in every phase.*/
+using PhaseSeconds =
+    std::array<double, static_cast<std::size_t>(TrainingPhase::Count)>;
+
+/** What happened during one epoch.*/
+struct EpochMetrics {
+  /** Epochs finished, counting from 1.*/
+  std::size_t epoch = 0;
+  /** Samples trained in the epoch.*/
+  std::size_t samples = 0;
+  /** Wall time of the epoch.*/
+  double seconds = 0.0;
+  /** Mean error of one sample over the epoch.*/
+  double meanLoss = 0.0;
+  PhaseSeconds phaseSeconds{};
+  /** Largest resident set size of the process so far.*/
+  std::size_t peakRssBytes = 0;
+  /** Heap allocations during the epoch.*/
+  std::size_t allocations = 0;
+  /** Bytes allocated during the epoch.*/
+  std::size_t allocatedBytes = 0;
+
+  /**
+   * @brief Get the training throughput.
+   *
+   * @return double samples per second.
+   */
+  double getSamplesPerSecond() const;
+};
+
+/**
+ * @brief Collects the time of every training phase and exports one record
+ * per epoch, either as a line of JSON appended to a file or as a text file
+ * in the Prometheus exposition format that is replaced every epoch.
+ * Timing a phase costs two clock reads, so it stays on in production runs.
+ */
+class TrainingMetrics {
+public:
+  /**
+   * @brief Construct a new Training Metrics object.
+   *
+   * @param filePath where the metrics are exported, empty for nowhere.
+   * @param format "jsonl" or "prometheus".
+   * @throws std::runtime_error for any other format.
+   */
+  TrainingMetrics(const std::string &filePath, const std::string &format);
+
+  /**
+   * @brief Start a new epoch, resets the phase times and remembers the
+   * allocation counters.
+   *
+   */
+  void startEpoch();
+
+  /**
+   * @brief Add time to a phase of the current epoch.
+   *
+   * @param phase phase the time was spent in.
+   * @param seconds time spent.
+   */
+  void add(TrainingPhase phase, double seconds);
+
+  /**
+   * @brief Finish the epoch and export its metrics.
+   *
+   * @param epoch epochs finished, counting from 1.
+   * @param samples samples trained in the epoch.
+   * @param meanLoss mean error of one sample over the epoch.
+   * @return EpochMetrics the metrics of the epoch.
+   */
+  EpochMetrics finishEpoch(std::size_t epoch, std::size_t samples,
+                           double meanLoss);
+
+  /**
+   * @brief Get the name of a phase, as it is exported.
+   *
+   * @param phase training phase.
+   * @return const char* name in camel case.
+   */
+  static const char *getPhaseName(TrainingPhase phase);
+
+  /**
+   * @brief Get the largest resident set size of the process so far.
+   *
+   * @return std::size_t peak RSS in bytes.
+   */
+  static std::size_t getPeakRssBytes();
+
+  /**
+   * @brief Seconds since a point in time, for timing a phase.
+   *
+   * @param start when the phase started.
+   * @return double elapsed seconds.
+   */
+  static double getSecondsSince(std::chrono::steady_clock::time_point start);
+
+private:
+  void writeJsonLine(const EpochMetrics &metrics) const;
+  void writePrometheus(const EpochMetrics &metrics) const;
+
+  std::string m_filePath;
+  /** Export as Prometheus text instead of JSON lines.*/
+  bool m_isPrometheus;
+  std::chrono::steady_clock::time_point m_epochStart;
+  PhaseSeconds m_phaseSeconds{};
+  /** Phase times of all epochs, Prometheus counters only grow.*/
+  PhaseSeconds m_totalPhaseSeconds{};
+  std::size_t m_totalSamples;
+  std::size_t m_allocationsAtStart;
+  std::size_t m_bytesAtStart;
+};
+
+#endif // _TRAINING_METRICS_H
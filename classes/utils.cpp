@@ -1,33 +1,15 @@
 #include "utils.h"
 
-std::vector<std::vector<double>> Utils::getDataFromFile(std::string filePath) {
-  std::vector<std::vector<double>> data;
+#include "dataset.h"
 
-  std::ifstream file(filePath);
-
-  std::string line;
-
-  if (file.is_open()) {
-    while (std::getline(file, line)) {
-      std::vector<double> dataRow;
-      std::string oneData;
-      std::stringstream ss(line);
-
-      while (std::getline(ss, oneData, ',')) {
-        dataRow.push_back(std::stof(oneData));
-      }
-      data.push_back(dataRow);
-    }
-  } else {
-    std::cerr << "Can not open a file " << filePath << std::endl;
-  }
-  return data;
+std::shared_ptr<Matrix> Utils::getDataFromFile(std::string filePath) {
+  return Dataset::open(filePath)->readAll();
 }
 // i want a vector of matrix
 void Utils::saveWeightToFile(std::string pathToFile,
                              std::vector<std::shared_ptr<Matrix>> weights) {
   nlohmann::json json = {};
-  std::vector<std::vector<std::vector<double>>> vectorWeightMatrixs;
+  std::vector<std::vector<std::vector<Scalar>>> vectorWeightMatrixs;
 
   for (std::size_t i = 0; i < weights.size(); ++i) {
     vectorWeightMatrixs.push_back(weights.at(i)->getMatrix());
@@ -47,7 +29,7 @@ std::vector<std::shared_ptr<Matrix>>
 Utils::loadWeights(std::string pathToFile) {
 
   std::ifstream file(pathToFile);
-  std::vector<std::vector<std::vector<double>>> vectorWeightMatrixs;
+  std::vector<std::vector<std::vector<Scalar>>> vectorWeightMatrixs;
   std::vector<std::shared_ptr<Matrix>> readMatrix;
 
   if (!file.is_open()) {
@@ -88,3 +70,10 @@ void Utils::missingInputArgumentPredict() {
 void Utils::missingInputArgumentTrain() {
   std::cout << "Use: ./train </path/to/the/config.json>" << std::endl;
 }
+
+void Utils::missingInputArgumentConvert() {
+  std::cout << "Use: ./convert </path/to/the/data.csv> [/path/to/data.bin]"
+            << std::endl;
+  std::cout << "  or: ./convert </path/to/weights.ckpt> "
+            << "</path/to/weights16.ckpt> [bf16|fp16]" << std::endl;
+}
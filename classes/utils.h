@@ -13,13 +13,15 @@
 class Utils {
 public:
   /**
-   * @brief Get the data from a file.
+   * @brief Get all data from a file, either a binary dataset or a CSV, see
+   * Dataset::open. A binary dataset is mapped and not copied.
    *
    * @param filePath path to a data file.
-   * @return std::vector<std::vector<double>> all data that is gathered from a
-   * file.
+   * @return std::shared_ptr<Matrix> all data that is gathered from a file,
+   * one sample per row. Empty when the file can not be opened.
+   * @throws std::runtime_error when the file holds invalid data.
    */
-  static std::vector<std::vector<double>> getDataFromFile(std::string filePath);
+  static std::shared_ptr<Matrix> getDataFromFile(std::string filePath);
 
   /**
    * @brief After training it saves weight to the .json file.
@@ -48,6 +50,12 @@ public:
    *
    */
   static void missingInputArgumentTrain();
+
+  /**
+   * @brief Print correct use of dataset conversion.
+   *
+   */
+  static void missingInputArgumentConvert();
 };
 
 #endif // _UTILS_H
\ No newline at end of file
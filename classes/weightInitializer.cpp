@@ -0,0 +1,123 @@
+#include "weightInitializer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+#include "threadPool.h"
+
+namespace {
+
+/** Values drawn by one task.*/
+constexpr int kMinValuesPerTask = 1 << 14;
+
+/** Constants of Philox4x32 from Salmon et al., "Parallel random numbers:
+ * as easy as 1, 2, 3".*/
+constexpr std::uint32_t kMultiplier0 = 0xD2511F53u;
+constexpr std::uint32_t kMultiplier1 = 0xCD9E8D57u;
+constexpr std::uint32_t kWeyl0 = 0x9E3779B9u;
+constexpr std::uint32_t kWeyl1 = 0xBB67AE85u;
+constexpr int kRounds = 10;
+
+using Block = std::array<std::uint32_t, 4>;
+
+/** Four random 32 bit words for a counter, ten rounds of Philox4x32.*/
+Block philox(Block counter, std::uint64_t seed) {
+  std::uint32_t key0 = static_cast<std::uint32_t>(seed);
+  std::uint32_t key1 = static_cast<std::uint32_t>(seed >> 32);
+  for (int round = 0; round < kRounds; ++round) {
+    const std::uint64_t product0 =
+        static_cast<std::uint64_t>(kMultiplier0) * counter[0];
+    const std::uint64_t product1 =
+        static_cast<std::uint64_t>(kMultiplier1) * counter[2];
+    counter = {static_cast<std::uint32_t>(product1 >> 32) ^ counter[1] ^ key0,
+               static_cast<std::uint32_t>(product1),
+               static_cast<std::uint32_t>(product0 >> 32) ^ counter[3] ^ key1,
+               static_cast<std::uint32_t>(product0)};
+    key0 += kWeyl0;
+    key1 += kWeyl1;
+  }
+  return counter;
+}
+
+/** Upper 24 bits of a word as a value in [0, 1), exact in a float.*/
+Scalar toUnit(std::uint32_t word) {
+  return static_cast<Scalar>(word >> 8) * static_cast<Scalar>(1.0 / (1 << 24));
+}
+
+} // namespace
+
+InitializationType WeightInitializer::typeFromString(const std::string &name) {
+  if (name.empty() || name == "auto") {
+    return InitializationType::Auto;
+  } else if (name == "xavier") {
+    return InitializationType::Xavier;
+  } else if (name == "he") {
+    return InitializationType::He;
+  }
+  throw std::runtime_error("Invalid weight initialization: " + name);
+}
+
+std::string WeightInitializer::getTypeName(InitializationType type) {
+  switch (type) {
+  case InitializationType::Xavier:
+    return "xavier";
+  case InitializationType::He:
+    return "he";
+  default:
+    return "auto";
+  }
+}
+
+InitializationType WeightInitializer::resolve(InitializationType type,
+                                              ActivationType activation) {
+  if (type != InitializationType::Auto) {
+    return type;
+  }
+  return activation == ActivationType::Relu ? InitializationType::He
+                                            : InitializationType::Xavier;
+}
+
+void WeightInitializer::initialize(Matrix &weights, InitializationType type,
+                                   std::uint64_t seed, std::uint32_t stream) {
+  const double fanIn = std::max(1, weights.getNumberOfRows());
+  const double fanOut = std::max(1, weights.getNumberOfColumns());
+  const double limit = type == InitializationType::He
+                           ? std::sqrt(6.0 / fanIn)
+                           : std::sqrt(6.0 / (fanIn + fanOut));
+  fillUniform(weights, static_cast<Scalar>(-limit),
+              static_cast<Scalar>(limit), seed, stream);
+}
+
+void WeightInitializer::fillUniform(Matrix &matrix, Scalar low, Scalar high,
+                                    std::uint64_t seed, std::uint32_t stream) {
+  const int columns = matrix.getNumberOfColumns();
+  const Scalar range = high - low;
+  // The upper bound is never reached, also after rounding.
+  const Scalar largest = std::nextafter(high, low);
+  ThreadPool::getInstance().parallelFor(
+      0, matrix.getNumberOfRows(),
+      std::max(1, kMinValuesPerTask / std::max(1, columns)),
+      [&](int begin, int end) {
+        // Value i of the matrix is word i % 4 of block i / 4, whichever
+        // thread draws it.
+        std::uint64_t i = static_cast<std::uint64_t>(begin) * columns;
+        Block words = {};
+        bool isDrawn = false;
+        for (int r = begin; r < end; ++r) {
+          Scalar *row = matrix.row(r).data();
+          for (int c = 0; c < columns; ++c, ++i) {
+            if (i % 4 == 0 || !isDrawn) {
+              const std::uint64_t block = i / 4;
+              words = philox({static_cast<std::uint32_t>(block),
+                              static_cast<std::uint32_t>(block >> 32),
+                              stream, 0},
+                             seed);
+              isDrawn = true;
+            }
+            row[c] = std::min(low + range * toUnit(words[i % 4]), largest);
+          }
+        }
+      });
+}
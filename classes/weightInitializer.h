@@ -0,0 +1,83 @@
+#ifndef _WEIGHT_INITIALIZER_H
+#define _WEIGHT_INITIALIZER_H
+
+#include <cstdint>
+#include <string>
+
+#include "activation.h"
+#include "matrix.h"
+
+/** How the starting weights of a layer are drawn.*/
+enum class InitializationType {
+  /** Picked from the activation of the layer the weights feed: He for
+   * relu, Xavier otherwise.*/
+  Auto,
+  /** Xavier/Glorot, uniform in +-sqrt(6 / (fanIn + fanOut)). Keeps the
+   * variance of the values and of the gradients for sigmoid and tanh.*/
+  Xavier,
+  /** He, uniform in +-sqrt(6 / fanIn). Makes up for the half of the
+   * values relu sets to zero.*/
+  He
+};
+
+/**
+ * @brief Fills weight matrices with random values from Philox4x32-10, a
+ * counter based generator. Value i of stream s is a function of the seed,
+ * s and i only, so the rows are filled by all threads at once and the
+ * result does not depend on their number. The same seed gives the same
+ * weights.
+ */
+class WeightInitializer {
+public:
+  /**
+   * @brief Get the scheme from its name in the config file.
+   *
+   * @param name "" or "auto", "xavier" or "he".
+   * @return InitializationType scheme.
+   * @throws std::runtime_error for any other name.
+   */
+  static InitializationType typeFromString(const std::string &name);
+
+  /**
+   * @brief Get the name of a scheme.
+   *
+   * @param type scheme.
+   * @return std::string "auto", "xavier" or "he".
+   */
+  static std::string getTypeName(InitializationType type);
+
+  /**
+   * @brief Resolve Auto for the layer the weights feed.
+   *
+   * @param type requested scheme.
+   * @param activation activation function of the right layer.
+   * @return InitializationType Xavier or He.
+   */
+  static InitializationType resolve(InitializationType type,
+                                    ActivationType activation);
+
+  /**
+   * @brief Draw the weights between two layers, (fanIn x fanOut).
+   *
+   * @param weights matrix to fill, its rows are the fan in.
+   * @param type Xavier or He, Auto is taken as Xavier.
+   * @param seed seed of the run.
+   * @param stream index of the matrix, every matrix gets its own values.
+   */
+  static void initialize(Matrix &weights, InitializationType type,
+                         std::uint64_t seed, std::uint32_t stream);
+
+  /**
+   * @brief Fill a matrix with values uniform in [low, high).
+   *
+   * @param matrix matrix to fill.
+   * @param low smallest value.
+   * @param high bound no value reaches.
+   * @param seed seed of the values.
+   * @param stream index of the matrix.
+   */
+  static void fillUniform(Matrix &matrix, Scalar low, Scalar high,
+                          std::uint64_t seed, std::uint32_t stream);
+};
+
+#endif // _WEIGHT_INITIALIZER_H
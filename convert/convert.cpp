@@ -0,0 +1,71 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "checkpoint.h"
+#include "csvDataset.h"
+#include "datasetFile.h"
+#include "halfMatrix.h"
+#include "utils.h"
+
+namespace {
+
+/** Write the weights of a checkpoint again in 16 bits.*/
+int convertCheckpoint(const std::string &inputPath,
+                      const std::string &outputPath,
+                      const std::string &typeName) {
+  const HalfType type = HalfMatrix::typeFromString(typeName);
+  if (type == HalfType::None) {
+    throw std::runtime_error("A checkpoint is converted to bf16 or fp16.");
+  }
+  const CheckpointData data = Checkpoint::load(inputPath);
+  Checkpoint::save(outputPath, data, type);
+  std::size_t values = 0;
+  for (const auto &weights : data.weights) {
+    values += static_cast<std::size_t>(weights->getNumberOfRows()) *
+              weights->getNumberOfColumns();
+  }
+  std::cout << "Wrote " << outputPath << ": " << values << " weights as "
+            << typeName << std::endl;
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+
+  if (argc != 2 && argc != 3 && argc != 4) {
+    Utils::missingInputArgumentConvert();
+    exit(-1);
+  }
+
+  const std::string inputPath = argv[1];
+
+  try {
+    if (Checkpoint::isCheckpoint(inputPath)) {
+      if (argc < 3) {
+        Utils::missingInputArgumentConvert();
+        return 1;
+      }
+      return convertCheckpoint(inputPath, argv[2],
+                               argc == 4 ? argv[3] : "bf16");
+    }
+    const std::string &csvPath = inputPath;
+    const std::string binaryPath =
+        argc >= 3 ? argv[2] : DatasetFile::getCachePath(csvPath);
+    CsvDataset data(csvPath);
+    if (data.getNumberOfRows() == 0) {
+      std::cerr << "No data in " << csvPath << std::endl;
+      return 1;
+    }
+    DatasetFile::write(binaryPath, data, csvPath);
+    std::cout << "Wrote " << binaryPath << ": " << data.getNumberOfRows()
+              << " rows x " << data.getNumberOfColumns() << " columns"
+              << std::endl;
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -6,7 +6,6 @@
 
 #include "matrix.h"
 #include "neuralNetwork.h"
-#include "neuron.h"
 #include "nlohmann/json.hpp"
 
 int main(int argc, char **argv) {
@@ -37,16 +36,35 @@ int main(int argc, char **argv) {
           {item["numberOfNeurons"], item["activationFunction"]});
     }
 
+    predict.bias = data["bias"];
     predict.loadWeightsPath = data["weightsFile"];
-    predict.testDataPath = data["testData"];
-    predict.testLabelDataPath = data["testLabelData"];
+    predict.batchSize = data.value("batchSize", 64);
+    predict.numberOfThreads = data.value("numberOfThreads", 0);
+    predict.serve = data.value("serve", false);
+    predict.socketPath = data.value("socketPath", "");
+    predict.maxBatchSize = data.value("maxBatchSize", 64);
+    predict.maxLatencyMs = data.value("maxLatencyMs", 1.0);
+    predict.probabilities = data.value("probabilities", false);
+    predict.calibrationDataPath = data.value("calibrationData", "");
+    predict.calibrationSamples = data.value("calibrationSamples", 1000);
+    predict.sparseInputThreshold = data.value("sparseInputThreshold", 0.25);
+    predict.halfWeights = data.value("halfWeights", "");
+    predict.inputScale = data.value("inputScale", 1.0);
+    if (!predict.serve) {
+      predict.testDataPath = data["testData"];
+      predict.testLabelDataPath = data["testLabelData"];
+    }
 
   } catch (nlohmann::json::parse_error &e) {
     std::cerr << "JSON parsing error: " << e.what() << std::endl;
   }
 
   std::unique_ptr<NeuralNetwork> NN = std::make_unique<NeuralNetwork>(predict);
-  NN->predict();
+  if (predict.serve) {
+    NN->serve();
+  } else {
+    NN->predict();
+  }
 
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include <cstdlib>
+#include <new>
+
+#include "allocationCounter.h"
+
+namespace {
+void *allocate(std::size_t bytes) {
+  AllocationCounter::count(bytes);
+  void *memory = std::malloc(bytes == 0 ? 1 : bytes);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+} // namespace
+
+// Replacements of the global allocation functions, so every new of train
+// is counted. They are linked into train only, programs that use the
+// classes library keep their own. Over-aligned new keeps the library's
+// version.
+void *operator new(std::size_t bytes) { return allocate(bytes); }
+
+void *operator new[](std::size_t bytes) { return allocate(bytes); }
+
+void *operator new(std::size_t bytes, const std::nothrow_t &) noexcept {
+  AllocationCounter::count(bytes);
+  return std::malloc(bytes == 0 ? 1 : bytes);
+}
+
+void *operator new[](std::size_t bytes, const std::nothrow_t &) noexcept {
+  AllocationCounter::count(bytes);
+  return std::malloc(bytes == 0 ? 1 : bytes);
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+void operator delete[](void *memory) noexcept { std::free(memory); }
+
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+
+void operator delete[](void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+  std::free(memory);
+}
@@ -6,7 +6,6 @@
 
 #include "matrix.h"
 #include "neuralNetwork.h"
-#include "neuron.h"
 #include "nlohmann/json.hpp"
 
 int main(int argc, char **argv) {
@@ -19,6 +18,7 @@ int main(int argc, char **argv) {
   Params params;
   int epoch = 0;
   std::string pathToSaveWeights;
+  std::string pathToExportJson;
 
   try {
 
@@ -41,11 +41,33 @@ int main(int argc, char **argv) {
 
     params.bias = data["bias"];
     params.learningRate = data["learningRate"];
-    params.momentum = data["momentum"];
+    params.momentum = data.value("momentum", 0.9);
     params.trainingDataPath = data["trainingData"];
     params.labelDataPath = data["labelData"];
+    params.batchSize = data.value("batchSize", 1);
+    params.numberOfThreads = data.value("numberOfThreads", 0);
+    params.shuffle = data.value("shuffle", false);
+    params.seed = data.value("seed", std::uint64_t{0});
+    params.weightInitialization = data.value("weightInitialization", "");
+    params.inputScale = data.value("inputScale", 1.0);
+    params.prefetchDepth = data.value("prefetchDepth", 2);
     epoch = data["epoch"];
     pathToSaveWeights = data["weightsFile"];
+    pathToExportJson = data.value("exportJson", "");
+    params.checkpointPath = data.value("checkpointFile", pathToSaveWeights);
+    params.checkpointEverySamples =
+        data.value("checkpointEverySamples", std::size_t{0});
+    params.checkpointEveryEpochs = data.value("checkpointEveryEpochs", 0);
+    params.resumeFrom = data.value("resumeFrom", "");
+    params.trainingMode = data.value("trainingMode", "");
+    params.optimizer = data.value("optimizer", "sgd");
+    params.beta1 = data.value("beta1", 0.9);
+    params.beta2 = data.value("beta2", 0.999);
+    params.epsilon = data.value("epsilon", 1e-8);
+    params.metricsFile = data.value("metricsFile", "");
+    params.metricsFormat = data.value("metricsFormat", "jsonl");
+    params.sparseInputThreshold = data.value("sparseInputThreshold", 0.25);
+    params.halfWeights = data.value("halfWeights", "");
 
   } catch (nlohmann::json::parse_error &e) {
     std::cerr << "JSON parsing error: " << e.what() << std::endl;
@@ -54,7 +76,14 @@ int main(int argc, char **argv) {
   std::unique_ptr<NeuralNetwork> NN = std::make_unique<NeuralNetwork>(params);
   NN->train(epoch);
   // save weights
-  Utils::saveWeightToFile(pathToSaveWeights, NN->getWeightMatrices());
+  try {
+    Checkpoint::save(pathToSaveWeights, NN->getCheckpointData());
+  } catch (const std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+  }
+  if (!pathToExportJson.empty()) {
+    Utils::saveWeightToFile(pathToExportJson, NN->getWeightMatrices());
+  }
 
   for (auto const &j : params.numOfNeuronsActivationFunction) {
     std::cout << "Activation function: " << j.activationFunction << std::endl;